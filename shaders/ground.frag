@@ -38,6 +38,8 @@ void main() {
 
 	// Convert the extracted normal_from_map to a surface normal
     vec4 normal = 2.0 * normalFromMap - 1.0;
+	// Rebuild z from x and y, so that normal maps cooked to BC5, which only stores x and y, work too
+	normal.z = sqrt(max(1.0 - dot(normal.xy, normal.xy), 0.0));
 	
 	// Extract the texture from the texture map
     vec4 texColor = texture(tex, fTexCoord);
@@ -4,9 +4,17 @@
 layout(location = 0) in vec3 position;
 layout(location = 1) in vec3 normal;
 layout(location = 2) in vec2 texCoord;
-layout(location = 3) in vec3 tangent;		// vertex tangent vector
+layout(location = 3) in vec4 tangent;		// vertex tangent vector, with the handedness of the texture mapping in w
 
-uniform mat4 model, view, projection;
+// Set once a frame for every program, as FrameUniforms in programs.h lays it out
+layout(std140) uniform Frame {
+	mat4 view;
+	mat4 projection;
+	vec3 cameraPosition_W;
+	vec3 lightPosition_W;
+};
+
+uniform mat4 model;
 uniform uint colourMode;
 
 out vec4 fColour;
@@ -18,7 +26,6 @@ vec3 lightDir = vec3(0.0, 5.0, 10.0);
 
 void main() {	
 	vec4 positionH = vec4(position, 1.0);		
-	vec4 tangentH = vec4(tangent, 1.0);		
 	
 	vec4 diffuseColour;		
 	if (colourMode == 1)
@@ -31,8 +38,8 @@ void main() {
 
 	// Calculate the normal, tangent and binormal vectors in model-view space
 	vec3 norm = normalize(normalMatrix * normal);
-	vec3 tang = normalize(normalMatrix * tangent);
-	vec3 binormal = normalize(cross(norm, tang)) * tangentH.w;
+	vec3 tang = normalize(normalMatrix * tangent.xyz);
+	vec3 binormal = normalize(cross(norm, tang)) * tangent.w;
 
 	// Define the matrix used to transform the light direction and view direction
 	// into tangent space
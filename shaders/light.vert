@@ -1,7 +1,15 @@
 #version 400 core
 layout (location = 0) in vec3 position_L;
 
-uniform mat4 model, view, projection;
+// Set once a frame for every program, as FrameUniforms in programs.h lays it out
+layout(std140) uniform Frame {
+	mat4 view;
+	mat4 projection;
+	vec3 cameraPosition_W;
+	vec3 lightPosition_W;
+};
+
+uniform mat4 model;
 
 void main() {
 	gl_Position = projection * view * model * vec4(position_L, 1.0);
@@ -8,9 +8,10 @@ float ambientLightStrength = 0.2;
 float specularLightStrength = 0.5;
 float shininess = 8;
 
-uniform sampler2D tex;
+uniform sampler2DArray materials;
 
 in vec2 fTexCoord;
+flat in float fMaterialLayer;
 in vec3 fPosition_V;
 in vec3 fNormal;
 in vec3 fLightPosition_V;
@@ -32,7 +33,7 @@ void main() {
 	vec3 specular = pow(max(dot(viewDir, reflectDir), 0.0), shininess) * specularLightStrength * lightColour;
 
 	//texture
-	vec4 texColour = texture(tex, fTexCoord);
+	vec4 texColour = texture(materials, vec3(fTexCoord, fMaterialLayer));
 
 	outputColor = vec4(ambient + diffuse + specular, 1.0) * texColour;
 }
\ No newline at end of file
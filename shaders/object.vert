@@ -6,19 +6,42 @@
 layout(location = 0) in vec3 position_L; //_L: local space
 layout(location = 1) in vec3 normal;
 layout(location = 2) in vec2 texCoord;
+layout(location = 4) in float materialLayer; // layer of the texture in the material array
+layout(location = 5) in mat4 instanceModel; // model matrix of each instance, in instanced draws
 
-uniform mat4 model, view, projection;
-uniform vec3 lightPosition_W;
+// Set once a frame for every program, as FrameUniforms in programs.h lays it out
+layout(std140) uniform Frame {
+	mat4 view;
+	mat4 projection;
+	vec3 cameraPosition_W;
+	vec3 lightPosition_W;
+};
+
+uniform mat4 model;
+uniform bool octahedralNormals; // normals are stored as two octahedral coordinates, rather than as xyz
+uniform bool instanced; // model only holds the dequantization, and instanceModel goes in front of it
 
 out vec2 fTexCoord;
+flat out float fMaterialLayer;
 out vec3 fPosition_V; //_V: view space;
 out vec3 fNormal;
 out vec3 fLightPosition_V;
 
+// Unfold an octahedral normal, as QuantizedMesh::octahedralDecode does
+vec3 octahedralDecode(vec2 e) {
+	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	if (n.z < 0.0) {
+		n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+	}
+	return normalize(n);
+}
+
 void main() {
 	fTexCoord = texCoord;
-	fPosition_V = (view * model * vec4(position_L, 1.0)).xyz;
-	fNormal = normal;
+	fMaterialLayer = materialLayer;
+	mat4 modelMatrix = instanced ? instanceModel * model : model;
+	fPosition_V = (view * modelMatrix * vec4(position_L, 1.0)).xyz;
+	fNormal = octahedralNormals ? octahedralDecode(normal.xy) : normal;
 	fLightPosition_V = (view * vec4(lightPosition_W, 1.0)).xyz;
 	gl_Position = projection * vec4(fPosition_V, 1.0);
 }
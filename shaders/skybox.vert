@@ -4,13 +4,19 @@
 #version 400 core
 layout (location = 0) in vec3 position;
 
-uniform mat4 view;
-uniform mat4 projection;
+// Set once a frame for every program, as FrameUniforms in programs.h lays it out
+layout(std140) uniform Frame {
+    mat4 view;
+    mat4 projection;
+    vec3 cameraPosition_W;
+    vec3 lightPosition_W;
+};
 
 out vec3 fTexCoord;
 
 void main() {
     fTexCoord = position;
-    vec4 pos = projection * view * vec4(position, 1.0);
+    // Only the camera's rotation, so that the skybox stays around it
+    vec4 pos = projection * mat4(mat3(view)) * vec4(position, 1.0);
     gl_Position = pos.xyww;
 }
\ No newline at end of file
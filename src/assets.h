@@ -0,0 +1,76 @@
+#pragma once
+
+#include <array>
+#include <future>
+#include <string>
+
+#include "objects/object/mesh_source.h"
+#include "objects/object/object.h"
+#include "objects/object/static_scene.h"
+#include "objects/texture/compressed_image.h"
+#include "objects/texture/image.h"
+#include "objects/texture/mip_chain.h"
+#include "thread_pool.h"
+
+// Loads the CPU side of assets (file I/O, OBJ parsing and image decoding) on a pool of worker threads.
+// Results are handed back as futures, and uploading them to OpenGL is left to the thread owning the context
+class AssetLoader {
+	ThreadPool pool;
+
+public:
+	// Start the given number of loader threads, or one per hardware thread if 0
+	explicit AssetLoader(unsigned int threadCount = 0) : pool(threadCount) {}
+
+	unsigned int getThreadCount() const {
+		return this->pool.getThreadCount();
+	}
+
+	// The loader threads, to share with work that runs once loading is done
+	ThreadPool& getPool() {
+		return this->pool;
+	}
+
+	// Mesh and texture of an Object
+	std::future<Object::Source> object(char const* path) {
+		auto owned = std::string(path);
+		return this->pool.submit([owned] { return Object::Source(owned.c_str()); });
+	}
+
+	// Bake and textures of a StaticScene, baking it first if needed
+	std::future<StaticScene::Source> staticScene(char const* path) {
+		auto owned = std::string(path);
+		return this->pool.submit([owned] { return StaticScene::Source(owned.c_str()); });
+	}
+
+	// Mesh with the given streams, as for MeshSource
+	std::future<MeshSource> mesh(char const* path, uint32_t streams) {
+		auto owned = std::string(path);
+		return this->pool.submit([owned, streams] { return MeshSource(owned.c_str(), streams); });
+	}
+
+	std::future<Image> image(char const* path) {
+		auto owned = std::string(path);
+		return this->pool.submit([owned] { return Image(owned.c_str()); });
+	}
+
+	// Decoded image with its mip chain built, averaging colours in linear space if srgb is set
+	std::future<MipChain> mipChain(char const* path, bool srgb) {
+		auto owned = std::string(path);
+		return this->pool.submit([owned, srgb] { return MipChain(Image(owned.c_str()), srgb); });
+	}
+
+	std::future<CompressedImage> compressedImage(char const* path) {
+		auto owned = std::string(path);
+		return this->pool.submit([owned] { return CompressedImage(owned.c_str()); });
+	}
+
+	// Wait for every future, collecting their results in order
+	template<typename T, size_t LEN>
+	static std::array<T, LEN> getAll(std::array<std::future<T>, LEN>& futures) {
+		std::array<T, LEN> results;
+		for (size_t i = 0; i < LEN; i++) {
+			results[i] = futures[i].get();
+		}
+		return results;
+	}
+};
@@ -0,0 +1,1008 @@
+#pragma once
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "bvh.h"
+#include "frustum_culling.h"
+#include "objects/object/mesh_lods.h"
+#include "objects/object/mesh_optimizer.h"
+#include "objects/object/mesh_source.h"
+#include "objects/object/meshlets.h"
+#include "objects/texture/mip_chain.h"
+#include "objects/vertex_array_object.h"
+#include "objects/vertex_layout.h"
+#include "occlusion_culling.h"
+#include "parallel_obj_loader.h"
+#include "programs.h"
+#include "scene.h"
+#include "window.h"
+
+// CPU-side benchmarks, run with `--bench <name>` in place of the scene. Only draws, instancing and indirect need an
+// OpenGL context, and open a window of their own for it
+namespace benchmarks {
+
+	inline double secondsSince(std::chrono::steady_clock::time_point start) {
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	// Write a side x side grid of quads with positions, texture coordinates and normals to the given path.
+	// Returns the size of the file in bytes
+	inline size_t writeGridObj(char const* path, int side) {
+		auto out = std::ofstream(path, std::ios::binary | std::ios::trunc);
+		char line[128];
+		for (int z = 0; z <= side; z++) {
+			for (int x = 0; x <= side; x++) {
+				snprintf(line, sizeof(line), "v %.6f %.6f %.6f\n", x * 0.01f, 0.001f * ((x * 7 + z * 13) % 17), z * 0.01f);
+				out << line;
+			}
+		}
+		for (int z = 0; z <= side; z++) {
+			for (int x = 0; x <= side; x++) {
+				snprintf(line, sizeof(line), "vt %.6f %.6f\n", (float)x / side, (float)z / side);
+				out << line;
+			}
+		}
+		out << "vn 0.000000 1.000000 0.000000\n";
+		out << "o Grid\n";
+		for (int z = 0; z < side; z++) {
+			for (int x = 0; x < side; x++) {
+				int a = z * (side + 1) + x + 1;
+				int b = a + side + 1;
+				snprintf(line, sizeof(line), "f %d/%d/1 %d/%d/1 %d/%d/1 %d/%d/1\n", a, a, b, b, b + 1, b + 1, a + 1, a + 1);
+				out << line;
+			}
+		}
+		return (size_t)out.tellp();
+	}
+
+	// OBJ parsing throughput of tinyobj against the parallel loader on a synthetic multi-million-face mesh
+	inline void objLoading() {
+		auto path = "bench_grid.obj";
+		auto side = 1500;
+		auto bytes = writeGridObj(path, side);
+		auto megabytes = bytes / (1024.0 * 1024.0);
+		std::cout << "OBJ loading: " << side * side << " quads, " << megabytes << " MiB" << std::endl;
+
+		{
+			tinyobj::attrib_t attrib;
+			std::vector<tinyobj::shape_t> shapes;
+			std::vector<tinyobj::material_t> materials;
+			std::string warn, err;
+			auto start = std::chrono::steady_clock::now();
+			tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, path);
+			auto seconds = secondsSince(start);
+			std::cout << "  tinyobj::LoadObj: " << seconds << " s, " << megabytes / seconds << " MiB/s" << std::endl;
+		}
+		auto threads = std::max(1u, std::thread::hardware_concurrency());
+		for (unsigned int threadCount = 1; threadCount <= threads; threadCount *= 2) {
+			tinyobj::attrib_t attrib;
+			std::vector<tinyobj::shape_t> shapes;
+			std::vector<tinyobj::material_t> materials;
+			std::string warn, err;
+			auto start = std::chrono::steady_clock::now();
+			parallel_obj::load(&attrib, &shapes, &materials, &warn, &err, path, threadCount);
+			auto seconds = secondsSince(start);
+			std::cout << "  parallel_obj::load, " << threadCount << " threads: " << seconds << " s, "
+				<< megabytes / seconds << " MiB/s" << std::endl;
+		}
+		std::remove(path);
+	}
+
+	// Mip chain generation from a synthetic 4096x4096 RGBA image, then the row filter with and without SIMD
+	inline void mipGeneration() {
+		auto side = 4096;
+		auto megapixels = side * side / 1e6;
+		auto pixels = std::vector<unsigned char>((size_t)side * side * 4);
+		for (size_t i = 0; i < pixels.size(); i++) { pixels[i] = (unsigned char)((i * 2654435761u) >> 24); }
+		std::cout << "Mip generation: " << side << "x" << side << " RGBA" << std::endl;
+
+		for (auto srgb : { false, true }) {
+			auto start = std::chrono::steady_clock::now();
+			auto chain = MipChain(pixels.data(), side, side, 4, srgb);
+			auto seconds = secondsSince(start);
+			std::cout << "  MipChain, " << (srgb ? "sRGB" : "linear") << ": " << chain.getLevelCount() << " levels in "
+				<< seconds << " s, " << megapixels / seconds << " MPix/s" << std::endl;
+		}
+
+		// The filter alone, over one level's worth of row pairs
+		auto rows = std::vector<float>((size_t)side * 4 * 2);
+		for (size_t i = 0; i < rows.size(); i++) { rows[i] = pixels[i] / 255.f; }
+		auto simdOut = std::vector<float>((size_t)side / 2 * 4);
+		auto scalarOut = simdOut;
+		auto start = std::chrono::steady_clock::now();
+		for (int y = 0; y < side / 2; y++) { MipChain::halveRows(&rows[0], &rows[(size_t)side * 4], side, simdOut.data()); }
+		auto simdSeconds = secondsSince(start);
+		start = std::chrono::steady_clock::now();
+		for (int y = 0; y < side / 2; y++) { MipChain::halveRowsScalar(&rows[0], &rows[(size_t)side * 4], side, scalarOut.data()); }
+		auto scalarSeconds = secondsSince(start);
+		std::cout << "  halveRows: " << megapixels / simdSeconds << " MPix/s SIMD, "
+			<< megapixels / scalarSeconds << " MPix/s scalar" << std::endl;
+		float difference = 0.f;
+		for (size_t i = 0; i < simdOut.size(); i++) { difference = std::max(difference, std::fabs(simdOut[i] - scalarOut[i])); }
+		std::cout << "  largest difference between the two: " << difference << std::endl;
+	}
+
+	// Vertex fetch from split streams against interleaved vertices, gathering every corner of a 1M-vertex grid
+	// through its index buffer, first in mesh order and then with its vertices shuffled. Full vertices are read
+	// as by the object shader, and positions alone as by a depth pass, where the split position stream pays off
+	inline void vertexLayouts() {
+		typedef VertexLayout<AttributePosition, AttributeNormal, AttributeTexCoord> Layout;
+		auto side = 1024;
+		auto vertexCount = (size_t)side * side;
+		auto positions = std::vector<glm::vec3>(vertexCount);
+		auto normals = std::vector<glm::vec3>(vertexCount);
+		auto texCoords = std::vector<glm::vec2>(vertexCount);
+		for (size_t i = 0; i < vertexCount; i++) {
+			auto x = (float)(i % side) / side;
+			auto z = (float)(i / side) / side;
+			positions[i] = glm::vec3(x, 0.1f * std::sin(8.f * x) * std::cos(8.f * z), z);
+			normals[i] = glm::normalize(glm::vec3(-std::cos(8.f * x), 1.f, std::sin(8.f * z)));
+			texCoords[i] = glm::vec2(x, z);
+		}
+		auto interleaved = Layout::interleave(vertexCount, positions.data(), normals.data(), texCoords.data());
+
+		auto indices = std::vector<GLuint>();
+		for (int z = 0; z + 1 < side; z++) {
+			for (int x = 0; x + 1 < side; x++) {
+				GLuint a = z * side + x;
+				GLuint b = a + side;
+				for (auto index : { a, b, b + 1, a, b + 1, a + 1 }) { indices.push_back(index); }
+			}
+		}
+		// The same triangles over vertices stored in a random order, as in a mesh never optimised for fetch
+		auto remap = std::vector<GLuint>(vertexCount);
+		for (size_t i = 0; i < vertexCount; i++) { remap[i] = (GLuint)i; }
+		std::shuffle(remap.begin(), remap.end(), std::mt19937(1));
+		auto shuffled = indices;
+		for (auto& index : shuffled) { index = remap[index]; }
+
+		std::cout << "Vertex layouts: " << vertexCount << " vertices, " << indices.size() << " indices, "
+			<< sizeof(glm::vec3) << " + " << sizeof(glm::vec3) + sizeof(glm::vec2) << " bytes split, "
+			<< Layout::STRIDE << " bytes interleaved" << std::endl;
+
+		// Best of a few passes, in millions of indices per second
+		auto measure = [&](std::vector<GLuint> const& order, auto fetch) {
+			double best = 1e30;
+			volatile float sink = 0.f;
+			for (int pass = 0; pass < 5; pass++) {
+				auto start = std::chrono::steady_clock::now();
+				float sum = 0.f;
+				for (auto index : order) { sum += fetch(index); }
+				best = std::min(best, secondsSince(start));
+				sink = sink + sum;
+			}
+			return order.size() / best / 1e6;
+		};
+		auto shade = [](glm::vec3 position, glm::vec3 normal, glm::vec2 texCoord) {
+			return glm::dot(position, normal) + texCoord.x * texCoord.y;
+		};
+		for (auto scattered : { false, true }) {
+			auto& order = scattered ? shuffled : indices;
+			auto splitFull = measure(order, [&](GLuint i) { return shade(positions[i], normals[i], texCoords[i]); });
+			auto interleavedFull = measure(order, [&](GLuint i) {
+				auto& vertex = interleaved[i];
+				return shade(Layout::get<0>(vertex), Layout::get<1>(vertex), Layout::get<2>(vertex));
+			});
+			auto splitDepth = measure(order, [&](GLuint i) { return positions[i].y; });
+			auto interleavedDepth = measure(order, [&](GLuint i) { return Layout::get<0>(interleaved[i]).y; });
+			std::cout << "  " << (scattered ? "shuffled vertices" : "mesh order") << ": full vertices "
+				<< splitFull << " M/s split, " << interleavedFull << " M/s interleaved; positions only "
+				<< splitDepth << " M/s split, " << interleavedDepth << " M/s interleaved" << std::endl;
+		}
+	}
+
+	// The mesh optimiser on a 300x300 grid whose triangles and vertices are shuffled, as in meshes exported without
+	// any care for the GPU: ACMR and ATVR before and after, under FIFO and LRU caches of a few sizes
+	inline void vertexCache() {
+		auto side = 300;
+		auto vertexCount = (size_t)side * side;
+		auto positions = std::vector<glm::vec3>(vertexCount);
+		for (size_t i = 0; i < vertexCount; i++) {
+			auto x = (float)(i % side) / side;
+			auto z = (float)(i / side) / side;
+			positions[i] = glm::vec3(x, 0.1f * std::sin(8.f * x) * std::cos(8.f * z), z);
+		}
+		auto indices = std::vector<GLuint>();
+		for (int z = 0; z + 1 < side; z++) {
+			for (int x = 0; x + 1 < side; x++) {
+				GLuint a = z * side + x;
+				GLuint b = a + side;
+				for (auto index : { a, b, b + 1, a, b + 1, a + 1 }) { indices.push_back(index); }
+			}
+		}
+
+		auto random = std::mt19937(1);
+		auto triangleOrder = std::vector<size_t>(indices.size() / 3);
+		for (size_t t = 0; t < triangleOrder.size(); t++) { triangleOrder[t] = t; }
+		std::shuffle(triangleOrder.begin(), triangleOrder.end(), random);
+		auto remap = std::vector<GLuint>(vertexCount);
+		for (size_t i = 0; i < vertexCount; i++) { remap[i] = (GLuint)i; }
+		std::shuffle(remap.begin(), remap.end(), random);
+		auto shuffled = std::vector<GLuint>();
+		for (auto t : triangleOrder) {
+			for (int c = 0; c < 3; c++) { shuffled.push_back(remap[indices[3 * t + c]]); }
+		}
+		mesh_optimizer::remapVertices(positions.data(), remap);
+
+		auto optimized = shuffled;
+		auto submeshes = std::vector<Submesh>{ Submesh{ 0, (GLuint)optimized.size(), "" } };
+		auto start = std::chrono::steady_clock::now();
+		auto result = mesh_optimizer::optimize(optimized.data(), optimized.size(), submeshes, positions.data(), vertexCount);
+		auto seconds = secondsSince(start);
+		std::cout << "Vertex cache: " << optimized.size() / 3 << " triangles, " << vertexCount << " vertices, optimised in "
+			<< seconds << " s" << std::endl;
+
+		auto models = {
+			mesh_optimizer::CacheModel{ mesh_optimizer::CacheModel::FIFO, 16 },
+			mesh_optimizer::CacheModel{ mesh_optimizer::CacheModel::FIFO, 32 },
+			mesh_optimizer::CacheModel{ mesh_optimizer::CacheModel::LRU, 16 },
+			mesh_optimizer::CacheModel{ mesh_optimizer::CacheModel::LRU, 32 },
+		};
+		for (auto model : models) {
+			auto before = mesh_optimizer::simulateCache(shuffled.data(), shuffled.size(), vertexCount, model);
+			auto after = mesh_optimizer::simulateCache(optimized.data(), optimized.size(), vertexCount, model);
+			std::cout << "  " << (model.kind == mesh_optimizer::CacheModel::FIFO ? "FIFO " : "LRU ") << model.size
+				<< ": ACMR " << before.acmr << " -> " << after.acmr << ", ATVR " << before.atvr << " -> " << after.atvr
+				<< std::endl;
+		}
+	}
+
+	// A finely tessellated unit sphere, whose UV seam and poles duplicate vertices, with its vertex cache order
+	// optimised as a loaded mesh's would be
+	struct Sphere {
+		std::vector<glm::vec3> positions;
+		std::vector<glm::vec3> normals;
+		std::vector<glm::vec2> texCoords;
+		std::vector<GLuint> indices;
+
+		Sphere(int rings, int segments) {
+			for (int ring = 0; ring <= rings; ring++) {
+				for (int segment = 0; segment <= segments; segment++) {
+					auto u = (float)segment / segments;
+					auto v = (float)ring / rings;
+					auto theta = u * 2.f * glm::pi<float>();
+					auto phi = v * glm::pi<float>();
+					auto normal = glm::vec3(std::sin(phi) * std::cos(theta), std::cos(phi), std::sin(phi) * std::sin(theta));
+					this->positions.push_back(normal);
+					this->normals.push_back(normal);
+					this->texCoords.push_back(glm::vec2(u, v));
+				}
+			}
+			for (int ring = 0; ring < rings; ring++) {
+				for (int segment = 0; segment < segments; segment++) {
+					GLuint a = ring * (segments + 1) + segment;
+					GLuint b = a + segments + 1;
+					if (ring != 0) { for (auto index : { a, a + 1, b }) { this->indices.push_back(index); } }
+					if (ring != rings - 1) { for (auto index : { a + 1, b + 1, b }) { this->indices.push_back(index); } }
+				}
+			}
+			mesh_optimizer::optimizeVertexCache(this->indices.data(), this->indices.size(), this->positions.size());
+		}
+
+		MeshView view() const {
+			auto mesh = MeshView();
+			mesh.vertices = this->positions.data();
+			mesh.normals = this->normals.data();
+			mesh.texCoords = this->texCoords.data();
+			mesh.vertexCount = this->positions.size();
+			mesh.indices = this->indices.data();
+			mesh.indexCount = this->indices.size();
+			mesh.boundsMin = glm::vec3(-1.f);
+			mesh.boundsMax = glm::vec3(1.f);
+			mesh.sphereRadius = 1.f;
+			mesh.submeshes.push_back(Submesh{ 0, (GLuint)this->indices.size(), "" });
+			return mesh;
+		}
+	};
+
+	// Levels of detail of a sphere, and how many triangles get drawn as the camera moves away from it and back
+	inline void levelsOfDetail() {
+		auto sphere = Sphere(128, 256);
+		auto start = std::chrono::steady_clock::now();
+		auto lods = MeshLods(sphere.view());
+		auto seconds = secondsSince(start);
+		std::cout << "Levels of detail: " << sphere.indices.size() / 3 << " triangles, built in " << seconds << " s"
+			<< std::endl;
+		lods.print(std::cout);
+
+		// The scene's projection at 768 pixels high, with the sphere scaled as the light is
+		auto projectionScale = 768.f / (2.f * std::tan(glm::radians(30.f) / 2.f));
+		auto model = glm::scale(glm::mat4(1.f), glm::vec3(0.1f));
+		auto selection = LodSelection(lods);
+		auto drawn = [&](float distance) {
+			auto level = selection.select(model, glm::vec3(0.f, 0.f, distance), projectionScale);
+			return lods.levels[level].triangleCount;
+		};
+		for (auto distance : { 0.5f, 1.f, 2.f, 4.f, 8.f, 16.f, 32.f }) {
+			std::cout << "  at " << distance << ": " << drawn(distance) << " triangles (level "
+				<< selection.getLevel() << ")" << std::endl;
+		}
+
+		// Jitter around every distance: without hysteresis, each one near a switching distance would flip levels
+		auto random = std::mt19937(1);
+		auto jitter = std::uniform_real_distribution<float>(-0.02f, 0.02f);
+		size_t switches = 0;
+		size_t frames = 0;
+		for (auto distance = 0.5f; distance < 32.f; distance *= 1.01f) {
+			for (int frame = 0; frame < 20; frame++) {
+				auto before = selection.getLevel();
+				drawn(distance * (1.f + jitter(random)));
+				switches += selection.getLevel() != before;
+				frames++;
+			}
+		}
+		std::cout << "  " << switches << " level switches over " << frames << " jittered frames" << std::endl;
+	}
+
+	// Share of the triangles meshlet culling rejects in the scene, seen from around it at the camera's starting
+	// distance, with a dense sphere added behind the light
+	inline void meshletCulling() {
+		struct SceneObject {
+			char const* name;
+			MeshLods lods;
+			glm::mat4 model;
+			MeshletStats stats;
+		};
+		auto placed = [](glm::vec3 position, float scale) {
+			return glm::scale(glm::translate(glm::mat4(1.f), position), glm::vec3(scale));
+		};
+		auto load = [](char const* path, uint32_t streams) {
+			return MeshLods(MeshSource(path, streams).view());
+		};
+		auto sphere = Sphere(128, 256);
+		auto objects = std::vector<SceneObject>();
+		auto streams = MeshCache::NORMALS | MeshCache::TEX_COORDS;
+		objects.push_back(SceneObject{
+			"cube", load("objects/aof5_cube.obj", streams), placed(glm::vec3(-1.f, 0.301f, 0.f), 0.3f), MeshletStats()
+		});
+		objects.push_back(SceneObject{
+			"rubik", load("objects/rubik.obj", streams), placed(glm::vec3(1.f, 0.301f, 0.f), 0.3f), MeshletStats()
+		});
+		objects.push_back(SceneObject{
+			"light", load("objects/light_sphere.obj", 0), placed(glm::vec3(0.f), 0.1f), MeshletStats()
+		});
+		objects.push_back(SceneObject{
+			"sphere", MeshLods(sphere.view()), placed(glm::vec3(0.f, 0.f, -2.f), 0.5f), MeshletStats()
+		});
+
+		auto projection = glm::perspective(glm::radians(30.f), 4.f / 3.f, 0.1f, 100.f);
+		auto views = 16;
+		for (int i = 0; i < views; i++) {
+			// Every other view looks off to the side, so that part of the scene leaves the frustum
+			auto angle = 2.f * glm::pi<float>() * i / views;
+			auto camera = glm::vec3(4.f * std::sin(angle), 0.5f, 4.f * std::cos(angle));
+			auto target = i % 2 == 0 ? glm::vec3(0.f) : glm::vec3(1.5f * std::cos(angle), 0.f, -1.5f * std::sin(angle));
+			auto viewProjection = projection * glm::lookAt(camera, target, glm::vec3(0.f, 1.f, 0.f));
+			for (auto& object : objects) {
+				auto culling = MeshletCulling(object.model, viewProjection, camera);
+				for (auto& meshlets : object.lods.levels[0].meshlets) {
+					auto counts = std::vector<GLsizei>();
+					auto offsets = std::vector<void const*>();
+					culling.cull(meshlets, sizeof(GLuint), counts, offsets, object.stats);
+				}
+			}
+		}
+
+		auto total = MeshletStats();
+		std::cout << "Meshlet culling over " << views << " views:" << std::endl;
+		for (auto& object : objects) {
+			auto& stats = object.stats;
+			std::cout << "  " << object.name << ": " << stats.meshlets / views << " meshlets, "
+				<< 100.0 * stats.culledTriangles / stats.triangles << "% of triangles culled" << std::endl;
+			total += stats;
+		}
+		std::cout << "  total: " << 100.0 * total.culledMeshlets / total.meshlets << "% of meshlets, "
+			<< 100.0 * total.culledTriangles / total.triangles << "% of triangles culled" << std::endl;
+	}
+
+	// CPU time to submit the draws of 10000 small objects, each with buffers of its own: first by setting up
+	// every attribute again before each draw, as objects used to, then by binding each object's vertex array object.
+	// The GPU is waited on outside the timings, so that they only measure the driver's work on this thread
+	inline void drawSubmission() {
+		struct NoData {};
+		auto data = NoData();
+		auto window = Window<NoData>(640, 480, "draws", data);
+		auto program = LightProgram("shaders/light.vert", "shaders/light.frag");
+
+		typedef VertexLayout<AttributeNormal, AttributeTexCoord> Layout;
+		struct DrawObject {
+			VertexArray vertices;
+			InterleavedArray surface;
+			IndexArray indices;
+			VertexArrayObject vao;
+			glm::mat4 model;
+		};
+		auto sphere = Sphere(6, 12);
+		auto surface = Layout::interleave(sphere.positions.size(), sphere.normals.data(), sphere.texCoords.data());
+		auto side = 100;
+		auto objects = std::vector<DrawObject>();
+		objects.reserve(side * side);
+		for (int i = 0; i < side * side; i++) {
+			auto position = glm::vec3((i % side - side / 2) * 0.05f, (i / side - side / 2) * 0.05f, 0.f);
+			objects.push_back(DrawObject{
+				VertexArray(sphere.positions), InterleavedArray::of<Layout>(surface), IndexArray(sphere.indices),
+				VertexArrayObject(), glm::scale(glm::translate(glm::mat4(1.f), position), glm::vec3(0.02f))
+			});
+			auto& object = objects.back();
+			object.vao = VertexArrayObject([&] {
+				object.vertices.bind();
+				object.surface.bind();
+				object.indices.bind();
+			});
+		}
+
+		program.program.use();
+		auto camera = glm::vec3(0.f, 0.f, 10.f);
+		auto frame = UniformBuffer<FrameUniforms>(FrameUniforms(
+			glm::lookAt(camera, glm::vec3(0.f), glm::vec3(0.f, 1.f, 0.f)),
+			glm::perspective(glm::radians(30.f), 4.f / 3.f, 0.1f, 100.f), camera, glm::vec3(0.f)
+		));
+		auto frames = 20;
+		auto time = [&](char const* label, auto submit) {
+			glFinish();
+			double seconds = 0.0;
+			for (int frame = 0; frame < frames; frame++) {
+				glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+				auto start = std::chrono::steady_clock::now();
+				for (auto& object : objects) {
+					program.model.set(object.model);
+					submit(object);
+				}
+				seconds += secondsSince(start);
+				glFinish();
+			}
+			std::cout << "  " << label << ": " << seconds / frames * 1e3 << " ms per frame, "
+				<< seconds / frames / objects.size() * 1e9 << " ns per draw" << std::endl;
+		};
+
+		std::cout << "Draw submission, " << objects.size() << " objects of " << sphere.indices.size() / 3
+			<< " triangles:" << std::endl;
+		// Attributes set up on every draw still have to go into some vertex array object in a core profile
+		auto shared = VertexArrayObject([] {});
+		shared.bind();
+		time("attributes set up per draw", [](DrawObject const& object) {
+			object.vertices.bind();
+			object.surface.bind();
+			object.indices.bind();
+			object.indices.draw(GL_TRIANGLES);
+		});
+		time("vertex array object per mesh", [](DrawObject const& object) {
+			object.vao.bind();
+			object.indices.draw(GL_TRIANGLES);
+		});
+		gl_state::bindVertexArray(0);
+	}
+
+	// Scale of the cubes of cubeGrid
+	const float GRID_CUBE_SCALE = 0.05f;
+
+	// Positions of count small cubes on a square grid under the scene, for stressing instanced draws
+	inline std::vector<glm::vec3> cubeGridPositions(size_t count) {
+		auto side = (size_t)std::ceil(std::sqrt((double)count));
+		auto positions = std::vector<glm::vec3>();
+		positions.reserve(count);
+		for (size_t i = 0; i < count; i++) {
+			auto x = ((float)(i % side) - side / 2.f) * 0.2f;
+			auto z = ((float)(i / side) - side / 2.f) * 0.2f;
+			positions.push_back(glm::vec3(x, -0.5f, z));
+		}
+		return positions;
+	}
+
+	// Model matrices of the cubes at cubeGridPositions
+	inline std::vector<glm::mat4> cubeGrid(size_t count) {
+		auto models = std::vector<glm::mat4>();
+		models.reserve(count);
+		for (auto& position : cubeGridPositions(count)) {
+			models.push_back(glm::scale(glm::translate(glm::mat4(1.f), position), glm::vec3(GRID_CUBE_SCALE)));
+		}
+		return models;
+	}
+
+	// Frame time, GPU included, of a grid of cubes drawn with one instanced draw and with a draw per cube, as the
+	// grid grows
+	inline void instancing() {
+		struct NoData {};
+		auto data = NoData();
+		auto window = Window<NoData>(1024, 768, "instancing", data);
+		auto program = ObjectProgram("shaders/object.vert", "shaders/object.frag");
+		auto materials = texture::MaterialArrays();
+		auto cube = Object("objects/aof5_cube.obj", materials);
+		materials.upload();
+
+		auto camera = glm::vec3(0.f, 20.f, 40.f);
+		auto frame = UniformBuffer<FrameUniforms>(FrameUniforms(
+			glm::lookAt(camera, glm::vec3(0.f), glm::vec3(0.f, 1.f, 0.f)),
+			glm::perspective(glm::radians(30.f), 4.f / 3.f, 0.1f, 100.f), camera, glm::vec3(0.f, 10.f, 0.f)
+		));
+		gl_state::enable(GL_DEPTH_TEST);
+		gl_state::enable(GL_CULL_FACE);
+		program.program.use();
+
+		auto frames = 20;
+		auto time = [&](auto drawFrame) {
+			drawFrame();
+			glFinish();
+			auto start = std::chrono::steady_clock::now();
+			for (int i = 0; i < frames; i++) {
+				glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+				drawFrame();
+				glFinish();
+			}
+			return secondsSince(start) / frames * 1e3;
+		};
+
+		std::cout << "Instanced drawing, in ms per frame:" << std::endl;
+		for (size_t count : { 100, 1000, 10000, 100000 }) {
+			auto models = cubeGrid(count);
+			auto instanced = time([&] {
+				program.setInstanced(cube);
+				cube.drawInstanced(0, models.data(), (GLsizei)models.size());
+			});
+			auto separate = time([&] {
+				for (auto& model : models) {
+					program.setModel(model, cube);
+					cube.draw(0);
+				}
+			});
+			std::cout << "  " << count << " cubes: " << instanced << " instanced, " << separate << " with a draw per cube"
+				<< std::endl;
+		}
+	}
+
+	// CPU time to submit a frame of cubes and Rubik's cubes, alternating over a grid, with a draw per object and
+	// through a MeshBatch, which submits a multi-draw per material array. As in drawSubmission, the GPU is waited on
+	// outside the timings. Software drivers, such as Mesa's with LIBGL_ALWAYS_SOFTWARE=1, show the driver's share
+	// without the GPU's
+	inline void indirectDrawing() {
+		struct NoData {};
+		auto data = NoData();
+		auto window = Window<NoData>(1024, 768, "indirect", data);
+		auto program = ObjectProgram("shaders/object.vert", "shaders/object.frag");
+		auto materials = texture::MaterialArrays();
+		auto batch = MeshBatch(materials);
+		auto add = [&](Object::Source& source) {
+			auto mesh = source.mesh.view();
+			return batch.add(mesh, source.textures.add(mesh.submeshes, materials));
+		};
+		auto cubeSource = Object::Source("objects/aof5_cube.obj");
+		auto rubikSource = Object::Source("objects/rubik.obj");
+		auto cubeMesh = add(cubeSource);
+		auto rubikMesh = add(rubikSource);
+		auto cube = Object(std::move(cubeSource), materials);
+		auto rubik = Object(std::move(rubikSource), materials);
+		materials.upload();
+		batch.upload();
+
+		auto camera = glm::vec3(0.f, 20.f, 40.f);
+		auto frame = UniformBuffer<FrameUniforms>(FrameUniforms(
+			glm::lookAt(camera, glm::vec3(0.f), glm::vec3(0.f, 1.f, 0.f)),
+			glm::perspective(glm::radians(30.f), 4.f / 3.f, 0.1f, 100.f), camera, glm::vec3(0.f, 10.f, 0.f)
+		));
+		gl_state::enable(GL_DEPTH_TEST);
+		gl_state::enable(GL_CULL_FACE);
+		program.program.use();
+
+		auto frames = 20;
+		auto time = [&](auto submit) {
+			submit();
+			glFinish();
+			double seconds = 0.0;
+			for (int i = 0; i < frames; i++) {
+				glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+				auto start = std::chrono::steady_clock::now();
+				submit();
+				seconds += secondsSince(start);
+				glFinish();
+			}
+			return seconds / frames * 1e3;
+		};
+
+		std::cout << "Indirect drawing, CPU submission in ms per frame ("
+			<< (GLAD_GL_VERSION_4_3 ? "multi-draws" : "no multi-draws before OpenGL 4.3, a draw per command")
+			<< "):" << std::endl;
+		auto placements = std::vector<MeshBatch::Placement>();
+		for (size_t count : { 100, 1000, 10000 }) {
+			auto models = cubeGrid(count);
+			placements.clear();
+			for (size_t i = 0; i < models.size(); i++) {
+				placements.push_back(MeshBatch::Placement{ i % 2 == 0 ? cubeMesh : rubikMesh, models[i] });
+			}
+			auto separate = time([&] {
+				for (size_t i = 0; i < models.size(); i++) {
+					auto& object = i % 2 == 0 ? cube : rubik;
+					program.setModel(models[i], object);
+					object.draw(0);
+				}
+			});
+			auto batched = time([&] {
+				program.setBatched();
+				batch.draw(0, placements);
+			});
+			std::cout << "  " << count << " objects: " << separate << " with a draw per object, " << batched
+				<< " batched" << std::endl;
+		}
+	}
+
+	// Transform update of a scene of 100000 entities, a thousand roots of 99 children each, with every entity moved
+	// and with 1% of them moved each frame. The moved entities are picked at random, and picking a root moves its
+	// whole subtree, so a bit more than 1% is recomputed. Only the update is timed
+	inline void sceneUpdate() {
+		auto scene = Scene();
+		auto bounds = Scene::Bounds{ glm::vec3(-1.f), glm::vec3(1.f), std::sqrt(3.f) };
+		auto up = glm::vec3(0.f, 1.f, 0.f);
+		for (int root = 0; root < 1000; root++) {
+			auto parent = scene.create(
+				Scene::NONE, glm::vec3(root % 32, 0.f, root / 32) * 4.f, glm::quat(1.f, 0.f, 0.f, 0.f), glm::vec3(1.f),
+				bounds
+			);
+			for (int child = 0; child < 99; child++) {
+				scene.create(
+					parent, glm::vec3(child % 10, 1.f, child / 10) * 0.3f, glm::angleAxis(child * 0.1f, up),
+					glm::vec3(0.1f), bounds, 0, 0
+				);
+			}
+		}
+		scene.update();
+
+		auto count = scene.getEntityCount();
+		auto random = std::mt19937(1);
+		auto pick = std::uniform_int_distribution<Scene::Entity>(0, count - 1);
+		auto frames = 100;
+		auto time = [&](char const* label, auto move) {
+			double seconds = 0.0;
+			size_t moved = 0;
+			size_t runs = 0;
+			for (int frame = 0; frame < frames; frame++) {
+				move(glm::angleAxis(frame * 0.01f, up));
+				auto start = std::chrono::steady_clock::now();
+				scene.update();
+				seconds += secondsSince(start);
+				for (auto& run : scene.getMoved()) { moved += run.count; }
+				runs += scene.getMoved().size();
+			}
+			std::cout << "  " << label << ": " << seconds / frames * 1e3 << " ms per update, " << moved / frames
+				<< " entities recomputed in " << runs / frames << " runs, " << moved / frames * sizeof(glm::mat4) / 1024
+				<< " KiB of world matrices to upload" << std::endl;
+		};
+
+		std::cout << "Scene update, " << count << " entities:" << std::endl;
+		time("every entity moved", [&](glm::quat rotation) {
+			for (Scene::Entity entity = 0; entity < count; entity++) { scene.setRotation(entity, rotation); }
+		});
+		time("1% moved", [&](glm::quat rotation) {
+			for (Scene::Entity i = 0; i < count / 100; i++) { scene.setRotation(pick(random), rotation); }
+		});
+		time("nothing moved", [](glm::quat) {});
+	}
+
+	// Frustum culling of a million scattered volumes, one at a time, a SIMD register at a time on one thread, and
+	// split across threads, each checked against the one at a time result
+	inline void frustumCulling() {
+		auto count = (size_t)1 << 20;
+		auto random = std::mt19937(1);
+		auto position = std::uniform_real_distribution<float>(-200.f, 200.f);
+		auto size = std::uniform_real_distribution<float>(0.1f, 4.f);
+		auto volumes = frustum_culling::Volumes();
+		volumes.resize(count);
+		for (size_t i = 0; i < count; i++) {
+			auto extent = glm::vec3(size(random), size(random), size(random));
+			auto centre = glm::vec3(position(random), position(random), position(random));
+			volumes.set(i, centre, extent, glm::length(extent));
+		}
+		auto view = glm::lookAt(glm::vec3(0.f, 5.f, 0.f), glm::vec3(1.f, 0.f, 1.f), glm::vec3(0.f, 1.f, 0.f));
+		auto projection = glm::perspective(glm::radians(60.f), 16.f / 9.f, 0.1f, 150.f);
+		auto frustum = frustum_culling::Frustum(projection * view);
+
+		auto repeats = 20;
+		auto reference = std::vector<uint32_t>();
+		auto time = [&](char const* label, auto cull) {
+			auto visible = std::vector<uint32_t>();
+			auto start = std::chrono::steady_clock::now();
+			for (int i = 0; i < repeats; i++) { cull(visible); }
+			auto seconds = secondsSince(start) / repeats;
+			if (reference.empty()) { reference = visible; }
+			std::cout << "  " << label << ": " << seconds * 1e3 << " ms, " << count / seconds / 1e6
+				<< " million objects/s, " << visible.size() << " visible"
+				<< (visible == reference ? "" : " - DIFFERS FROM ONE AT A TIME") << std::endl;
+		};
+
+		std::cout << "Frustum culling, " << count << " volumes, " << frustum_culling::LANES << " lanes:" << std::endl;
+		time("one at a time", [&](std::vector<uint32_t>& visible) {
+			visible.clear();
+			frustum_culling::cullScalar(frustum, volumes, 0, count, visible);
+		});
+		time("SIMD, one thread", [&](std::vector<uint32_t>& visible) {
+			visible.clear();
+			frustum_culling::cullLanes(frustum, volumes, 0, count, visible);
+		});
+		auto slices = std::vector<std::vector<uint32_t>>();
+		ThreadPool pool;
+		time("SIMD, threaded", [&](std::vector<uint32_t>& visible) {
+			frustum_culling::cull(frustum, volumes, visible, slices, pool);
+		});
+	}
+
+	// A bounding volume hierarchy over 10k, 100k and 1M scattered volumes: building it, refitting it as some of them
+	// move, and querying it, with each query checked against testing every volume
+	inline void boundingVolumeHierarchy() {
+		for (auto count : { (size_t)10000, (size_t)100000, (size_t)1000000 }) {
+			// As dense at every count, with the frustum and spheres reaching the same share of the volumes
+			auto side = std::cbrt((float)count) * 4.f;
+			auto random = std::mt19937(1);
+			auto position = std::uniform_real_distribution<float>(-side / 2.f, side / 2.f);
+			auto size = std::uniform_real_distribution<float>(0.1f, 1.f);
+			auto unit = std::uniform_real_distribution<float>(-1.f, 1.f);
+			auto volumes = frustum_culling::Volumes();
+			volumes.resize(count);
+			for (size_t i = 0; i < count; i++) {
+				auto centre = glm::vec3(position(random), position(random), position(random));
+				auto extent = glm::vec3(size(random), size(random), size(random));
+				volumes.set(i, centre, extent, glm::length(extent));
+			}
+			std::cout << "Bounding volume hierarchy, " << count << " volumes:" << std::endl;
+
+			auto bvh = Bvh();
+			auto start = std::chrono::steady_clock::now();
+			bvh.build(volumes);
+			std::cout << "  build: " << secondsSince(start) * 1e3 << " ms, " << bvh.getNodeCount() << " nodes, cost "
+				<< bvh.getCost() << std::endl;
+
+			// 1% of the volumes drift a little every frame, until the tree is built again
+			auto frames = 0;
+			auto rebuilt = false;
+			double refitSeconds = 0.0;
+			double rebuildSeconds = 0.0;
+			auto pick = std::uniform_int_distribution<uint32_t>(0, (uint32_t)count - 1);
+			auto moved = std::vector<Scene::Run>();
+			while (!rebuilt && frames < 100) {
+				moved.clear();
+				for (size_t i = 0; i < count / 100; i++) {
+					auto item = pick(random);
+					auto centre = glm::vec3(volumes.centreX[item], volumes.centreY[item], volumes.centreZ[item]);
+					auto extent = glm::vec3(volumes.extentX[item], volumes.extentY[item], volumes.extentZ[item]);
+					volumes.set(item, centre + glm::vec3(unit(random), unit(random), unit(random)) * 0.2f, extent,
+						volumes.radius[item]);
+					moved.push_back(Scene::Run{ item, 1 });
+				}
+				auto cost = bvh.getCost();
+				start = std::chrono::steady_clock::now();
+				rebuilt = bvh.update(moved);
+				auto seconds = secondsSince(start);
+				frames++;
+				if (!rebuilt) {
+					refitSeconds += seconds;
+				} else {
+					rebuildSeconds = seconds;
+					std::cout << "  refit with 1% moved: ";
+					if (frames > 1) {
+						std::cout << refitSeconds / (frames - 1) * 1e3 << " ms, ";
+					}
+					std::cout << "built again after " << frames << " frames, at a cost of " << cost << ", in "
+						<< rebuildSeconds * 1e3 << " ms" << std::endl;
+				}
+			}
+			if (!rebuilt) {
+				std::cout << "  refit with 1% moved: " << refitSeconds / frames * 1e3 << " ms, cost " << bvh.getCost()
+					<< " after " << frames << " frames" << std::endl;
+			}
+
+			auto view = glm::lookAt(glm::vec3(0.f), glm::vec3(1.f, 0.2f, 0.5f), glm::vec3(0.f, 1.f, 0.f));
+			auto projection = glm::perspective(glm::radians(60.f), 16.f / 9.f, 0.1f, side / 2.f);
+			auto frustum = frustum_culling::Frustum(projection * view);
+			auto visible = std::vector<uint32_t>();
+			auto reference = std::vector<uint32_t>();
+			start = std::chrono::steady_clock::now();
+			bvh.frustum(frustum, visible);
+			auto bvhSeconds = secondsSince(start);
+			start = std::chrono::steady_clock::now();
+			frustum_culling::cullLanes(frustum, volumes, 0, count, reference);
+			auto linearSeconds = secondsSince(start);
+			std::sort(visible.begin(), visible.end());
+			std::cout << "  frustum: " << bvhSeconds * 1e3 << " ms against " << linearSeconds * 1e3
+				<< " ms testing every volume, " << visible.size() << " visible"
+				<< (visible == reference ? "" : " - DIFFERS FROM TESTING EVERY VOLUME") << std::endl;
+
+			// Rays and spheres from random points, checked against every volume for the first few
+			auto queries = 1000;
+			auto checked = 20;
+			auto wrong = 0;
+			auto hits = 0;
+			double raySeconds = 0.0;
+			for (int query = 0; query < queries; query++) {
+				auto origin = glm::vec3(position(random), position(random), position(random));
+				auto direction = glm::normalize(glm::vec3(unit(random), unit(random), unit(random)) + glm::vec3(1e-3f));
+				start = std::chrono::steady_clock::now();
+				auto hit = bvh.raycast(origin, direction, side, [](uint32_t) { return true; });
+				raySeconds += secondsSince(start);
+				if (hit.item != Bvh::NO_ITEM) { hits++; }
+				if (query >= checked) continue;
+				auto closest = side;
+				for (size_t i = 0; i < count; i++) {
+					auto centre = glm::vec3(volumes.centreX[i], volumes.centreY[i], volumes.centreZ[i]);
+					auto extent = glm::vec3(volumes.extentX[i], volumes.extentY[i], volumes.extentZ[i]);
+					auto near = (centre - extent - origin) / direction;
+					auto far = (centre + extent - origin) / direction;
+					auto enter = glm::min(near, far);
+					auto leave = glm::max(near, far);
+					auto first = std::max(std::max(enter.x, enter.y), std::max(enter.z, 0.f));
+					auto last = std::min(std::min(leave.x, leave.y), std::min(leave.z, closest));
+					if (first <= last) { closest = std::min(closest, first); }
+				}
+				if (std::abs(closest - hit.distance) > 1e-4f * side) { wrong++; }
+			}
+			std::cout << "  rays: " << raySeconds / queries * 1e6 << " us per ray, " << hits << " of " << queries
+				<< " hit" << (wrong == 0 ? "" : " - CLOSEST HIT DIFFERS FROM TESTING EVERY VOLUME") << std::endl;
+
+			wrong = 0;
+			size_t overlaps = 0;
+			double sphereSeconds = 0.0;
+			auto overlapping = std::vector<uint32_t>();
+			for (int query = 0; query < queries; query++) {
+				auto centre = glm::vec3(position(random), position(random), position(random));
+				auto radius = 4.f;
+				start = std::chrono::steady_clock::now();
+				bvh.overlapSphere(centre, radius, overlapping);
+				sphereSeconds += secondsSince(start);
+				overlaps += overlapping.size();
+				if (query >= checked) continue;
+				size_t expected = 0;
+				for (size_t i = 0; i < count; i++) {
+					auto boxCentre = glm::vec3(volumes.centreX[i], volumes.centreY[i], volumes.centreZ[i]);
+					auto extent = glm::vec3(volumes.extentX[i], volumes.extentY[i], volumes.extentZ[i]);
+					auto offset = glm::clamp(centre, boxCentre - extent, boxCentre + extent) - centre;
+					if (glm::dot(offset, offset) <= radius * radius) { expected++; }
+				}
+				if (expected != overlapping.size()) { wrong++; }
+			}
+			std::cout << "  spheres: " << sphereSeconds / queries * 1e6 << " us per sphere, " << overlaps / queries
+				<< " volumes overlapped on average" << (wrong == 0 ? "" : " - DIFFERS FROM TESTING EVERY VOLUME")
+				<< std::endl;
+		}
+	}
+
+	// Add a box to the occluders, its faces split into quads x quads, counter-clockwise seen from outside
+	inline void addBoxOccluder(OcclusionCulling& occlusion, glm::vec3 min, glm::vec3 max, int quads) {
+		auto positions = std::vector<glm::vec3>();
+		auto triangles = std::vector<uint32_t>();
+		for (int axis = 0; axis < 3; axis++) {
+			for (int side = 0; side < 2; side++) {
+				// The face on the max side, then on the min side, spanned by u then v seen from outside
+				auto u = (axis + 1 + side) % 3;
+				auto v = (axis + 2 - side) % 3;
+				auto first = (uint32_t)positions.size();
+				for (int j = 0; j <= quads; j++) {
+					for (int i = 0; i <= quads; i++) {
+						auto position = glm::vec3(0.f);
+						position[axis] = side == 0 ? max[axis] : min[axis];
+						position[u] = glm::mix(min[u], max[u], (float)i / quads);
+						position[v] = glm::mix(min[v], max[v], (float)j / quads);
+						positions.push_back(position);
+					}
+				}
+				for (int j = 0; j < quads; j++) {
+					for (int i = 0; i < quads; i++) {
+						auto corner = first + j * (quads + 1) + i;
+						auto above = corner + quads + 1;
+						triangles.insert(triangles.end(), { corner, corner + 1, above + 1, corner, above + 1, above });
+					}
+				}
+			}
+		}
+		occlusion.addOccluder(positions, triangles, glm::mat4(1.f));
+	}
+
+	// Occlusion culling of 100k small boxes in a city of 100 blocks on a ground slab, from the street and from
+	// above. The SIMD, threaded render and its tests are checked against the reference render's
+	inline void occlusionCulling() {
+		auto random = std::mt19937(1);
+		ThreadPool pool;
+		auto occlusion = OcclusionCulling(pool);
+		addBoxOccluder(occlusion, glm::vec3(-60.f, -1.f, -60.f), glm::vec3(60.f, 0.f, 60.f), 32);
+		auto height = std::uniform_real_distribution<float>(4.f, 20.f);
+		for (int i = 0; i < 10; i++) {
+			for (int j = 0; j < 10; j++) {
+				// Blocks 6 wide, 10 apart, with streets along every multiple of 10
+				auto centre = glm::vec3(i * 10.f - 45.f, 0.f, j * 10.f - 45.f);
+				auto top = centre + glm::vec3(3.f, height(random), 3.f);
+				addBoxOccluder(occlusion, centre - glm::vec3(3.f, 0.f, 3.f), top, 8);
+			}
+		}
+
+		auto count = (size_t)100000;
+		auto position = std::uniform_real_distribution<float>(-50.f, 50.f);
+		auto above = std::uniform_real_distribution<float>(0.25f, 3.f);
+		auto volumes = frustum_culling::Volumes();
+		volumes.resize(count);
+		for (size_t i = 0; i < count; i++) {
+			volumes.set(i, glm::vec3(position(random), above(random), position(random)), glm::vec3(0.25f), 0.5f);
+		}
+
+		struct View {
+			char const* name;
+			glm::vec3 eye;
+			glm::vec3 target;
+		};
+		View views[] = {
+			{ "down a street", glm::vec3(0.f, 1.7f, -48.f), glm::vec3(0.f, 1.7f, 0.f) },
+			{ "across the streets", glm::vec3(-48.f, 1.7f, 10.f), glm::vec3(0.f, 1.7f, 10.f) },
+			{ "from a corner", glm::vec3(-49.f, 1.7f, -49.f), glm::vec3(0.f, 1.7f, 0.f) },
+			{ "from above", glm::vec3(0.f, 80.f, -60.f), glm::vec3(0.f, 0.f, 0.f) },
+		};
+		auto projection = glm::perspective(glm::radians(60.f), 16.f / 9.f, 0.1f, 150.f);
+		auto repeats = 20;
+		std::cout << "Occlusion culling, " << occlusion.getTriangleCount() << " occluder triangles into "
+			<< OcclusionCulling::WIDTH << "x" << OcclusionCulling::HEIGHT << " pixels, " << count << " boxes:"
+			<< std::endl;
+		auto inFrustum = std::vector<uint32_t>();
+		auto slices = std::vector<std::vector<uint32_t>>();
+		auto visible = std::vector<uint32_t>();
+		auto referenceVisible = std::vector<uint32_t>();
+		for (auto& view : views) {
+			auto viewProjection = projection * glm::lookAt(view.eye, view.target, glm::vec3(0.f, 1.f, 0.f));
+			frustum_culling::cull(frustum_culling::Frustum(viewProjection), volumes, inFrustum, slices, pool);
+
+			occlusion.renderReference(viewProjection);
+			auto referenceDepth = std::vector<float>(
+				occlusion.getDepth(), occlusion.getDepth() + OcclusionCulling::WIDTH * OcclusionCulling::HEIGHT
+			);
+			referenceVisible = inFrustum;
+			occlusion.cull(volumes, referenceVisible);
+
+			occlusion.resetStats();
+			for (int i = 0; i < repeats; i++) {
+				occlusion.render(viewProjection);
+				visible = inFrustum;
+				occlusion.cull(volumes, visible);
+			}
+			auto& stats = occlusion.getStats();
+			auto same = visible == referenceVisible && std::equal(referenceDepth.begin(), referenceDepth.end(),
+				occlusion.getDepth());
+			std::cout << "  " << view.name << ": " << stats.rasterSeconds / repeats * 1e3 << " ms rasterizing "
+				<< stats.triangles / repeats << " triangles, " << stats.testSeconds / repeats * 1e3 << " ms testing, "
+				<< 100.0 * stats.culled / std::max<size_t>(1, stats.tested) << "% of " << inFrustum.size()
+				<< " boxes in the frustum culled" << (same ? "" : " - DIFFERS FROM THE REFERENCE") << std::endl;
+		}
+		auto first = projection * glm::lookAt(views[0].eye, views[0].target, glm::vec3(0.f, 1.f, 0.f));
+		auto start = std::chrono::steady_clock::now();
+		for (int i = 0; i < repeats; i++) { occlusion.renderReference(first); }
+		std::cout << "  reference render " << views[0].name << ": " << secondsSince(start) / repeats * 1e3 << " ms"
+			<< std::endl;
+	}
+
+	// Run the named benchmark. Returns false if there is no such benchmark
+	inline bool run(std::string const& name) {
+		if (name == "obj") { objLoading(); }
+		else if (name == "mips") { mipGeneration(); }
+		else if (name == "layout") { vertexLayouts(); }
+		else if (name == "vcache") { vertexCache(); }
+		else if (name == "lod") { levelsOfDetail(); }
+		else if (name == "cull") { meshletCulling(); }
+		else if (name == "draws") { drawSubmission(); }
+		else if (name == "instancing") { instancing(); }
+		else if (name == "indirect") { indirectDrawing(); }
+		else if (name == "scene") { sceneUpdate(); }
+		else if (name == "frustum") { frustumCulling(); }
+		else if (name == "bvh") { boundingVolumeHierarchy(); }
+		else if (name == "occlusion") { occlusionCulling(); }
+		else {
+			std::cerr << "Unknown benchmark \"" << name << "\". Available: "
+				<< "obj, mips, layout, vcache, lod, cull, draws, instancing, indirect, scene, frustum, bvh, occlusion"
+				<< std::endl;
+			return false;
+		}
+		return true;
+	}
+}
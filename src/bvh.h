@@ -0,0 +1,498 @@
+#pragma once
+
+#include <algorithm>
+#include <cfloat>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "frustum_culling.h"
+#include "scene.h"
+
+// Storage aligned to Alignment bytes, which std::allocator only guarantees for over-aligned types from C++17 on
+template<typename T, size_t Alignment>
+struct AlignedAllocator {
+	typedef T value_type;
+
+	template<typename U>
+	struct rebind {
+		typedef AlignedAllocator<U, Alignment> other;
+	};
+
+	AlignedAllocator() {}
+
+	template<typename U>
+	AlignedAllocator(AlignedAllocator<U, Alignment> const&) {}
+
+	// Allocates a little more than asked, and keeps where that starts just before the aligned storage
+	T* allocate(size_t count) {
+		auto block = (char*)::operator new(count * sizeof(T) + Alignment + sizeof(void*));
+		auto aligned = ((uintptr_t)(block + sizeof(void*)) + Alignment - 1) & ~(uintptr_t)(Alignment - 1);
+		((void**)aligned)[-1] = block;
+		return (T*)aligned;
+	}
+
+	void deallocate(T* storage, size_t) {
+		::operator delete(((void**)storage)[-1]);
+	}
+
+	template<typename U>
+	bool operator==(AlignedAllocator<U, Alignment> const&) const {
+		return true;
+	}
+
+	template<typename U>
+	bool operator!=(AlignedAllocator<U, Alignment> const&) const {
+		return false;
+	}
+};
+
+// Bounding volume hierarchy over the boxes of a set of bounding volumes, such as a scene's, for frustum, ray and
+// sphere queries that only visit the parts of the world they reach.
+//
+// It is built top-down with the surface area heuristic, binned: each node is split where the chance of a query
+// reaching its children, their surface area, times the items in them is smallest. Nodes are flattened into an array
+// of 32 bytes each, 32-byte aligned, so that one never straddles cache lines, with the two children of a node next
+// to each other and after it. Items are reordered so that those under any node are consecutive.
+//
+// When volumes move, update refits the boxes of the nodes above them rather than building again. Refitted boxes
+// overlap more and more as things move, so the tree's cost, by the same heuristic, is kept up to date as it is
+// refitted, and the tree is built again once that cost has grown by a third since the last build.
+//
+// Queries share scratch space, so a tree is queried from one thread at a time
+class Bvh {
+public:
+	struct alignas(32) Node {
+		glm::vec3 min;
+		uint32_t first;	// first item of a leaf, or left child of an inner node, the right one following it
+		glm::vec3 max;
+		uint32_t count;	// items of a leaf, or 0 for an inner node
+	};
+	static_assert(sizeof(Node) == 32, "a node has to fill half a cache line");
+
+	static const uint32_t NO_ITEM = (uint32_t)-1;
+	// Items a leaf holds at most
+	static const uint32_t MAX_LEAF = 4;
+	// Candidate splits tried per axis
+	static const int BINS = 16;
+
+	// The closest volume along a ray, or NO_ITEM
+	struct Hit {
+		uint32_t item;
+		float distance;	// in lengths of the ray's direction
+	};
+
+private:
+	frustum_culling::Volumes const* volumes;
+	std::vector<Node, AlignedAllocator<Node, 32>> nodes;
+	std::vector<uint32_t> parents;	// of each node, the root being its own
+	std::vector<uint32_t> items;	// in leaf order
+	std::vector<uint32_t> leaves;	// of each item
+	// getCost as of the last build, and the sum it divides by the root's area: each node's surface area, weighted
+	// by the cost of visiting it. The sum is updated as nodes are refitted, so it is kept precise
+	float builtCost;
+	double cost;
+	// Scratch space
+	std::vector<uint8_t> refitMarks;	// by node
+	std::vector<uint32_t> refitNodes;
+	mutable std::vector<uint32_t> stack;
+
+public:
+	Bvh() : volumes(nullptr), builtCost(0.f), cost(0.0) {}
+
+	// Build over the boxes of the given volumes, which have to outlive the tree
+	void build(frustum_culling::Volumes const& volumes) {
+		this->volumes = &volumes;
+		auto count = (uint32_t)volumes.size();
+		this->nodes.clear();
+		this->parents.clear();
+		this->items.resize(count);
+		this->leaves.resize(count);
+		this->cost = 0.0;
+		if (count == 0) {
+			this->builtCost = 0.f;
+			return;
+		}
+
+		// Every item's box, reordered along with the items, so that splitting reads them in order
+		auto boxes = std::vector<BuildBox>(count);
+		for (uint32_t i = 0; i < count; i++) {
+			auto extent = glm::vec3(volumes.extentX[i], volumes.extentY[i], volumes.extentZ[i]);
+			auto centre = glm::vec3(volumes.centreX[i], volumes.centreY[i], volumes.centreZ[i]);
+			boxes[i] = BuildBox{ centre - extent, centre + extent, centre, i };
+		}
+
+		// Nodes still to split, with the items under them
+		struct Pending {
+			uint32_t node;
+			uint32_t begin;
+			uint32_t end;
+		};
+		auto pending = std::vector<Pending>{ Pending{ 0, 0, count } };
+		this->nodes.reserve(2 * (count / MAX_LEAF + 1));
+		this->nodes.push_back(Node());
+		this->parents.push_back(0);
+		while (!pending.empty()) {
+			auto range = pending.back();
+			pending.pop_back();
+			auto& node = this->nodes[range.node];
+			auto centroidMin = glm::vec3(FLT_MAX);
+			auto centroidMax = glm::vec3(-FLT_MAX);
+			node.min = glm::vec3(FLT_MAX);
+			node.max = glm::vec3(-FLT_MAX);
+			for (auto i = range.begin; i < range.end; i++) {
+				auto& box = boxes[i];
+				node.min = glm::min(node.min, box.min);
+				node.max = glm::max(node.max, box.max);
+				centroidMin = glm::min(centroidMin, box.centroid);
+				centroidMax = glm::max(centroidMax, box.centroid);
+			}
+			auto itemCount = range.end - range.begin;
+			node.first = range.begin;
+			node.count = itemCount;
+			if (itemCount <= MAX_LEAF) {
+				this->cost += area(node.min, node.max) * itemCount;
+				continue;
+			}
+
+			auto split = findSplit(boxes.data() + range.begin, boxes.data() + range.end, centroidMin, centroidMax);
+			auto middle = range.begin + itemCount / 2;
+			if (split.axis >= 0) {
+				auto scale = BINS / (centroidMax[split.axis] - centroidMin[split.axis]);
+				auto first = boxes.begin() + range.begin;
+				auto last = boxes.begin() + range.end;
+				middle = (uint32_t)(std::partition(first, last, [&](BuildBox const& box) {
+					return binOf(box.centroid[split.axis], centroidMin[split.axis], scale) < split.bin;
+				}) - boxes.begin());
+			}
+			// Items all at one point can be split anywhere
+			if (middle == range.begin || middle == range.end) { middle = range.begin + itemCount / 2; }
+
+			auto left = (uint32_t)this->nodes.size();
+			node.first = left;
+			node.count = 0;
+			this->cost += area(node.min, node.max);
+			this->nodes.push_back(Node());
+			this->nodes.push_back(Node());
+			this->parents.push_back(range.node);
+			this->parents.push_back(range.node);
+			pending.push_back(Pending{ left + 1, middle, range.end });
+			pending.push_back(Pending{ left, range.begin, middle });
+		}
+
+		for (uint32_t i = 0; i < count; i++) { this->items[i] = boxes[i].item; }
+		for (uint32_t n = 0; n < (uint32_t)this->nodes.size(); n++) {
+			auto& node = this->nodes[n];
+			for (auto i = node.first; node.count > 0 && i < node.first + node.count; i++) {
+				this->leaves[this->items[i]] = n;
+			}
+		}
+		this->refitMarks.assign(this->nodes.size(), 0);
+		this->builtCost = this->getCost();
+	}
+
+	// Refit the nodes above the volumes that moved, as Scene::update reports them, or build again if the tree has
+	// grown too costly, or volumes were added. Returns whether it built again
+	bool update(std::vector<Scene::Run> const& moved) {
+		if (this->volumes == nullptr) return false;
+		if (this->volumes->size() != this->leaves.size()) {
+			this->build(*this->volumes);
+			return true;
+		}
+		if (moved.empty()) return false;
+
+		// Every node above a moved item, each once. Walks up stop at a node already marked, the root at the latest
+		this->refitNodes.clear();
+		for (auto& run : moved) {
+			for (auto item = run.first; item < run.first + run.count; item++) {
+				for (auto node = this->leaves[item]; !this->refitMarks[node];) {
+					this->refitMarks[node] = 1;
+					this->refitNodes.push_back(node);
+					node = this->parents[node];
+				}
+			}
+		}
+		// Children come after their parents, so going backwards refits them first. Once many nodes moved, going
+		// through every mark is quicker than sorting them
+		if (this->refitNodes.size() * 16 > this->nodes.size()) {
+			for (auto index = (uint32_t)this->nodes.size(); index-- > 0;) {
+				if (this->refitMarks[index]) { this->refit(index); }
+			}
+		} else {
+			std::sort(this->refitNodes.begin(), this->refitNodes.end(), [](uint32_t a, uint32_t b) { return a > b; });
+			for (auto index : this->refitNodes) { this->refit(index); }
+		}
+
+		if (this->getCost() > this->builtCost * 4.f / 3.f) {
+			this->build(*this->volumes);
+			return true;
+		}
+		return false;
+	}
+
+	// Replace visible with every item whose volume is inside the frustum, as frustum_culling::isVisible decides,
+	// in no particular order. The items under a node wholly inside the frustum are taken without testing them
+	void frustum(frustum_culling::Frustum const& frustum, std::vector<uint32_t>& visible) const {
+		visible.clear();
+		if (this->nodes.empty()) return;
+		this->stack.assign(1, 0);
+		while (!this->stack.empty()) {
+			auto& node = this->nodes[this->stack.back()];
+			this->stack.pop_back();
+			auto centre = (node.min + node.max) / 2.f;
+			auto extent = (node.max - node.min) / 2.f;
+			auto inside = true;
+			auto outside = false;
+			for (auto& plane : frustum.planes) {
+				auto distance = glm::dot(glm::vec3(plane), centre) + plane.w;
+				auto reach = glm::dot(glm::abs(glm::vec3(plane)), extent);
+				if (distance + reach < 0.f) {
+					outside = true;
+					break;
+				}
+				if (distance - reach < 0.f) { inside = false; }
+			}
+			if (outside) continue;
+
+			if (inside) {
+				auto begin = this->subtreeBegin(node);
+				auto end = this->subtreeEnd(node);
+				visible.insert(visible.end(), this->items.begin() + begin, this->items.begin() + end);
+			} else if (node.count > 0) {
+				for (auto i = node.first; i < node.first + node.count; i++) {
+					auto item = this->items[i];
+					if (frustum_culling::isVisible(frustum, *this->volumes, item)) { visible.push_back(item); }
+				}
+			} else {
+				this->stack.push_back(node.first + 1);
+				this->stack.push_back(node.first);
+			}
+		}
+	}
+
+	// The closest item whose box the ray from origin along direction enters within maxDistance, among those accept
+	// takes, as in bool accept(uint32_t item). Starting inside a box counts as entering it at 0
+	template<typename Accept>
+	Hit raycast(glm::vec3 origin, glm::vec3 direction, float maxDistance, Accept accept) const {
+		auto hit = Hit{ NO_ITEM, maxDistance };
+		if (this->nodes.empty()) return hit;
+		auto inverse = 1.f / direction;
+		this->stack.assign(1, 0);
+		while (!this->stack.empty()) {
+			auto& node = this->nodes[this->stack.back()];
+			this->stack.pop_back();
+			if (entry(origin, inverse, node.min, node.max, hit.distance) > hit.distance) continue;
+
+			if (node.count > 0) {
+				for (auto i = node.first; i < node.first + node.count; i++) {
+					auto item = this->items[i];
+					auto distance = entry(origin, inverse, this->itemMin(item), this->itemMax(item), hit.distance);
+					if (distance < hit.distance && accept(item)) { hit = Hit{ item, distance }; }
+				}
+				continue;
+			}
+			// The nearer child goes on top, so that its hits cut the farther one short
+			auto& left = this->nodes[node.first];
+			auto& right = this->nodes[node.first + 1];
+			auto leftEntry = entry(origin, inverse, left.min, left.max, hit.distance);
+			auto rightEntry = entry(origin, inverse, right.min, right.max, hit.distance);
+			auto nearFirst = leftEntry <= rightEntry;
+			this->stack.push_back(nearFirst ? node.first + 1 : node.first);
+			this->stack.push_back(nearFirst ? node.first : node.first + 1);
+		}
+		return hit;
+	}
+
+	// Replace overlapping with every item whose box the sphere overlaps, in no particular order
+	void overlapSphere(glm::vec3 centre, float radius, std::vector<uint32_t>& overlapping) const {
+		overlapping.clear();
+		if (this->nodes.empty()) return;
+		auto reaches = [&](glm::vec3 min, glm::vec3 max) {
+			auto offset = glm::clamp(centre, min, max) - centre;
+			return glm::dot(offset, offset) <= radius * radius;
+		};
+		this->stack.assign(1, 0);
+		while (!this->stack.empty()) {
+			auto& node = this->nodes[this->stack.back()];
+			this->stack.pop_back();
+			if (!reaches(node.min, node.max)) continue;
+
+			if (node.count > 0) {
+				for (auto i = node.first; i < node.first + node.count; i++) {
+					auto item = this->items[i];
+					if (reaches(this->itemMin(item), this->itemMax(item))) { overlapping.push_back(item); }
+				}
+			} else {
+				this->stack.push_back(node.first + 1);
+				this->stack.push_back(node.first);
+			}
+		}
+	}
+
+	// Surface area heuristic cost of the tree as it is now: inner nodes count once and leaves once per item, each
+	// in proportion to its surface area, relative to the root's
+	float getCost() const {
+		if (this->nodes.empty()) return 0.f;
+		auto rootArea = area(this->nodes[0].min, this->nodes[0].max);
+		return rootArea > 0.f ? (float)(this->cost / rootArea) : 0.f;
+	}
+
+	// Cost as of the last build
+	float getBuiltCost() const {
+		return this->builtCost;
+	}
+
+	size_t getNodeCount() const {
+		return this->nodes.size();
+	}
+
+	Node const* getNodes() const {
+		return this->nodes.data();
+	}
+
+private:
+	// An item's box while building
+	struct BuildBox {
+		glm::vec3 min;
+		glm::vec3 max;
+		glm::vec3 centroid;
+		uint32_t item;
+	};
+
+	struct Split {
+		int axis;	// or -1 if no split does better than any other
+		int bin;	// first bin on the right
+	};
+
+	// The split of the boxes among [begin, end) into bins along an axis whose cost is smallest. The boxes are
+	// binned along all three axes in one pass over them
+	static Split findSplit(
+		BuildBox const* begin, BuildBox const* end, glm::vec3 centroidMin, glm::vec3 centroidMax
+	) {
+		struct Bin {
+			glm::vec3 min;
+			glm::vec3 max;
+			uint32_t count;
+		};
+		Bin bins[3][BINS];
+		for (auto& axisBins : bins) {
+			for (auto& bin : axisBins) { bin = Bin{ glm::vec3(FLT_MAX), glm::vec3(-FLT_MAX), 0 }; }
+		}
+		auto size = centroidMax - centroidMin;
+		auto scale = glm::vec3(BINS) / glm::max(size, glm::vec3(FLT_MIN));
+		for (auto box = begin; box < end; box++) {
+			for (int axis = 0; axis < 3; axis++) {
+				auto& bin = bins[axis][binOf(box->centroid[axis], centroidMin[axis], scale[axis])];
+				bin.min = glm::min(bin.min, box->min);
+				bin.max = glm::max(bin.max, box->max);
+				bin.count++;
+			}
+		}
+
+		auto best = Split{ -1, 0 };
+		auto bestCost = FLT_MAX;
+		for (int axis = 0; axis < 3; axis++) {
+			if (!(size[axis] > 0.f)) continue;
+			// Areas and counts left of each split, swept from the left, then the right side swept from the right
+			float leftArea[BINS];
+			uint32_t leftCount[BINS];
+			auto min = glm::vec3(FLT_MAX);
+			auto max = glm::vec3(-FLT_MAX);
+			uint32_t count = 0;
+			for (int bin = 0; bin < BINS - 1; bin++) {
+				min = glm::min(min, bins[axis][bin].min);
+				max = glm::max(max, bins[axis][bin].max);
+				count += bins[axis][bin].count;
+				leftArea[bin + 1] = count > 0 ? area(min, max) : 0.f;
+				leftCount[bin + 1] = count;
+			}
+			min = glm::vec3(FLT_MAX);
+			max = glm::vec3(-FLT_MAX);
+			count = 0;
+			for (int bin = BINS - 1; bin > 0; bin--) {
+				min = glm::min(min, bins[axis][bin].min);
+				max = glm::max(max, bins[axis][bin].max);
+				count += bins[axis][bin].count;
+				if (count == 0 || leftCount[bin] == 0) continue;
+				auto cost = leftArea[bin] * leftCount[bin] + area(min, max) * count;
+				if (cost < bestCost) {
+					bestCost = cost;
+					best = Split{ axis, bin };
+				}
+			}
+		}
+		return best;
+	}
+
+	// Recompute a node's box from its items' or its children's, and clear its mark
+	void refit(uint32_t index) {
+		auto& node = this->nodes[index];
+		auto weight = node.count > 0 ? (double)node.count : 1.0;
+		this->cost -= area(node.min, node.max) * weight;
+		if (node.count > 0) {
+			node.min = glm::vec3(FLT_MAX);
+			node.max = glm::vec3(-FLT_MAX);
+			for (auto i = node.first; i < node.first + node.count; i++) {
+				auto item = this->items[i];
+				node.min = glm::min(node.min, this->itemMin(item));
+				node.max = glm::max(node.max, this->itemMax(item));
+			}
+		} else {
+			auto& left = this->nodes[node.first];
+			auto& right = this->nodes[node.first + 1];
+			node.min = glm::min(left.min, right.min);
+			node.max = glm::max(left.max, right.max);
+		}
+		this->cost += area(node.min, node.max) * weight;
+		this->refitMarks[index] = 0;
+	}
+
+	static int binOf(float centroid, float min, float scale) {
+		return std::min(BINS - 1, (int)((centroid - min) * scale));
+	}
+
+	// Half the surface area of a box, which is all the heuristic needs
+	static float area(glm::vec3 min, glm::vec3 max) {
+		auto size = max - min;
+		return size.x * size.y + size.y * size.z + size.z * size.x;
+	}
+
+	// Where a ray enters a box, by the slab test, or FLT_MAX if it misses it or only gets there past maxDistance
+	static float entry(glm::vec3 origin, glm::vec3 inverse, glm::vec3 min, glm::vec3 max, float maxDistance) {
+		auto near = (min - origin) * inverse;
+		auto far = (max - origin) * inverse;
+		auto enter = glm::min(near, far);
+		auto leave = glm::max(near, far);
+		auto first = std::max(std::max(enter.x, enter.y), std::max(enter.z, 0.f));
+		auto last = std::min(std::min(leave.x, leave.y), std::min(leave.z, maxDistance));
+		return first <= last ? first : FLT_MAX;
+	}
+
+	glm::vec3 itemMin(uint32_t item) const {
+		auto& volumes = *this->volumes;
+		return glm::vec3(volumes.centreX[item] - volumes.extentX[item], volumes.centreY[item] - volumes.extentY[item],
+			volumes.centreZ[item] - volumes.extentZ[item]);
+	}
+
+	glm::vec3 itemMax(uint32_t item) const {
+		auto& volumes = *this->volumes;
+		return glm::vec3(volumes.centreX[item] + volumes.extentX[item], volumes.centreY[item] + volumes.extentY[item],
+			volumes.centreZ[item] + volumes.extentZ[item]);
+	}
+
+	// Items under a node are consecutive, from its leftmost leaf's first to its rightmost leaf's last
+	uint32_t subtreeBegin(Node const& node) const {
+		auto current = &node;
+		while (current->count == 0) { current = &this->nodes[current->first]; }
+		return current->first;
+	}
+
+	uint32_t subtreeEnd(Node const& node) const {
+		auto current = &node;
+		while (current->count == 0) { current = &this->nodes[current->first + 1]; }
+		return current->first + current->count;
+	}
+};
\ No newline at end of file
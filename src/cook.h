@@ -0,0 +1,88 @@
+#pragma once
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "objects/object/baked_scene.h"
+#include "objects/texture/compressed_image.h"
+#include "objects/texture/image.h"
+
+// Offline asset cooking, run with `--compress <format> <output.ktx> <inputs>...` in place of the scene.
+// Textures are cooked next to their source image, as the same path with a .ktx extension, and the skybox into
+// textures/skybox.ktx; the scene then loads the cooked versions instead of decoding the originals.
+// Static scenes are baked with `--bake <scene>`, next to their description
+namespace cook {
+
+	// Compress one image into a 2D texture, or six into a cubemap in +X, -X, +Y, -Y, +Z, -Z order.
+	// Returns false if the arguments were wrong or the output could not be written
+	inline bool compress(int argc, char* argv[]) {
+		auto usage = "Usage: --compress <bc1|bc3|bc5|bc7> <output.ktx> <image> | <+x> <-x> <+y> <-y> <+z> <-z>";
+		if (argc != 5 && argc != 10) {
+			std::cerr << usage << std::endl;
+			return false;
+		}
+		auto formatName = std::string(argv[2]);
+		BlockFormat format;
+		if (formatName == "bc1") { format = BlockFormat::BC1; }
+		else if (formatName == "bc3") { format = BlockFormat::BC3; }
+		else if (formatName == "bc5") { format = BlockFormat::BC5; }
+		else if (formatName == "bc7") { format = BlockFormat::BC7; }
+		else {
+			std::cerr << "Unknown format \"" << formatName << "\". " << usage << std::endl;
+			return false;
+		}
+
+		auto images = std::vector<Image>();
+		auto faces = std::vector<Image const*>();
+		for (int i = 4; i < argc; i++) { images.push_back(Image(argv[i])); }
+		for (auto& image : images) {
+			if (image.getWidth() != images[0].getWidth() || image.getHeight() != images[0].getHeight()) {
+				std::cerr << "Every face of a cubemap must have the same size" << std::endl;
+				return false;
+			}
+			faces.push_back(&image);
+		}
+
+		auto start = std::chrono::steady_clock::now();
+		ThreadPool pool;
+		auto compressed = CompressedImage::compress(faces, format, pool);
+		auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		if (!compressed.write(argv[3])) {
+			std::cerr << "Could not write \"" << argv[3] << "\"" << std::endl;
+			return false;
+		}
+
+		size_t uncompressedSize = 0;
+		for (int level = 0; level < compressed.getLevelCount(); level++) {
+			uncompressedSize += (size_t)compressed.getWidth(level) * compressed.getHeight(level) *
+				images[0].getChannelCount() * images.size();
+		}
+		std::cout << argv[3] << ": " << formatName << ", " << compressed.getWidth() << "x" << compressed.getHeight()
+			<< ", " << compressed.getLevelCount() << " levels, " << images.size() << " faces, in " << seconds << " s" << std::endl;
+		std::cout << "  " << uncompressedSize << " -> " << compressed.getTotalSize() << " bytes ("
+			<< (double)uncompressedSize / compressed.getTotalSize() << "x smaller than uncompressed with mips)" << std::endl;
+		for (size_t face = 0; face < images.size(); face++) {
+			std::cout << "  " << argv[4 + face] << ": " << compressed.psnr(images[face], (int)face) << " dB PSNR" << std::endl;
+		}
+		return true;
+	}
+
+	// Bake the static props of a scene description into batches, as BakedScene does when its bake is out of date.
+	// Returns false if the arguments were wrong or the description could not be read
+	inline bool bake(int argc, char* argv[]) {
+		if (argc != 3) {
+			std::cerr << "Usage: --bake <scene>" << std::endl;
+			return false;
+		}
+		auto start = std::chrono::steady_clock::now();
+		auto batches = BakedScene::Batches();
+		if (!BakedScene::bake(argv[2], batches)) return false;
+		auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		auto bakedPath = BakedScene::bakedPathOf(argv[2]);
+		MeshCache::write(argv[2], bakedPath.c_str(), batches.view(), BakedScene::STREAMS, batches.sources);
+		std::cout << bakedPath << ": baked in " << seconds << " s" << std::endl;
+		return true;
+	}
+}
\ No newline at end of file
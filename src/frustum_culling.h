@@ -0,0 +1,243 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#if defined(__AVX2__)
+#define FRUSTUM_CULLING_USE_AVX2
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FRUSTUM_CULLING_USE_SSE2
+#include <emmintrin.h>
+#endif
+
+#include <glm/glm.hpp>
+
+#include "thread_pool.h"
+
+// View-frustum culling of many bounding volumes at once. The volumes are stored as structure of arrays, so that a
+// plane is tested against eight of them at a time with AVX2, or four with SSE2, and large sets split across
+// threads. AVX2 is only used when the compiler targets it (/arch:AVX2), and SSE2 otherwise.
+//
+// Each volume is a box and a sphere sharing its centre. A volume is outside once either is wholly behind a plane,
+// so whichever of the two reaches less far towards the plane is the one tested
+namespace frustum_culling {
+
+	// Volumes per thread below which culling stays on the calling thread
+	const size_t MIN_SLICE = 32768;
+
+	// Extract the six planes of the frustum of a clip matrix, normalised and pointing inwards, as Gribb and
+	// Hartmann do: each plane is the last row of the matrix plus or minus one of the others
+	inline void extractPlanes(glm::mat4 const& clip, glm::vec4 (&planes)[6]) {
+		auto row = [&](int i) { return glm::vec4(clip[0][i], clip[1][i], clip[2][i], clip[3][i]); };
+		for (int i = 0; i < 3; i++) {
+			planes[2 * i] = row(3) + row(i);
+			planes[2 * i + 1] = row(3) - row(i);
+		}
+		for (auto& plane : planes) { plane /= glm::length(glm::vec3(plane)); }
+	}
+
+	// The frustum of a view-projection matrix, whose volumes are in world space
+	struct Frustum {
+		glm::vec4 planes[6];
+
+		explicit Frustum(glm::mat4 const& viewProjection) {
+			extractPlanes(viewProjection, this->planes);
+		}
+	};
+
+	// Bounding volumes, one array per component
+	struct Volumes {
+		std::vector<float> centreX;
+		std::vector<float> centreY;
+		std::vector<float> centreZ;
+		std::vector<float> extentX;	// half the box's size
+		std::vector<float> extentY;
+		std::vector<float> extentZ;
+		std::vector<float> radius;	// of the sphere
+
+		size_t size() const {
+			return this->radius.size();
+		}
+
+		void resize(size_t count) {
+			for (auto array : {
+				&this->centreX, &this->centreY, &this->centreZ, &this->extentX, &this->extentY, &this->extentZ,
+				&this->radius
+			}) {
+				array->resize(count);
+			}
+		}
+
+		void set(size_t i, glm::vec3 centre, glm::vec3 extent, float radius) {
+			this->centreX[i] = centre.x;
+			this->centreY[i] = centre.y;
+			this->centreZ[i] = centre.z;
+			this->extentX[i] = extent.x;
+			this->extentY[i] = extent.y;
+			this->extentZ[i] = extent.z;
+			this->radius[i] = radius;
+		}
+	};
+
+	// One volume at a time, the reference the vectorised pass has to agree with. Sums are in the same order as
+	// there, so that both round the same way
+	inline bool isVisible(Frustum const& frustum, Volumes const& volumes, size_t i) {
+		for (auto& plane : frustum.planes) {
+			auto distance = plane.x * volumes.centreX[i] + plane.y * volumes.centreY[i] + plane.z * volumes.centreZ[i] +
+				plane.w;
+			auto boxReach = std::abs(plane.x) * volumes.extentX[i] + std::abs(plane.y) * volumes.extentY[i] +
+				std::abs(plane.z) * volumes.extentZ[i];
+			if (distance + std::min(boxReach, volumes.radius[i]) < 0.f) return false;
+		}
+		return true;
+	}
+
+	// Append the visible volumes among [begin, end) to visible, one at a time
+	inline void cullScalar(
+		Frustum const& frustum, Volumes const& volumes, size_t begin, size_t end, std::vector<uint32_t>& visible
+	) {
+		for (auto i = begin; i < end; i++) {
+			if (isVisible(frustum, volumes, i)) { visible.push_back((uint32_t)i); }
+		}
+	}
+
+#if defined(FRUSTUM_CULLING_USE_AVX2)
+	const size_t LANES = 8;
+
+	// Append the visible volumes among [begin, end) to visible, eight at a time, and what is left one at a time
+	inline void cullLanes(
+		Frustum const& frustum, Volumes const& volumes, size_t begin, size_t end, std::vector<uint32_t>& visible
+	) {
+		__m256 planeX[6], planeY[6], planeZ[6], planeW[6], absX[6], absY[6], absZ[6];
+		for (int p = 0; p < 6; p++) {
+			auto& plane = frustum.planes[p];
+			planeX[p] = _mm256_set1_ps(plane.x);
+			planeY[p] = _mm256_set1_ps(plane.y);
+			planeZ[p] = _mm256_set1_ps(plane.z);
+			planeW[p] = _mm256_set1_ps(plane.w);
+			absX[p] = _mm256_set1_ps(std::abs(plane.x));
+			absY[p] = _mm256_set1_ps(std::abs(plane.y));
+			absZ[p] = _mm256_set1_ps(std::abs(plane.z));
+		}
+		auto zero = _mm256_setzero_ps();
+		auto i = begin;
+		for (; i + LANES <= end; i += LANES) {
+			auto centreX = _mm256_loadu_ps(volumes.centreX.data() + i);
+			auto centreY = _mm256_loadu_ps(volumes.centreY.data() + i);
+			auto centreZ = _mm256_loadu_ps(volumes.centreZ.data() + i);
+			auto extentX = _mm256_loadu_ps(volumes.extentX.data() + i);
+			auto extentY = _mm256_loadu_ps(volumes.extentY.data() + i);
+			auto extentZ = _mm256_loadu_ps(volumes.extentZ.data() + i);
+			auto radius = _mm256_loadu_ps(volumes.radius.data() + i);
+			auto outside = zero;
+			for (int p = 0; p < 6; p++) {
+				auto distance = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(
+					_mm256_mul_ps(planeX[p], centreX), _mm256_mul_ps(planeY[p], centreY)),
+					_mm256_mul_ps(planeZ[p], centreZ)), planeW[p]
+				);
+				auto boxReach = _mm256_add_ps(_mm256_add_ps(
+					_mm256_mul_ps(absX[p], extentX), _mm256_mul_ps(absY[p], extentY)), _mm256_mul_ps(absZ[p], extentZ)
+				);
+				auto reach = _mm256_min_ps(boxReach, radius);
+				outside = _mm256_or_ps(outside, _mm256_cmp_ps(_mm256_add_ps(distance, reach), zero, _CMP_LT_OQ));
+			}
+			auto inside = ~_mm256_movemask_ps(outside) & 0xFF;
+			for (size_t lane = 0; lane < LANES; lane++) {
+				if (inside & (1 << lane)) { visible.push_back((uint32_t)(i + lane)); }
+			}
+		}
+		cullScalar(frustum, volumes, i, end, visible);
+	}
+#elif defined(FRUSTUM_CULLING_USE_SSE2)
+	const size_t LANES = 4;
+
+	// Append the visible volumes among [begin, end) to visible, four at a time, and what is left one at a time
+	inline void cullLanes(
+		Frustum const& frustum, Volumes const& volumes, size_t begin, size_t end, std::vector<uint32_t>& visible
+	) {
+		__m128 planeX[6], planeY[6], planeZ[6], planeW[6], absX[6], absY[6], absZ[6];
+		for (int p = 0; p < 6; p++) {
+			auto& plane = frustum.planes[p];
+			planeX[p] = _mm_set1_ps(plane.x);
+			planeY[p] = _mm_set1_ps(plane.y);
+			planeZ[p] = _mm_set1_ps(plane.z);
+			planeW[p] = _mm_set1_ps(plane.w);
+			absX[p] = _mm_set1_ps(std::abs(plane.x));
+			absY[p] = _mm_set1_ps(std::abs(plane.y));
+			absZ[p] = _mm_set1_ps(std::abs(plane.z));
+		}
+		auto zero = _mm_setzero_ps();
+		auto i = begin;
+		for (; i + LANES <= end; i += LANES) {
+			auto centreX = _mm_loadu_ps(volumes.centreX.data() + i);
+			auto centreY = _mm_loadu_ps(volumes.centreY.data() + i);
+			auto centreZ = _mm_loadu_ps(volumes.centreZ.data() + i);
+			auto extentX = _mm_loadu_ps(volumes.extentX.data() + i);
+			auto extentY = _mm_loadu_ps(volumes.extentY.data() + i);
+			auto extentZ = _mm_loadu_ps(volumes.extentZ.data() + i);
+			auto radius = _mm_loadu_ps(volumes.radius.data() + i);
+			auto outside = zero;
+			for (int p = 0; p < 6; p++) {
+				auto distance = _mm_add_ps(_mm_add_ps(_mm_add_ps(
+					_mm_mul_ps(planeX[p], centreX), _mm_mul_ps(planeY[p], centreY)),
+					_mm_mul_ps(planeZ[p], centreZ)), planeW[p]
+				);
+				auto boxReach = _mm_add_ps(_mm_add_ps(
+					_mm_mul_ps(absX[p], extentX), _mm_mul_ps(absY[p], extentY)), _mm_mul_ps(absZ[p], extentZ)
+				);
+				auto reach = _mm_min_ps(boxReach, radius);
+				outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(distance, reach), zero));
+			}
+			auto inside = ~_mm_movemask_ps(outside) & 0xF;
+			for (size_t lane = 0; lane < LANES; lane++) {
+				if (inside & (1 << lane)) { visible.push_back((uint32_t)(i + lane)); }
+			}
+		}
+		cullScalar(frustum, volumes, i, end, visible);
+	}
+#else
+	const size_t LANES = 1;
+
+	inline void cullLanes(
+		Frustum const& frustum, Volumes const& volumes, size_t begin, size_t end, std::vector<uint32_t>& visible
+	) {
+		cullScalar(frustum, volumes, begin, end, visible);
+	}
+#endif
+
+	// Replace visible with the index of every volume inside the frustum, in order. Large sets are split into
+	// slices across threads, each culled into a list of its own, and the lists joined in order afterwards.
+	// slices is scratch space for those lists, kept by the caller to reuse their storage. The threads are the
+	// workers of pool, along with the calling one
+	inline void cull(
+		Frustum const& frustum, Volumes const& volumes, std::vector<uint32_t>& visible,
+		std::vector<std::vector<uint32_t>>& slices, ThreadPool& pool
+	) {
+		visible.clear();
+		auto count = volumes.size();
+		auto threadCount = (size_t)pool.getThreadCount() + 1;
+		auto sliceCount = std::min(threadCount, count / MIN_SLICE);
+		if (sliceCount <= 1) {
+			cullLanes(frustum, volumes, 0, count, visible);
+			return;
+		}
+
+		slices.resize(sliceCount);
+		// Slices start on a multiple of the lane count, so that only the last one has volumes left over
+		auto boundary = [&](size_t slice) {
+			return slice == sliceCount ? count : count * slice / sliceCount / LANES * LANES;
+		};
+		parallelFor(pool, sliceCount, 1, [&](size_t first, size_t last) {
+			for (auto slice = first; slice < last; slice++) {
+				slices[slice].clear();
+				cullLanes(frustum, volumes, boundary(slice), boundary(slice + 1), slices[slice]);
+			}
+		});
+		for (size_t slice = 0; slice < sliceCount; slice++) {
+			visible.insert(visible.end(), slices[slice].begin(), slices[slice].end());
+		}
+	}
+}
\ No newline at end of file
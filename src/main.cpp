@@ -5,6 +5,9 @@
 #endif
 #pragma comment(lib, "opengl32.lib")
 
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
 #include <iostream>
 #include <stack>
 
@@ -12,11 +15,18 @@
 #include "glm/gtc/matrix_transform.hpp"
 #include <glm/gtc/type_ptr.hpp>
 
+#include "assets.h"
+#include "benchmarks.h"
+#include "bvh.h"
+#include "cook.h"
+#include "objects/gl_state.h"
 #include "objects/object/object.h"
 #include "objects/object/object_position.h"
 #include "objects/skybox.h"
 #include "objects/texture/texture.h"
+#include "occlusion_culling.h"
 #include "programs.h"
+#include "scene.h"
 #include "window.h"
 
 struct Camera {
@@ -44,96 +54,196 @@ struct RenderData {
 	glm::vec3 lightPosition;
 	glm::vec2 lastMousePos;
 	GLfloat aspectRatio;
+	GLfloat screenHeight;
 	GLuint drawMode;
 	GLfloat timeDelta;
+	bool pick;	// say what is under the crosshair on the next frame
 
 	RenderData(
 		Camera camera, glm::vec3 lightPosition, GLfloat screenWidth, GLfloat screenHeight, GLuint drawMode
 	) :
 		camera(camera), lightPosition(lightPosition), 
 		lastMousePos(glm::vec2(screenWidth / 2.f, screenHeight / 2.f)), 
-		aspectRatio(screenWidth / screenHeight), drawMode(drawMode), timeDelta(0)
+		aspectRatio(screenWidth / screenHeight), screenHeight(screenHeight), drawMode(drawMode), timeDelta(0),
+		pick(false)
 	{}
 };
 
+// What the mesh handles of the scene's entities stand for
+enum SceneMesh : uint32_t {
+	CUBE_MESH,
+	RUBIK_MESH,
+	LIGHT_MESH
+};
+
+// The entities display draws, and which of them the last frame's culling let through
+struct SceneEntities {
+	Scene::Entity cube;
+	Scene::Entity rubik;
+	Scene::Entity light;
+	Scene::Run grid;	// the stress cubes, consecutive so that their world matrices make one instance stream
+	std::vector<uint32_t> visible;	// in entity order, kept to reuse its storage every frame
+
+	bool isVisible(Scene::Entity entity) const {
+		return std::binary_search(this->visible.begin(), this->visible.end(), entity);
+	}
+};
+
+// The scene's objects in a single MeshBatch, drawn in place of the objects with --batched
+struct SceneBatch {
+	MeshBatch batch;
+	size_t cube;
+	size_t rubik;
+	std::vector<MeshBatch::Placement> placements;	// kept to reuse their storage every frame
+};
+
 // display callback, used in the event loop
 void display(
-	RenderData& data, 
-	ObjectProgram& objectProgram, Object const& cube, Object const& rubik,
+	RenderData& data, UniformBuffer<FrameUniforms> const& frame,
+	ObjectProgram& objectProgram, Object& cube, Object& rubik,
+	Scene& scene, Bvh& bvh, OcclusionCulling& occlusion, SceneEntities& entities,
+	SceneBatch* batched, StaticScene const& staticScene,
 	SkyboxProgram& skyboxProgram, Skybox const& skybox,
-	LightProgram& lightProgram, ObjectPosition const& light
+	LightProgram& lightProgram, ObjectPosition& light
 	//GroundProgram& groundProgram, NormalMap<Object>& ground
 ) {
-	glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+	gl_state::clearColor(glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-	glEnable(GL_DEPTH_TEST);
+	gl_state::enable(GL_DEPTH_TEST);
+	gl_state::depthFunc(GL_LEQUAL);
 
-	glEnable(GL_CULL_FACE);
+	gl_state::enable(GL_CULL_FACE);
 
 	glm::mat4 view = glm::lookAt(
 		data.camera.position,
 		data.camera.position + data.camera.lookDirection,
 		data.camera.up
 	);
-	glm::mat4 projection = glm::perspective(glm::radians(30.0f), data.aspectRatio, 0.1f, 100.0f);
+	auto fovY = glm::radians(30.0f);
+	glm::mat4 projection = glm::perspective(fovY, data.aspectRatio, 0.1f, 100.0f);
+	// Pixels a unit covers at a distance of 1, which levels of detail are picked from
+	auto projectionScale = data.screenHeight / (2.f * std::tan(fovY / 2.f));
+	auto viewProjection = projection * view;
+	frame.update(FrameUniforms(view, projection, data.camera.position, data.lightPosition));
 
 	// objects
 	{
 		objectProgram.program.use();
 
-		objectProgram.view.set(view);
-		objectProgram.projection.set(projection);
-		objectProgram.cameraPosition.set(data.camera.position);
-		objectProgram.lightPosition.set(data.lightPosition);
-
-		auto scale = 0.3f;
-
-		auto model = glm::mat4(1.f);
-		model = glm::translate(model, glm::vec3(-1.f, 0.301f, 0.f));
-		model = glm::scale(model, glm::vec3(scale));
-		objectProgram.model.set(model);
-		cube.draw(data.drawMode);
-
-		model = glm::mat4(1.f);
-		model = glm::translate(model, glm::vec3(1.f, 0.301f, 0.f));
-		model = glm::scale(model, glm::vec3(scale));
-		objectProgram.model.set(model);
-		rubik.draw(data.drawMode);
+		if (scene.getPosition(entities.light) != data.lightPosition) {
+			scene.setPosition(entities.light, data.lightPosition);
+		}
+		scene.update();
+		bvh.update(scene.getMoved());
+		bvh.frustum(frustum_culling::Frustum(viewProjection), entities.visible);
+		std::sort(entities.visible.begin(), entities.visible.end());
+		// Then those hidden behind the occluders
+		if (occlusion.getTriangleCount() > 0) {
+			occlusion.render(viewProjection);
+			occlusion.cull(scene.getWorldVolumes(), entities.visible);
+		}
+
+		// The entity whose bounds the centre of the screen is on, when asked
+		if (data.pick) {
+			data.pick = false;
+			auto hit = bvh.raycast(data.camera.position, data.camera.lookDirection, 100.f, [&](uint32_t entity) {
+				return scene.getMesh(entity) != Scene::NO_HANDLE;
+			});
+			char const* meshNames[] = { "cube", "Rubik's cube", "light" };
+			if (hit.item == Bvh::NO_ITEM) {
+				std::cout << "Nothing under the crosshair" << std::endl;
+			} else {
+				std::cout << "Entity " << hit.item << " under the crosshair, a " << meshNames[scene.getMesh(hit.item)]
+					<< " " << hit.distance << " away" << std::endl;
+			}
+		}
+		auto& cubeModel = scene.getWorld(entities.cube);
+		auto& rubikModel = scene.getWorld(entities.rubik);
+
+		if (batched) {
+			// Every visible entity with a mesh in the batch, stress grid included, in a multi-draw per material array
+			auto& placements = batched->placements;
+			placements.clear();
+			for (auto entity : entities.visible) {
+				auto mesh = scene.getMesh(entity);
+				if (mesh != CUBE_MESH && mesh != RUBIK_MESH) continue;
+				placements.push_back(MeshBatch::Placement{
+					mesh == CUBE_MESH ? batched->cube : batched->rubik, scene.getWorld(entity)
+				});
+			}
+			objectProgram.setBatched();
+			batched->batch.draw(data.drawMode, placements);
+		} else {
+			if (entities.isVisible(entities.cube)) {
+				cube.selectLod(cubeModel, data.camera.position, projectionScale);
+				objectProgram.setModel(cubeModel, cube);
+				cube.draw(data.drawMode, MeshletCulling(cubeModel, viewProjection, data.camera.position));
+			}
+
+			if (entities.isVisible(entities.rubik)) {
+				rubik.selectLod(rubikModel, data.camera.position, projectionScale);
+				objectProgram.setModel(rubikModel, rubik);
+				rubik.draw(data.drawMode, MeshletCulling(rubikModel, viewProjection, data.camera.position));
+			}
+
+			// The stress grid, at the level of detail of the cube above. Only the cubes that moved since the last
+			// frame are uploaded again, and each run of consecutive visible cubes is one instanced draw
+			auto& grid = entities.grid;
+			if (grid.count > 0) {
+				for (auto& run : scene.getMoved()) {
+					auto first = std::max(run.first, grid.first);
+					auto end = std::min(run.first + run.count, grid.first + grid.count);
+					if (first < end) {
+						cube.updateInstances(scene.getWorlds() + first, first - grid.first, end - first);
+					}
+				}
+				objectProgram.setInstanced(cube);
+				auto visible = std::lower_bound(entities.visible.begin(), entities.visible.end(), grid.first);
+				auto gridEnd = grid.first + grid.count;
+				while (visible != entities.visible.end() && *visible < gridEnd) {
+					auto first = *visible;
+					auto count = 0u;
+					while (visible != entities.visible.end() && *visible == first + count && *visible < gridEnd) {
+						visible++;
+						count++;
+					}
+					cube.drawInstanceRange(data.drawMode, first - grid.first, (GLsizei)count);
+				}
+			}
+		}
+
+		// Static props, a draw per material whatever their number
+		if (staticScene.getBatchCount() > 0) {
+			objectProgram.setStatic();
+			staticScene.draw(data.drawMode, MeshletCulling(glm::mat4(1.f), viewProjection, data.camera.position));
+		}
 	}
 	// light
-	{
+	if (entities.isVisible(entities.light)) {
 		lightProgram.program.use();
-		lightProgram.view.set(view);
-		lightProgram.projection.set(projection);
 
-		auto model = glm::mat4(1.f);
-		model = glm::translate(model, data.lightPosition);
-		model = glm::scale(model, glm::vec3(0.1));
+		auto& model = scene.getWorld(entities.light);
 		lightProgram.model.set(model);
-		light.draw(data.drawMode);
+		light.selectLod(model, data.camera.position, projectionScale);
+		light.draw(data.drawMode, MeshletCulling(model, viewProjection, data.camera.position));
 	}
 	// ground
 	/*
 	{
 		groundProgram.program.use();
 		groundProgram.model.set(glm::mat4(1.f));
-		groundProgram.view.set(view);
-		groundProgram.projection.set(projection);
 		groundProgram.colourMode.set(1); //TODO: probably remove
 		ground.draw(data.drawMode);
 
 	}
 	*/
-	// skybox
+	// skybox, which surrounds the camera and so is never culled
 	{
 		skyboxProgram.program.use();
-		skyboxProgram.view.set(glm::mat4(glm::mat3(view)));
-		skyboxProgram.projection.set(projection);
 		skybox.draw(data.drawMode);
 	}
 
-	glDisableVertexAttribArray(0);
-	glUseProgram(0);
+	gl_state::useProgram(0);
 }
 
 // GLFW's docs recommend using glfwGetKey for things like driving animation,
@@ -190,6 +300,7 @@ void keyboardCallback(GLFWwindow* window, int key, int scancode, int action, int
 		data.drawMode++;
 		if (data.drawMode > 2) data.drawMode = 0;
 	}
+	if (key == 'E' && action == GLFW_PRESS) { data.pick = true; }
 }
 
 // Handle mouse movement
@@ -228,9 +339,58 @@ static void reshapeCallback(GLFWwindow* window, int w, int h) {
 	auto data = (RenderData*)glfwGetWindowUserPointer(window);
 	glViewport(0, 0, (GLsizei)w, (GLsizei)h);
 	data->aspectRatio = ((float)w / 640.f*4.f) / ((float)h / 480.f*3.f);
+	data->screenHeight = (float)h;
 }
 
 int main(int argc, char* argv[]) {
+	if (argc == 3 && std::string(argv[1]) == "--bench") {
+		return benchmarks::run(argv[2]) ? 0 : 1;
+	}
+	if (argc >= 2 && std::string(argv[1]) == "--compress") {
+		return cook::compress(argc, argv) ? 0 : 1;
+	}
+	if (argc >= 2 && std::string(argv[1]) == "--bake") {
+		return cook::bake(argc, argv) ? 0 : 1;
+	}
+	unsigned int loaderThreads = 0;
+	size_t stressCubes = 0;
+	auto batch = false;
+	auto scenePath = std::string();
+	for (int i = 1; i < argc; i++) {
+		auto argument = std::string(argv[i]);
+		if (argument == "--loader-threads" && i + 1 < argc) {
+			loaderThreads = (unsigned int)std::max(1, atoi(argv[++i]));
+		} else if (argument == "--stress" && i + 1 < argc) {
+			stressCubes = (size_t)std::max(0, atoi(argv[++i]));
+		} else if (argument == "--scene" && i + 1 < argc) {
+			scenePath = argv[++i];
+		} else if (argument == "--batched") {
+			batch = true;
+		}
+	}
+
+	// Start loading assets straight away, so that it overlaps with creating the window and building the programs
+	auto loadStart = std::chrono::steady_clock::now();
+	AssetLoader loader(loaderThreads);
+	auto cubeSource = loader.object("objects/aof5_cube.obj");
+	auto rubikSource = loader.object("objects/rubik.obj");
+	auto lightSource = loader.mesh("objects/light_sphere.obj", 0);
+	auto staticSource = scenePath.empty() ? std::future<StaticScene::Source>() : loader.staticScene(scenePath.c_str());
+	// A skybox cooked with --compress replaces the six JPEGs
+	auto skyboxIsCooked = CompressedImage::exists("textures/skybox.ktx");
+	auto cookedSkybox = skyboxIsCooked ? loader.compressedImage("textures/skybox.ktx") : std::future<CompressedImage>();
+	auto skyboxFaces = std::array<std::future<MipChain>, 6>();
+	if (!skyboxIsCooked) {
+		skyboxFaces = {
+			loader.mipChain("textures/skybox/right.jpg", true),
+			loader.mipChain("textures/skybox/left.jpg", true),
+			loader.mipChain("textures/skybox/top.jpg", true),
+			loader.mipChain("textures/skybox/bottom.jpg", true),
+			loader.mipChain("textures/skybox/front.jpg", true),
+			loader.mipChain("textures/skybox/back.jpg", true),
+		};
+	}
+
 	auto width = 1024;
 	auto height = 768;
 
@@ -253,42 +413,115 @@ int main(int argc, char* argv[]) {
 	window.setKeyCallback(keyboardCallback);
 	window.setReshapeCallback(reshapeCallback);
 
-	GLuint vao;
-	glGenVertexArrays(1, &vao);
-	glBindVertexArray(vao);
-
 	auto objectProgram = ObjectProgram("shaders/object.vert", "shaders/object.frag");
 	auto skyboxProgram = SkyboxProgram("shaders/skybox.vert", "shaders/skybox.frag");
 	auto lightProgram = LightProgram("shaders/light.vert", "shaders/light.frag");
 	//auto groundProgram = GroundProgram("shaders/ground.vert", "shaders/ground.frag");
+	// Camera and light, read by every program from the same buffer
+	auto frame = UniformBuffer<FrameUniforms>(
+		FrameUniforms(glm::mat4(1.f), glm::mat4(1.f), renderData.camera.position, renderData.lightPosition)
+	);
 
-	auto cube = Object(ObjectData("objects/aof5_cube.obj"));
-	auto rubik = Object(ObjectData("objects/rubik.obj"));
+	// Textures of the same size share one array, so the objects below share a bind per array
+	auto materials = texture::MaterialArrays();
+	auto cubeLoaded = cubeSource.get();
+	auto rubikLoaded = rubikSource.get();
+	auto lightMesh = lightSource.get();
+	// With --batched, the meshes also go into a batch, sharing the textures of the objects
+	auto sceneBatch = SceneBatch{ MeshBatch(materials), 0, 0, {} };
+	if (batch) {
+		auto add = [&](Object::Source& source) {
+			auto mesh = source.mesh.view();
+			return sceneBatch.batch.add(mesh, source.textures.add(mesh.submeshes, materials));
+		};
+		sceneBatch.cube = add(cubeLoaded);
+		sceneBatch.rubik = add(rubikLoaded);
+	}
+	// Where everything goes. The stress cubes hang off an entity of their own, and move with it
+	auto scene = Scene();
+	auto identity = glm::quat(1.f, 0.f, 0.f, 0.f);
+	auto boundsOf = [](MeshView const& mesh) {
+		return Scene::Bounds{ mesh.boundsMin, mesh.boundsMax, mesh.sphereRadius };
+	};
+	auto cubeBounds = boundsOf(cubeLoaded.mesh.view());
+	auto rubikBounds = boundsOf(rubikLoaded.mesh.view());
+	auto entities = SceneEntities();
+	entities.cube = scene.create(
+		Scene::NONE, glm::vec3(-1.f, 0.301f, 0.f), identity, glm::vec3(0.3f), cubeBounds, CUBE_MESH
+	);
+	entities.rubik = scene.create(
+		Scene::NONE, glm::vec3(1.f, 0.301f, 0.f), identity, glm::vec3(0.3f), rubikBounds, RUBIK_MESH
+	);
+	entities.light = scene.create(
+		Scene::NONE, renderData.lightPosition, identity, glm::vec3(0.1f), boundsOf(lightMesh.view()), LIGHT_MESH
+	);
+	auto grid = scene.create(Scene::NONE, glm::vec3(0.f), identity, glm::vec3(1.f), Scene::Bounds());
+	entities.grid = Scene::Run{ scene.getEntityCount(), (Scene::Entity)stressCubes };
+	for (auto& position : benchmarks::cubeGridPositions(stressCubes)) {
+		scene.create(grid, position, identity, glm::vec3(benchmarks::GRID_CUBE_SCALE), cubeBounds, CUBE_MESH);
+	}
+	scene.update();
+	// Culling and picking go through a hierarchy over the entities' bounds, refitted as they move
+	auto bvh = Bvh();
+	bvh.build(scene.getWorldVolumes());
+
+	auto cube = Object(std::move(cubeLoaded), materials);
+	auto rubik = Object(std::move(rubikLoaded), materials);
+	// Static props of the scene given with --scene, if any, which also hide the entities behind them
+	auto staticScene = StaticScene();
+	// Loading is done by now, so the loader threads are free to share the culling of every frame
+	auto occlusion = OcclusionCulling(loader.getPool());
+	if (!scenePath.empty()) {
+		auto staticLoaded = staticSource.get();
+		occlusion.addOccluder(staticLoaded.baked.view(), glm::mat4(1.f));
+		staticScene = StaticScene(std::move(staticLoaded), materials);
+	}
+	materials.upload();
+	if (batch) { sceneBatch.batch.upload(); }
+	cube.uploadInstances(scene.getWorlds() + entities.grid.first, (GLsizei)entities.grid.count);
 
-	auto light = ObjectPosition(ObjectData("objects/light_sphere.obj"));
+	auto light = ObjectPosition(lightMesh);
 
 	//auto ground = NormalMap<Object>(ObjectData("objects/ground.obj"));
 
-	auto skybox = Skybox({
-		"textures/skybox/right.jpg",
-		"textures/skybox/left.jpg",
-		"textures/skybox/top.jpg",
-		"textures/skybox/bottom.jpg",
-		"textures/skybox/front.jpg",
-		"textures/skybox/back.jpg",
-	});
+	auto skybox = skyboxIsCooked ? Skybox(cookedSkybox.get()) : Skybox(AssetLoader::getAll(skyboxFaces));
+
+	std::cout << "Loaded assets in " << std::chrono::duration<double>(std::chrono::steady_clock::now() - loadStart).count()
+		<< " s with " << loader.getThreadCount() << " loader threads" << std::endl;
 
+	// Frame time, and how many state changes the state tracker passed on and dropped, reported every few seconds
+	size_t frames = 0;
+	auto lastReport = glfwGetTime();
 	window.eventLoop([&](auto& window) {
 		keyboardPoll(window);
-		display(window.getData(), 
-			objectProgram, cube, rubik,
+		display(window.getData(), frame,
+			objectProgram, cube, rubik, scene, bvh, occlusion, entities, batch ? &sceneBatch : nullptr, staticScene,
 			skyboxProgram, skybox,
 			lightProgram, light
 			//groundProgram, ground
 		);
-	});
 
-	glDeleteVertexArrays(1, &vao);
+		frames++;
+		if (glfwGetTime() - lastReport >= 5.0) {
+			auto& counters = gl_state::counters();
+			std::cout << (glfwGetTime() - lastReport) / frames * 1e3 << " ms per frame";
+			if (stressCubes > 0) { std::cout << " with " << stressCubes << " stress cubes"; }
+			std::cout << ", GL state calls per frame: " << counters.issued / frames << " issued, "
+				<< counters.skipped / frames << " skipped" << std::endl;
+			gl_state::resetCounters();
+			auto& occluded = occlusion.getStats();
+			if (occluded.frames > 0) {
+				std::cout << "  occlusion culling per frame: " << occluded.rasterSeconds / occluded.frames * 1e3
+					<< " ms rasterizing " << occluded.triangles / occluded.frames << " occluder triangles, "
+					<< occluded.testSeconds / occluded.frames * 1e3 << " ms testing, "
+					<< 100.0 * occluded.culled / std::max<size_t>(1, occluded.tested) << "% of "
+					<< occluded.tested / occluded.frames << " entities culled" << std::endl;
+				occlusion.resetStats();
+			}
+			frames = 0;
+			lastReport = glfwGetTime();
+		}
+	});
 
 	return 0;
 }
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <cstdint>
+#include <utility>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Size and last modification time of a file, used to cheaply detect changes to it
+struct FileStamp {
+	uint64_t size;
+	int64_t modified;
+
+	// Returns false if the file cannot be accessed
+	static bool of(char const* path, FileStamp& stamp) {
+#ifdef _WIN32
+		struct _stat64 info;
+		if (_stat64(path, &info) != 0) return false;
+#else
+		struct stat info;
+		if (stat(path, &info) != 0) return false;
+#endif
+		stamp.size = (uint64_t)info.st_size;
+		stamp.modified = (int64_t)info.st_mtime;
+		return true;
+	}
+};
+
+// A read-only view of a whole file, mapped into memory.
+// The mapping is valid for as long as this object is alive
+class MappedFile {
+	void const* data;
+	size_t size;
+#ifdef _WIN32
+	HANDLE file;
+	HANDLE mapping;
+#endif
+
+public:
+	MappedFile() : data(nullptr), size(0) {
+#ifdef _WIN32
+		this->file = INVALID_HANDLE_VALUE;
+		this->mapping = NULL;
+#endif
+	}
+
+	// Map the file at the specified path. On failure, the result is empty
+	explicit MappedFile(char const* path) : MappedFile() {
+#ifdef _WIN32
+		this->file = CreateFileA(
+			path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL
+		);
+		if (this->file == INVALID_HANDLE_VALUE) return;
+		LARGE_INTEGER size;
+		if (!GetFileSizeEx(this->file, &size) || size.QuadPart == 0) return;
+		this->mapping = CreateFileMappingA(this->file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (this->mapping == NULL) return;
+		this->data = MapViewOfFile(this->mapping, FILE_MAP_READ, 0, 0, 0);
+		if (this->data) this->size = (size_t)size.QuadPart;
+#else
+		int fd = open(path, O_RDONLY);
+		if (fd == -1) return;
+		struct stat info;
+		if (fstat(fd, &info) == 0 && info.st_size > 0) {
+			void* data = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (data != MAP_FAILED) {
+				this->data = data;
+				this->size = (size_t)info.st_size;
+			}
+		}
+		// The mapping keeps the file alive on its own
+		close(fd);
+#endif
+	}
+
+	MappedFile(MappedFile const&) = delete;
+	MappedFile& operator=(MappedFile const&) = delete;
+	MappedFile(MappedFile&& from) noexcept : MappedFile() {
+		*this = std::move(from);
+	}
+	MappedFile& operator=(MappedFile&& from) noexcept {
+		std::swap(this->data, from.data);
+		std::swap(this->size, from.size);
+#ifdef _WIN32
+		std::swap(this->file, from.file);
+		std::swap(this->mapping, from.mapping);
+#endif
+		return *this;
+	}
+	~MappedFile() {
+#ifdef _WIN32
+		if (this->data) UnmapViewOfFile(this->data);
+		if (this->mapping != NULL) CloseHandle(this->mapping);
+		if (this->file != INVALID_HANDLE_VALUE) CloseHandle(this->file);
+#else
+		if (this->data) munmap(const_cast<void*>(this->data), this->size);
+#endif
+	}
+
+	bool isValid() const {
+		return this->data != nullptr;
+	}
+	unsigned char const* getBytes() const {
+		return (unsigned char const*)this->data;
+	}
+	size_t getSize() const {
+		return this->size;
+	}
+
+	// 64-bit FNV-1a hash of the file contents
+	uint64_t hash() const {
+		uint64_t hash = 0xcbf29ce484222325ull;
+		auto bytes = this->getBytes();
+		for (size_t i = 0; i < this->size; i++) {
+			hash ^= bytes[i];
+			hash *= 0x100000001b3ull;
+		}
+		return hash;
+	}
+};
@@ -1,17 +1,37 @@
 #pragma once
 
+#include <array>
 #include <vector>
 
 #include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "gl_state.h"
+#include "stream_buffer.h"
+
+// How the components of an attribute are laid out in its buffer
+struct VertexFormat {
+	GLint size;
+	GLenum type;
+	GLboolean normalized;
+	GLsizei stride;
+};
+
+// The format of an attribute stored on its own, as its trait struct describes it
+template<typename Attribute>
+VertexFormat formatOf() {
+	return VertexFormat{ Attribute::SIZE, Attribute::TYPE, Attribute::NORMALIZED, sizeof(typename Attribute::Element) };
+}
 
 template<typename Attribute>
 class AttributeArray {
 	GLuint name;
+	VertexFormat format;
 
 	using Element = typename Attribute::Element;
 
 public:
-	AttributeArray() : name(0) {}
+	AttributeArray() : name(0), format(formatOf<Attribute>()) {}
 
 	explicit AttributeArray(std::vector<Element> const& data) :
 		AttributeArray(data.data(), data.size()) {}
@@ -20,55 +40,268 @@ public:
 	AttributeArray(std::array<Element, LEN> const& data) :
 		AttributeArray(data.data(), data.size()) {}
 
-	AttributeArray(Element const* data, GLuint size) {
+	AttributeArray(Element const* data, GLuint size) : format(formatOf<Attribute>()) {
 		glGenBuffers(1, &this->name);
-		glBindBuffer(GL_ARRAY_BUFFER, this->name);
+		gl_state::bindBuffer(GL_ARRAY_BUFFER, this->name);
 		glBufferData(GL_ARRAY_BUFFER, size * sizeof(Element), &data[0], GL_STATIC_DRAW);
 	}
 
+	// Upload an attribute already encoded in the given format
+	AttributeArray(void const* data, size_t byteCount, VertexFormat format) : format(format) {
+		glGenBuffers(1, &this->name);
+		gl_state::bindBuffer(GL_ARRAY_BUFFER, this->name);
+		glBufferData(GL_ARRAY_BUFFER, byteCount, data, GL_STATIC_DRAW);
+	}
+
 	AttributeArray(AttributeArray const&) = delete;
 	AttributeArray& operator=(AttributeArray const&) = delete;
-	AttributeArray(AttributeArray&& from) noexcept {
+	AttributeArray(AttributeArray&& from) noexcept : AttributeArray() {
 		*this = std::move(from);
 	}
 	AttributeArray& operator=(AttributeArray&& from) noexcept {
+		if (this == &from) return *this;
+		if (this->name != 0) { gl_state::deleteBuffer(this->name); }
 		this->name = from.name;
-		from.name = -1;
+		this->format = from.format;
+		from.name = 0;
 		return *this;
 	}
 	~AttributeArray() {
-		if (this->name != -1) { glDeleteBuffers(1, &this->name); }
+		if (this->name != 0) { gl_state::deleteBuffer(this->name); }
 	}
 
+	// Point the attribute at this buffer, in the vertex array object being recorded
 	void bind() const {
 		glEnableVertexAttribArray(Attribute::ATTRIBUTE);
-		glBindBuffer(GL_ARRAY_BUFFER, this->name);
-		glVertexAttribPointer(Attribute::ATTRIBUTE, Attribute::SIZE, GL_FLOAT, GL_FALSE, 0, 0);
+		gl_state::bindBuffer(GL_ARRAY_BUFFER, this->name);
+		glVertexAttribPointer(
+			Attribute::ATTRIBUTE, this->format.size, this->format.type, this->format.normalized, this->format.stride, 0
+		);
+	}
+};
+
+// Index buffer for indexed drawing. Indices are stored as 16-bit values whenever every index fits,
+// halving the size of the buffer for all but the largest meshes.
+// Uploads go through GL_COPY_WRITE_BUFFER, as the GL_ELEMENT_ARRAY_BUFFER binding belongs to whichever vertex array
+// object is bound, and building a mesh must not change another mesh's indices
+class IndexArray {
+	GLuint name;
+	GLenum type;
+	GLsizei count;
+
+public:
+	IndexArray() : name(0), type(GL_UNSIGNED_INT), count(0) {}
+
+	explicit IndexArray(std::vector<GLuint> const& indices) :
+		IndexArray(indices.data(), indices.size()) {}
+
+	IndexArray(GLuint const* indices, GLsizei count) : type(typeFor(indices, count)), count(count) {
+		glGenBuffers(1, &this->name);
+		gl_state::bindBuffer(GL_COPY_WRITE_BUFFER, this->name);
+		if (this->type == GL_UNSIGNED_SHORT) {
+			auto narrowed = std::vector<GLushort>(indices, indices + count);
+			glBufferData(GL_COPY_WRITE_BUFFER, count * sizeof(GLushort), narrowed.data(), GL_STATIC_DRAW);
+		} else {
+			glBufferData(GL_COPY_WRITE_BUFFER, count * sizeof(GLuint), indices, GL_STATIC_DRAW);
+		}
+	}
+
+	// Upload indices that are already of the given type, as they are
+	IndexArray(void const* indices, GLenum type, GLsizei count) : type(type), count(count) {
+		glGenBuffers(1, &this->name);
+		gl_state::bindBuffer(GL_COPY_WRITE_BUFFER, this->name);
+		glBufferData(GL_COPY_WRITE_BUFFER, count * indexSize(type), indices, GL_STATIC_DRAW);
+	}
+
+	IndexArray(IndexArray const&) = delete;
+	IndexArray& operator=(IndexArray const&) = delete;
+	IndexArray(IndexArray&& from) noexcept : IndexArray() {
+		*this = std::move(from);
+	}
+	IndexArray& operator=(IndexArray&& from) noexcept {
+		if (this == &from) return *this;
+		if (this->name != 0) { gl_state::deleteBuffer(this->name); }
+		this->name = from.name;
+		this->type = from.type;
+		this->count = from.count;
+		from.name = 0;
+		return *this;
+	}
+	~IndexArray() {
+		if (this->name != 0) { gl_state::deleteBuffer(this->name); }
+	}
+
+	// Draw from this buffer, in the vertex array object being recorded
+	void bind() const {
+		gl_state::bindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->name);
+	}
+
+	// Draw every index in the buffer as the given primitive. A vertex array object using the buffer must be bound
+	void draw(GLenum mode) const {
+		glDrawElements(mode, this->count, this->type, 0);
+	}
+
+	// Draw count indices starting at first. A vertex array object using the buffer must be bound
+	void draw(GLenum mode, GLuint first, GLuint count) const {
+		glDrawElements(mode, count, this->type, (void const*)(first * indexSize(this->type)));
+	}
+
+	// Draw count indices starting at first, instanceCount times over, with instanced attributes read from instance
+	// baseInstance on. A vertex array object using the buffer must be bound
+	void drawInstanced(GLenum mode, GLuint first, GLuint count, GLsizei instanceCount, GLuint baseInstance = 0) const {
+		glDrawElementsInstancedBaseInstance(
+			mode, count, this->type, (void const*)(first * indexSize(this->type)), instanceCount, baseInstance
+		);
+	}
+
+	// Draw several ranges of indices in one call, each given by its count and its offset in bytes, as
+	// glMultiDrawElements takes them. A vertex array object using the buffer must be bound
+	void multiDraw(GLenum mode, std::vector<GLsizei> const& counts, std::vector<void const*> const& offsets) const {
+		glMultiDrawElements(mode, counts.data(), this->type, offsets.data(), (GLsizei)counts.size());
+	}
+
+	GLenum getType() const {
+		return this->type;
+	}
+
+	// The smallest index type able to address every index in the given list
+	static GLenum typeFor(GLuint const* indices, GLsizei count) {
+		for (GLsizei i = 0; i < count; i++) {
+			if (indices[i] > 0xFFFF) return GL_UNSIGNED_INT;
+		}
+		return GL_UNSIGNED_SHORT;
+	}
+
+	// Size in bytes of a single index of the given type
+	static size_t indexSize(GLenum type) {
+		return type == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
 	}
 };
 
+// Each attribute is read as SIZE components of TYPE, which are scaled into [0, 1] or [-1, 1] if NORMALIZED
 struct AttributePosition {
 	typedef glm::vec3 Element;
 	static const GLuint ATTRIBUTE = 0;
 	static const GLuint SIZE = 3;
+	static const GLenum TYPE = GL_FLOAT;
+	static const GLboolean NORMALIZED = GL_FALSE;
 };
 struct AttributeNormal {
 	typedef glm::vec3 Element;
 	static const GLuint ATTRIBUTE = 1;
 	static const GLuint SIZE = 3;
+	static const GLenum TYPE = GL_FLOAT;
+	static const GLboolean NORMALIZED = GL_FALSE;
 };
 struct AttributeTexCoord {
 	typedef glm::vec2 Element;
 	static const GLuint ATTRIBUTE = 2;
 	static const GLuint SIZE = 2;
+	static const GLenum TYPE = GL_FLOAT;
+	static const GLboolean NORMALIZED = GL_FALSE;
 };
-class AttributeTangent {
-	typedef glm::vec3 Element;
+// Tangent, with the handedness of the texture mapping in w
+struct AttributeTangent {
+	typedef glm::vec4 Element;
 	static const GLuint ATTRIBUTE = 3;
+	static const GLuint SIZE = 4;
+	static const GLenum TYPE = GL_FLOAT;
+	static const GLboolean NORMALIZED = GL_FALSE;
+};
+// Layer of the object's texture in its material array. Set once per draw rather than read from a buffer
+struct AttributeMaterialLayer {
+	typedef GLfloat Element;
+	static const GLuint ATTRIBUTE = 4;
+	static const GLuint SIZE = 1;
+	static const GLenum TYPE = GL_FLOAT;
+	static const GLboolean NORMALIZED = GL_FALSE;
+};
+// Model matrix of each instance in instanced draws. A mat4 takes up four attributes, one per column, from
+// ATTRIBUTE on
+struct AttributeInstanceModel {
+	typedef glm::mat4 Element;
+	static const GLuint ATTRIBUTE = 5;
+	static const GLuint SIZE = 4;
+	static const GLenum TYPE = GL_FLOAT;
+	static const GLboolean NORMALIZED = GL_FALSE;
+};
+
+// The encodings QuantizedMesh gives the attributes above.
+// Positions are 4 shorts rather than 3, so that every vertex is 4-byte aligned
+struct AttributePositionShort {
+	typedef GLuint64 Element;
+	static const GLuint ATTRIBUTE = AttributePosition::ATTRIBUTE;
 	static const GLuint SIZE = 3;
+	static const GLenum TYPE = GL_UNSIGNED_SHORT;
+	static const GLboolean NORMALIZED = GL_TRUE;
+};
+struct AttributeNormalPacked {
+	typedef GLuint Element;
+	static const GLuint ATTRIBUTE = AttributeNormal::ATTRIBUTE;
+	static const GLuint SIZE = 4;
+	static const GLenum TYPE = GL_INT_2_10_10_10_REV;
+	static const GLboolean NORMALIZED = GL_TRUE;
+};
+struct AttributeNormalOctahedral {
+	typedef GLuint Element;
+	static const GLuint ATTRIBUTE = AttributeNormal::ATTRIBUTE;
+	static const GLuint SIZE = 2;
+	static const GLenum TYPE = GL_SHORT;
+	static const GLboolean NORMALIZED = GL_TRUE;
+};
+struct AttributeTexCoordHalf {
+	typedef GLuint Element;
+	static const GLuint ATTRIBUTE = AttributeTexCoord::ATTRIBUTE;
+	static const GLuint SIZE = 2;
+	static const GLenum TYPE = GL_HALF_FLOAT;
+	static const GLboolean NORMALIZED = GL_FALSE;
 };
 
 typedef AttributeArray<AttributePosition> VertexArray;
 typedef AttributeArray<AttributeNormal> NormalArray;
 typedef AttributeArray<AttributeTexCoord> TexCoordArray;
-typedef AttributeArray<AttributeTangent> TangentArray;
\ No newline at end of file
+typedef AttributeArray<AttributeTangent> TangentArray;
+
+// Per-instance model matrices, read once per instance rather than once per vertex. Refilled before each instanced
+// draw, or uploaded once and then updated where they changed
+class InstanceArray {
+	StreamBuffer buffer;
+
+public:
+	InstanceArray() {}
+
+	// Create the buffer, empty until the first upload
+	static InstanceArray create() {
+		auto array = InstanceArray();
+		array.buffer = StreamBuffer(GL_ARRAY_BUFFER);
+		return array;
+	}
+
+	void upload(glm::mat4 const* models, GLsizei count) {
+		this->buffer.upload(models, count * sizeof(glm::mat4));
+	}
+
+	// Replace count matrices from first on, within those of the last upload
+	void update(glm::mat4 const* models, GLsizei first, GLsizei count) {
+		this->buffer.update(first * sizeof(glm::mat4), models, count * sizeof(glm::mat4));
+	}
+
+	// Point the instance model attributes at this buffer, in the vertex array object being recorded
+	void bind() const {
+		this->buffer.bind(GL_ARRAY_BUFFER);
+		pointModels(sizeof(glm::mat4), 0);
+	}
+
+	// Point the instance model attributes, advancing once per instance, at the matrices at offset in the buffer
+	// bound to GL_ARRAY_BUFFER, stride bytes apart
+	static void pointModels(GLsizei stride, size_t offset) {
+		typedef AttributeInstanceModel Model;
+		for (GLuint column = 0; column < 4; column++) {
+			auto attribute = Model::ATTRIBUTE + column;
+			auto columnOffset = (void const*)(offset + column * sizeof(glm::vec4));
+			glEnableVertexAttribArray(attribute);
+			glVertexAttribPointer(attribute, Model::SIZE, Model::TYPE, Model::NORMALIZED, stride, columnOffset);
+			glVertexAttribDivisor(attribute, 1);
+		}
+	}
+};
\ No newline at end of file
@@ -0,0 +1,202 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <vector>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+// A shadow copy of the OpenGL state the wrappers set, so that calls which would leave the state as it is are
+// dropped before they reach the driver. Every change to tracked state has to go through here, or the shadow goes
+// stale; after state is changed behind its back, invalidate() makes everything unknown again. There is a single
+// context, and so a single shadow
+namespace gl_state {
+
+	// Calls passed on to OpenGL, and calls dropped as redundant, since the counters were last reset
+	struct Counters {
+		size_t issued;
+		size_t skipped;
+
+		Counters() : issued(0), skipped(0) {}
+	};
+
+	// One piece of state, unknown until it is first set
+	template<typename T>
+	struct Shadow {
+		T value;
+		bool known;
+
+		Shadow() : value(), known(false) {}
+
+		// Record the new value, and return whether it changes anything
+		bool change(T const& value) {
+			if (this->known && this->value == value) return false;
+			this->value = value;
+			this->known = true;
+			return true;
+		}
+	};
+
+	// Texture targets tracked on every unit
+	const GLenum TEXTURE_TARGETS[] = { GL_TEXTURE_2D, GL_TEXTURE_2D_ARRAY, GL_TEXTURE_CUBE_MAP };
+	// Buffer targets tracked. GL_ELEMENT_ARRAY_BUFFER is left out, as it belongs to the bound vertex array object
+	const GLenum BUFFER_TARGETS[] = {
+		GL_ARRAY_BUFFER, GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, GL_UNIFORM_BUFFER, GL_DRAW_INDIRECT_BUFFER
+	};
+	const GLenum CAPABILITIES[] = { GL_DEPTH_TEST, GL_CULL_FACE, GL_MULTISAMPLE, GL_BLEND };
+
+	template<size_t N>
+	int indexOf(GLenum const (&values)[N], GLenum value) {
+		for (size_t i = 0; i < N; i++) {
+			if (values[i] == value) return (int)i;
+		}
+		return -1;
+	}
+
+	struct State {
+		Shadow<GLuint> program;
+		Shadow<GLuint> vertexArray;
+		Shadow<GLuint> activeTexture;	// unit
+		std::vector<std::array<Shadow<GLuint>, 3>> textures;	// of each unit, for each of TEXTURE_TARGETS
+		std::array<Shadow<GLuint>, 5> buffers;	// for each of BUFFER_TARGETS
+		std::array<Shadow<bool>, 4> capabilities;	// for each of CAPABILITIES
+		Shadow<GLenum> polygonMode;
+		Shadow<GLfloat> pointSize;
+		Shadow<GLenum> depthFunc;
+		Shadow<glm::vec4> clearColor;
+		Counters counters;
+	};
+
+	inline State& state() {
+		static State state;
+		return state;
+	}
+
+	// Count a call, and return whether it has to be made
+	inline bool issue(bool changed) {
+		auto& counters = state().counters;
+		if (changed) { counters.issued++; }
+		else { counters.skipped++; }
+		return changed;
+	}
+
+	// Forget every piece of state, as after creating a context. The counters are kept
+	inline void invalidate() {
+		auto counters = state().counters;
+		state() = State();
+		state().counters = counters;
+	}
+
+	inline Counters const& counters() {
+		return state().counters;
+	}
+
+	inline void resetCounters() {
+		state().counters = Counters();
+	}
+
+	inline void useProgram(GLuint program) {
+		if (issue(state().program.change(program))) { glUseProgram(program); }
+	}
+
+	inline void bindVertexArray(GLuint name) {
+		if (issue(state().vertexArray.change(name))) { glBindVertexArray(name); }
+	}
+
+	// The bound vertex array object, only asked of OpenGL if it is not known yet
+	inline GLuint boundVertexArray() {
+		auto& bound = state().vertexArray;
+		if (!bound.known) {
+			GLint name;
+			glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &name);
+			bound.change((GLuint)name);
+		}
+		return bound.value;
+	}
+
+	inline void activeTexture(GLuint unit) {
+		if (issue(state().activeTexture.change(unit))) { glActiveTexture(GL_TEXTURE0 + unit); }
+	}
+
+	// Bind a texture to a unit. The active unit only changes if the binding does
+	inline void bindTexture(GLuint unit, GLenum target, GLuint name) {
+		auto& textures = state().textures;
+		auto index = indexOf(TEXTURE_TARGETS, target);
+		if (index >= 0) {
+			if (textures.size() <= unit) { textures.resize(unit + 1); }
+			if (!issue(textures[unit][index].change(name))) return;
+		} else {
+			issue(true);
+		}
+		activeTexture(unit);
+		glBindTexture(target, name);
+	}
+
+	inline void bindBuffer(GLenum target, GLuint name) {
+		auto index = indexOf(BUFFER_TARGETS, target);
+		if (issue(index < 0 || state().buffers[index].change(name))) { glBindBuffer(target, name); }
+	}
+
+	inline void setCapability(GLenum capability, bool enabled) {
+		auto index = indexOf(CAPABILITIES, capability);
+		if (issue(index < 0 || state().capabilities[index].change(enabled))) {
+			if (enabled) { glEnable(capability); }
+			else { glDisable(capability); }
+		}
+	}
+
+	inline void enable(GLenum capability) {
+		setCapability(capability, true);
+	}
+
+	inline void disable(GLenum capability) {
+		setCapability(capability, false);
+	}
+
+	// Core profiles only take GL_FRONT_AND_BACK, so that is the face set
+	inline void polygonMode(GLenum mode) {
+		if (issue(state().polygonMode.change(mode))) { glPolygonMode(GL_FRONT_AND_BACK, mode); }
+	}
+
+	inline void pointSize(GLfloat size) {
+		if (issue(state().pointSize.change(size))) { glPointSize(size); }
+	}
+
+	inline void depthFunc(GLenum function) {
+		if (issue(state().depthFunc.change(function))) { glDepthFunc(function); }
+	}
+
+	inline void clearColor(glm::vec4 colour) {
+		if (issue(state().clearColor.change(colour))) { glClearColor(colour.r, colour.g, colour.b, colour.a); }
+	}
+
+	// Deleting an object unbinds it everywhere in this context, and its name may then be handed out again, so the
+	// deletions go through here too and clear what they unbind
+	inline void deleteTexture(GLuint name) {
+		for (auto& unit : state().textures) {
+			for (auto& binding : unit) {
+				if (binding.known && binding.value == name) { binding.value = 0; }
+			}
+		}
+		glDeleteTextures(1, &name);
+	}
+
+	inline void deleteBuffer(GLuint name) {
+		for (auto& binding : state().buffers) {
+			if (binding.known && binding.value == name) { binding.value = 0; }
+		}
+		glDeleteBuffers(1, &name);
+	}
+
+	inline void deleteVertexArray(GLuint name) {
+		auto& bound = state().vertexArray;
+		if (bound.known && bound.value == name) { bound.value = 0; }
+		glDeleteVertexArrays(1, &name);
+	}
+
+	// A program in use is only deleted once another one is used, so nothing about the binding changes
+	inline void deleteProgram(GLuint name) {
+		glDeleteProgram(name);
+	}
+}
\ No newline at end of file
@@ -0,0 +1,252 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <set>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "data.h"
+#include "mesh_cache.h"
+#include "mesh_source.h"
+
+// An OBJ placed in the world once and never moved
+struct StaticProp {
+	std::string path;
+	std::string texture;	// used by every triangle of the prop in place of its materials' textures, unless empty
+	glm::mat4 model;
+};
+
+// The static props of a scene, read from a text file with one prop per line, as
+//   prop <obj> <texture, or - to keep the OBJ's materials> <x> <y> <z> <yaw in degrees> <scale>
+// and the size of the cubes the world is split into for culling, as `chunk <size>`. # starts a comment
+struct SceneDescription {
+	std::vector<StaticProp> props;
+	float chunkSize;
+
+	SceneDescription() : chunkSize(8.f) {}
+
+	// Returns false, after saying which line is wrong, if the file cannot be read or is malformed
+	static bool read(char const* path, SceneDescription& description) {
+		auto in = std::ifstream(path);
+		if (!in.is_open()) {
+			std::cerr << "Could not read scene \"" << path << "\"" << std::endl;
+			return false;
+		}
+		auto line = std::string();
+		for (int number = 1; std::getline(in, line); number++) {
+			line = line.substr(0, line.find('#'));
+			auto words = std::istringstream(line);
+			auto keyword = std::string();
+			if (!(words >> keyword)) continue;
+
+			auto valid = false;
+			if (keyword == "chunk") {
+				valid = (words >> description.chunkSize) && description.chunkSize > 0.f;
+			} else if (keyword == "prop") {
+				auto prop = StaticProp();
+				auto position = glm::vec3(0.f);
+				float yaw, scale;
+				words >> prop.path >> prop.texture >> position.x >> position.y >> position.z >> yaw >> scale;
+				// A uniform, positive scale keeps the winding and the normals as they are
+				valid = words && scale > 0.f;
+				if (prop.texture == "-") { prop.texture.clear(); }
+				prop.model = glm::translate(glm::mat4(1.f), position);
+				prop.model = glm::rotate(prop.model, glm::radians(yaw), glm::vec3(0.f, 1.f, 0.f));
+				prop.model = glm::scale(prop.model, glm::vec3(scale));
+				description.props.push_back(prop);
+			}
+			if (!valid) {
+				std::cerr << path << ":" << number << ": expected `prop <obj> <texture|-> <x> <y> <z> <yaw> <scale>` "
+					<< "or `chunk <size>`" << std::endl;
+				return false;
+			}
+		}
+		return true;
+	}
+};
+
+// The static props of a scene, baked into world space and merged into a batch for each material and chunk of the
+// world holding triangles of that material, so that drawing them takes a draw per batch however many props there
+// are, while each chunk can still be culled on its own. A triangle goes to the chunk its centroid is in.
+// The bake is stored next to the description in the format of a MeshCache, each batch a submesh, with the OBJ and
+// material libraries of every prop as dependencies, and is loaded as MeshSource loads a mesh: memory-mapped when
+// it is up to date with the description and those files, or baked again otherwise
+class BakedScene {
+public:
+	static const uint32_t STREAMS = MeshCache::NORMALS | MeshCache::TEX_COORDS;
+
+	// The streams of a bake, as built
+	struct Batches {
+		std::vector<glm::vec3> vertices;
+		std::vector<glm::vec3> normals;
+		std::vector<glm::vec2> texCoords;
+		std::vector<GLuint> indices;
+		std::vector<Submesh> submeshes;	// a batch each, in material then chunk order
+		glm::vec3 boundsMin;
+		glm::vec3 boundsMax;
+		glm::vec3 sphereCentre;
+		float sphereRadius;
+		size_t propCount;
+		size_t materialCount;
+		size_t chunkCount;
+		std::vector<std::string> sources;	// the OBJ and material libraries of every prop, once each
+
+		MeshView view() const {
+			auto view = MeshView();
+			view.vertices = this->vertices.data();
+			view.normals = this->normals.data();
+			view.texCoords = this->texCoords.data();
+			view.vertexCount = (GLuint)this->vertices.size();
+			view.indices = this->indices.data();
+			view.indexType = GL_UNSIGNED_INT;
+			view.indexCount = (GLuint)this->indices.size();
+			view.boundsMin = this->boundsMin;
+			view.boundsMax = this->boundsMax;
+			view.sphereCentre = this->sphereCentre;
+			view.sphereRadius = this->sphereRadius;
+			view.submeshes = this->submeshes;
+			return view;
+		}
+
+		void print(std::ostream& out) const {
+			out << "  " << this->propCount << " props, " << this->indices.size() / 3 << " triangles -> "
+				<< this->submeshes.size() << " batches, of " << this->materialCount << " materials in "
+				<< this->chunkCount << " chunks" << std::endl;
+		}
+	};
+
+private:
+	MeshCache cache;
+	std::unique_ptr<Batches> batches;	// when baked this run
+
+public:
+	// Load the bake of the scene description at the given path, baking it first if needed.
+	// A broken description is fatal
+	explicit BakedScene(char const* path) {
+		auto bakedPath = bakedPathOf(path);
+		this->cache = MeshCache(path, bakedPath.c_str(), STREAMS);
+		if (!this->cache.isValid()) {
+			this->batches.reset(new Batches());
+			if (!bake(path, *this->batches)) {
+				std::cerr << "fatal error while loading \"" << path << "\", exiting" << std::endl;
+				exit(1);
+			}
+			MeshCache::write(path, bakedPath.c_str(), this->batches->view(), STREAMS, this->batches->sources);
+		}
+	}
+
+	BakedScene(BakedScene const&) = delete;
+	BakedScene& operator=(BakedScene const&) = delete;
+	BakedScene(BakedScene&&) noexcept = default;
+	BakedScene& operator=(BakedScene&&) noexcept = default;
+
+	// View of the baked streams, valid for as long as this scene is
+	MeshView view() const {
+		return this->batches ? this->batches->view() : this->cache.getView();
+	}
+
+	static std::string bakedPathOf(char const* path) {
+		return std::string(path) + ".baked";
+	}
+
+	// Bake the scene description at the given path, loading each prop's mesh as MeshSource does. Returns false
+	// if the description could not be read
+	static bool bake(char const* path, Batches& baked) {
+		auto description = SceneDescription();
+		if (!SceneDescription::read(path, description)) return false;
+
+		// The triangles of one material in one chunk, with the vertices they use. Vertices are only shared within
+		// a prop, so remap, from the vertices of the prop being baked, is cleared on every new prop
+		struct Batch {
+			std::vector<glm::vec3> vertices;
+			std::vector<glm::vec3> normals;
+			std::vector<glm::vec2> texCoords;
+			std::vector<GLuint> indices;
+			size_t prop;
+			std::unordered_map<GLuint, GLuint> remap;
+
+			Batch() : prop((size_t)-1) {}
+		};
+		// Ordered by material first, so that the batches come out as submeshes in material order
+		auto batches = std::map<std::tuple<std::string, int, int, int>, Batch>();
+		auto chunks = std::set<std::tuple<int, int, int>>();
+		// Material names come from each OBJ's material libraries, so the bake depends on those as well
+		auto sources = std::set<std::string>();
+
+		for (size_t p = 0; p < description.props.size(); p++) {
+			auto& prop = description.props[p];
+			auto source = MeshSource(prop.path.c_str(), STREAMS);
+			auto mesh = source.view();
+			sources.insert(prop.path);
+			sources.insert(source.getMaterialLibraries().begin(), source.getMaterialLibraries().end());
+			auto normalMatrix = glm::transpose(glm::inverse(glm::mat3(prop.model)));
+			for (auto& submesh : mesh.submeshes) {
+				auto& material = prop.texture.empty() ? submesh.textureName : prop.texture;
+				for (auto i = submesh.firstIndex; i < submesh.firstIndex + submesh.indexCount; i += 3) {
+					GLuint corners[3];
+					glm::vec3 positions[3];
+					for (int c = 0; c < 3; c++) {
+						corners[c] = mesh.index(i + c);
+						positions[c] = glm::vec3(prop.model * glm::vec4(mesh.vertices[corners[c]], 1.f));
+					}
+					auto chunk = glm::floor((positions[0] + positions[1] + positions[2]) / 3.f / description.chunkSize);
+					auto chunkKey = std::make_tuple((int)chunk.x, (int)chunk.y, (int)chunk.z);
+					chunks.insert(chunkKey);
+					auto& batch = batches[std::tuple_cat(std::make_tuple(material), chunkKey)];
+					if (batch.prop != p) {
+						batch.prop = p;
+						batch.remap.clear();
+					}
+					for (int c = 0; c < 3; c++) {
+						auto inserted = batch.remap.emplace(corners[c], (GLuint)batch.vertices.size());
+						if (inserted.second) {
+							batch.vertices.push_back(positions[c]);
+							batch.normals.push_back(glm::normalize(normalMatrix * mesh.normals[corners[c]]));
+							batch.texCoords.push_back(mesh.texCoords[corners[c]]);
+						}
+						batch.indices.push_back(inserted.first->second);
+					}
+				}
+			}
+		}
+
+		baked = Batches();
+		auto materials = std::set<std::string>();
+		for (auto& entry : batches) {
+			auto& batch = entry.second;
+			auto baseVertex = (GLuint)baked.vertices.size();
+			auto& material = std::get<0>(entry.first);
+			materials.insert(material);
+			baked.submeshes.push_back(Submesh{ (GLuint)baked.indices.size(), (GLuint)batch.indices.size(), material });
+			baked.vertices.insert(baked.vertices.end(), batch.vertices.begin(), batch.vertices.end());
+			baked.normals.insert(baked.normals.end(), batch.normals.begin(), batch.normals.end());
+			baked.texCoords.insert(baked.texCoords.end(), batch.texCoords.begin(), batch.texCoords.end());
+			for (auto index : batch.indices) { baked.indices.push_back(baseVertex + index); }
+		}
+		computeBounds(baked.vertices, baked.boundsMin, baked.boundsMax);
+		computeBoundingSphere(
+			baked.vertices.data(), baked.vertices.size(), baked.boundsMin, baked.boundsMax, baked.sphereCentre,
+			baked.sphereRadius
+		);
+		baked.propCount = description.props.size();
+		baked.materialCount = materials.size();
+		baked.chunkCount = chunks.size();
+		baked.sources.assign(sources.begin(), sources.end());
+
+		std::cout << path << ":" << std::endl;
+		baked.print(std::cout);
+		return true;
+	}
+};
\ No newline at end of file
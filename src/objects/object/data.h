@@ -1,37 +1,75 @@
 #pragma once
 
+#include <functional>
 #include <iostream>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
 
 #define TINYOBJLOADER_IMPLEMENTATION // define this in only *one* .cc
 #include "../../tiny_obj_loader.h"
+#undef TINYOBJLOADER_IMPLEMENTATION // so that later includes of the header only get the declarations
+#include "../../parallel_obj_loader.h"
 
 struct ObjectData {
+	std::string path;
 	tinyobj::attrib_t attrib;
 	std::vector<tinyobj::shape_t> shapes;
-	tinyobj::material_t material;
+	std::vector<tinyobj::material_t> materials;
 
-	explicit ObjectData(char const* path) {
-		//multiple materials not supported owing to the apparently extreme complexity of doing so
-		std::vector<tinyobj::material_t> materials;
+	explicit ObjectData(char const* path) : path(path) {
 		std::string err;
 		std::string warn;
-		bool ret = tinyobj::LoadObj(&this->attrib, &this->shapes, &materials, &err, &warn, path);
+		bool ret = parallel_obj::load(&this->attrib, &this->shapes, &this->materials, &warn, &err, path);
 		if (!err.empty()) {
 			std::cerr << err << std::endl;
 		}
 		if (!warn.empty()) {
-			std::cerr << err << std::endl;
+			std::cerr << warn << std::endl;
 		}
 		if (!ret) {
 			std::cerr << "fatal error while loading \"" << path << "\", exiting" << std::endl;
 			exit(1);
 		}
-		if (materials.size() == 1) {
-			this->material = std::move(materials[0]);
-		} else if (materials.size() > 1) {
-			std::cerr << "fatal error while loading \"" << path <<
-				"\": At most 1 material is supported. Exiting" << std::endl;
-			exit(1);
-		}
 	}
-};
\ No newline at end of file
+
+	// Diffuse texture of every material, in material order
+	std::vector<std::string> textureNames() const {
+		auto names = std::vector<std::string>();
+		for (auto& material : this->materials) { names.push_back(material.diffuse_texname); }
+		return names;
+	}
+};
+
+// Hashing and comparison for the vertex/normal/texCoord index triplets of a face corner,
+// so that corners referencing the same attributes can be merged into a single vertex
+struct ObjectIndexHash {
+	size_t operator()(tinyobj::index_t const& idx) const {
+		auto hash = std::hash<int>();
+		size_t seed = hash(idx.vertex_index);
+		seed ^= hash(idx.normal_index) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+		seed ^= hash(idx.texcoord_index) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+		return seed;
+	}
+};
+struct ObjectIndexEqual {
+	bool operator()(tinyobj::index_t const& a, tinyobj::index_t const& b) const {
+		return a.vertex_index == b.vertex_index &&
+			a.normal_index == b.normal_index &&
+			a.texcoord_index == b.texcoord_index;
+	}
+};
+
+// Axis-aligned bounding box of a list of positions. Empty lists have an empty box at the origin
+inline void computeBounds(std::vector<glm::vec3> const& positions, glm::vec3& min, glm::vec3& max) {
+	if (positions.empty()) {
+		min = max = glm::vec3(0.f);
+		return;
+	}
+	min = max = positions[0];
+	for (auto& position : positions) {
+		min = glm::min(min, position);
+		max = glm::max(max, position);
+	}
+}
\ No newline at end of file
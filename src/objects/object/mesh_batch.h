@@ -0,0 +1,189 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "../attribute_array.h"
+#include "../gl_state.h"
+#include "../stream_buffer.h"
+#include "../texture/texture_array.h"
+#include "../vertex_array_object.h"
+#include "../vertex_layout.h"
+#include "mesh_cache.h"
+
+// Many meshes suballocated from one vertex buffer and one index buffer, and drawn with indirect draws: every frame,
+// a command per submesh of each placed mesh goes into one buffer, and the data of each draw, its model matrix and
+// texture layer, into another. A command's baseInstance points its single instance at its own draw data, which
+// the vertex shader reads as instanced attributes. Draws sharing a material array then go out in one
+// glMultiDrawElementsIndirect, or in a glDrawElementsIndirect each where that is missing.
+//
+// Meshes are added on the CPU, then uploaded together, as MaterialArrays does with textures. The streams are kept
+// at full precision, as every mesh has to share one vertex format, and meshes are drawn whole, at their full
+// level of detail
+class MeshBatch {
+	typedef VertexLayout<AttributeNormal, AttributeTexCoord> SurfaceLayout;
+
+	struct Range {
+		GLuint firstIndex;	// into the batch's indices
+		GLuint indexCount;
+		texture::MaterialSlot material;
+	};
+	struct Mesh {
+		GLint baseVertex;
+		std::vector<Range> ranges;
+	};
+	// What each draw reads through its instance. The layer sits after the matrix, padded to keep matrices aligned
+	struct DrawData {
+		glm::mat4 model;
+		GLfloat layer;
+		GLfloat padding[3];
+	};
+	// As glDrawElementsIndirect reads it
+	struct DrawCommand {
+		GLuint count;
+		GLuint instanceCount;
+		GLuint firstIndex;
+		GLint baseVertex;
+		GLuint baseInstance;
+	};
+
+	texture::MaterialArrays const* materials;
+	std::vector<Mesh> meshes;
+	// The streams of every mesh added, until upload
+	std::vector<glm::vec3> positionData;
+	std::vector<SurfaceLayout::Vertex> surfaceData;
+	std::vector<GLuint> indexData;
+
+	VertexArray vertices;
+	InterleavedArray surface;
+	IndexArray indices;
+	StreamBuffer drawData;
+	StreamBuffer commands;
+	VertexArrayObject vao;
+	// A frame's commands and draw data, in material array order, kept to reuse their storage every frame
+	std::vector<DrawCommand> frameCommands;
+	std::vector<DrawData> frameData;
+	std::vector<GLuint> arrayStarts;	// first command of each array, and one past the last
+	std::vector<GLuint> arrayNext;	// next command of each array to fill
+
+public:
+	MeshBatch() : materials(nullptr) {}
+
+	// The materials must outlive the batch, and be uploaded before it is drawn
+	explicit MeshBatch(texture::MaterialArrays const& materials) : materials(&materials) {}
+
+	// Add a mesh with full streams, whose textures are already in the materials, with slots holding the texture
+	// of each submesh. Returns the mesh's id, for placing it
+	size_t add(MeshView const& mesh, std::vector<texture::MaterialSlot> const& slots) {
+		auto added = Mesh{ (GLint)this->positionData.size(), {} };
+		this->positionData.insert(this->positionData.end(), mesh.vertices, mesh.vertices + mesh.vertexCount);
+		auto surface = SurfaceLayout::interleave(mesh.vertexCount, mesh.normals, mesh.texCoords);
+		this->surfaceData.insert(this->surfaceData.end(), surface.begin(), surface.end());
+
+		auto firstIndex = (GLuint)this->indexData.size();
+		if (mesh.indexType == GL_UNSIGNED_SHORT) {
+			auto shorts = (GLushort const*)mesh.indices;
+			this->indexData.insert(this->indexData.end(), shorts, shorts + mesh.indexCount);
+		} else {
+			auto ints = (GLuint const*)mesh.indices;
+			this->indexData.insert(this->indexData.end(), ints, ints + mesh.indexCount);
+		}
+		for (size_t i = 0; i < mesh.submeshes.size(); i++) {
+			auto& submesh = mesh.submeshes[i];
+			added.ranges.push_back(Range{ firstIndex + submesh.firstIndex, submesh.indexCount, slots[i] });
+		}
+		this->meshes.push_back(std::move(added));
+		return this->meshes.size() - 1;
+	}
+
+	// Upload every mesh added so far, and free the CPU copies. Indices stay relative to their mesh, with the
+	// mesh's base vertex added by the draws, so they keep to 16 bits whenever each mesh does
+	void upload() {
+		this->vertices = VertexArray(this->positionData);
+		this->surface = InterleavedArray::of<SurfaceLayout>(this->surfaceData);
+		this->indices = IndexArray(this->indexData);
+		this->drawData = StreamBuffer(GL_ARRAY_BUFFER);
+		this->commands = StreamBuffer(GL_DRAW_INDIRECT_BUFFER);
+		this->vao = VertexArrayObject([this] {
+			this->vertices.bind();
+			this->surface.bind();
+			this->indices.bind();
+			this->drawData.bind(GL_ARRAY_BUFFER);
+			InstanceArray::pointModels(sizeof(DrawData), offsetof(DrawData, model));
+			typedef AttributeMaterialLayer Layer;
+			glEnableVertexAttribArray(Layer::ATTRIBUTE);
+			glVertexAttribPointer(
+				Layer::ATTRIBUTE, Layer::SIZE, Layer::TYPE, Layer::NORMALIZED, sizeof(DrawData),
+				(void const*)offsetof(DrawData, layer)
+			);
+			glVertexAttribDivisor(Layer::ATTRIBUTE, 1);
+		});
+		this->positionData = std::vector<glm::vec3>();
+		this->surfaceData = std::vector<SurfaceLayout::Vertex>();
+		this->indexData = std::vector<GLuint>();
+	}
+
+	// A mesh of the batch, and where to draw it
+	struct Placement {
+		size_t mesh;
+		glm::mat4 model;
+	};
+
+	// Draw every placement, with a multi-draw per material array. The program must take its model matrices per
+	// instance, as ObjectProgram::setBatched sets it up
+	void draw(int drawMode, std::vector<Placement> const& placements) {
+		auto arrayCount = this->materials->getArrayCount();
+		this->arrayStarts.assign(arrayCount + 1, 0);
+		for (auto& placement : placements) {
+			for (auto& range : this->meshes[placement.mesh].ranges) { this->arrayStarts[range.material.array + 1]++; }
+		}
+		for (GLuint array = 0; array < arrayCount; array++) {
+			this->arrayStarts[array + 1] += this->arrayStarts[array];
+		}
+
+		auto drawCount = this->arrayStarts.back();
+		this->frameCommands.resize(drawCount);
+		this->frameData.resize(drawCount);
+		this->arrayNext.assign(this->arrayStarts.begin(), this->arrayStarts.end() - 1);
+		for (auto& placement : placements) {
+			auto& mesh = this->meshes[placement.mesh];
+			for (auto& range : mesh.ranges) {
+				auto draw = this->arrayNext[range.material.array]++;
+				this->frameCommands[draw] = DrawCommand{ range.indexCount, 1, range.firstIndex, mesh.baseVertex, draw };
+				this->frameData[draw] = DrawData{ placement.model, (GLfloat)range.material.layer, { 0.f, 0.f, 0.f } };
+			}
+		}
+		if (drawCount == 0) return;
+		this->drawData.upload(this->frameData.data(), drawCount * sizeof(DrawData));
+		this->commands.upload(this->frameCommands.data(), drawCount * sizeof(DrawCommand));
+
+		this->vao.bind();
+		// Points are the vertices of the triangles rather than of the meshes, so shared ones are drawn again
+		gl_state::pointSize(3.f);
+		gl_state::polygonMode(drawMode == 1 ? GL_LINE : drawMode == 2 ? GL_POINT : GL_FILL);
+		auto type = this->indices.getType();
+		for (GLuint array = 0; array < arrayCount; array++) {
+			auto first = this->arrayStarts[array];
+			auto count = this->arrayStarts[array + 1] - first;
+			if (count == 0) continue;
+			// The layer comes from the draw data, so binding any slot of the array does
+			this->materials->bind(texture::MaterialSlot{ array, 0 });
+			if (GLAD_GL_VERSION_4_3) {
+				glMultiDrawElementsIndirect(
+					GL_TRIANGLES, type, (void const*)(first * sizeof(DrawCommand)), (GLsizei)count, 0
+				);
+			} else {
+				for (auto command = first; command < first + count; command++) {
+					glDrawElementsIndirect(GL_TRIANGLES, type, (void const*)(command * sizeof(DrawCommand)));
+				}
+			}
+		}
+	}
+
+	size_t getMeshCount() const {
+		return this->meshes.size();
+	}
+};
\ No newline at end of file
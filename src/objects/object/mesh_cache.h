@@ -0,0 +1,401 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "../../mapped_file.h"
+
+// A contiguous range of a mesh's indices whose triangles share a material
+struct Submesh {
+	GLuint firstIndex;
+	GLuint indexCount;
+	std::string textureName;	// the material's diffuse texture, empty for triangles without a material
+};
+
+// Reorder the triangles of a mesh so that those sharing a material are contiguous, in material order, and return
+// the resulting submeshes. triangleMaterials holds the material of each triangle, or -1 for none, and
+// textureNames the diffuse texture of each material
+inline std::vector<Submesh> groupByMaterial(
+	GLuint* indices, size_t indexCount, int const* triangleMaterials, std::vector<std::string> const& textureNames
+) {
+	// Counting sort into one bucket per material, after a first bucket for triangles without a valid material.
+	// As when only one material was supported, triangles before any usemtl take the only material there is
+	auto triangleCount = indexCount / 3;
+	auto bucketOf = [&](size_t triangle) -> size_t {
+		auto material = triangleMaterials[triangle];
+		if (material < 0 && textureNames.size() == 1) return 1;
+		return material < 0 || material >= (int)textureNames.size() ? 0 : material + 1;
+	};
+	auto starts = std::vector<size_t>(textureNames.size() + 2, 0);
+	for (size_t t = 0; t < triangleCount; t++) { starts[bucketOf(t) + 1]++; }
+	for (size_t b = 1; b < starts.size(); b++) { starts[b] += starts[b - 1]; }
+
+	size_t usedCount = 0;
+	for (size_t b = 0; b + 1 < starts.size(); b++) { usedCount += starts[b + 1] != starts[b]; }
+	if (usedCount > 1) {
+		auto sorted = std::vector<GLuint>(indexCount);
+		auto next = starts;
+		for (size_t t = 0; t < triangleCount; t++) {
+			std::copy(indices + 3 * t, indices + 3 * t + 3, &sorted[3 * next[bucketOf(t)]++]);
+		}
+		std::copy(sorted.begin(), sorted.end(), indices);
+	}
+
+	auto submeshes = std::vector<Submesh>();
+	for (size_t b = 0; b + 1 < starts.size(); b++) {
+		if (starts[b + 1] == starts[b]) continue;
+		submeshes.push_back(Submesh{
+			(GLuint)(3 * starts[b]), (GLuint)(3 * (starts[b + 1] - starts[b])), b == 0 ? "" : textureNames[b - 1]
+		});
+	}
+	return submeshes;
+}
+
+// The sphere centred on a mesh's bounding box that holds every one of its positions. Not the smallest sphere there
+// is, but one culling can test alongside the box, as both share a centre
+inline void computeBoundingSphere(
+	glm::vec3 const* positions, size_t count, glm::vec3 boundsMin, glm::vec3 boundsMax, glm::vec3& centre, float& radius
+) {
+	centre = (boundsMin + boundsMax) / 2.f;
+	radius = 0.f;
+	for (size_t i = 0; i < count; i++) { radius = std::max(radius, glm::length(positions[i] - centre)); }
+}
+
+// Non-owning view of the final vertex and index streams of a mesh, ready to be uploaded.
+// Streams that a mesh does not have are null
+struct MeshView {
+	glm::vec3 const* vertices;
+	glm::vec3 const* normals;
+	glm::vec2 const* texCoords;
+	GLuint vertexCount;
+	void const* indices;
+	GLenum indexType;
+	GLuint indexCount;
+	glm::vec3 boundsMin;
+	glm::vec3 boundsMax;
+	glm::vec3 sphereCentre;	// of a sphere holding every vertex, as computeBoundingSphere finds it
+	float sphereRadius;
+	std::vector<Submesh> submeshes;	// covering every index, in material order
+
+	MeshView() :
+		vertices(nullptr), normals(nullptr), texCoords(nullptr), vertexCount(0),
+		indices(nullptr), indexType(GL_UNSIGNED_INT), indexCount(0),
+		boundsMin(0.f), boundsMax(0.f), sphereCentre(0.f), sphereRadius(0.f)
+	{}
+
+	// The index at position i, whichever type the indices are stored as
+	GLuint index(GLuint i) const {
+		if (this->indexType == GL_UNSIGNED_SHORT) return ((GLushort const*)this->indices)[i];
+		return ((GLuint const*)this->indices)[i];
+	}
+};
+
+// A binary copy of a mesh's final streams, stored next to the OBJ it was built from so later runs can
+// memory-map it instead of parsing the OBJ again. The streams are used straight from the mapping,
+// so the cache must outlive any view taken from it. Other files the mesh was built from, such as the OBJs of
+// the props a scene's bake merges, can be recorded as dependencies, and are checked as the source is
+class MeshCache {
+	// Bumped whenever the layout below changes, so that old caches are rebuilt rather than misread
+	static const uint32_t VERSION = 5;
+	static const uint32_t MAGIC = 0x4853454d; // "MESH"
+
+	// A file as it was when the cache was written
+	struct SourceStamp {
+		uint64_t size;
+		int64_t modified;
+		uint64_t hash;
+	};
+
+	struct Header {
+		uint32_t magic;
+		uint32_t version;
+		uint32_t streams;
+		uint32_t indexType;
+		uint32_t vertexCount;
+		uint32_t indexCount;
+		uint32_t submeshCount;
+		uint32_t textureNamesLength;
+		uint32_t dependencyCount;
+		uint32_t dependencyPathsLength;
+		SourceStamp source;
+		float boundsMin[3];
+		float boundsMax[3];
+		float sphere[4];	// centre and radius
+	};
+
+	// Followed by the texture names of every submesh, back to back
+	struct SubmeshRecord {
+		uint32_t firstIndex;
+		uint32_t indexCount;
+		uint32_t textureNameLength;
+	};
+
+	// After the texture names, unaligned, and followed by the paths of every dependency, back to back
+	struct DependencyRecord {
+		SourceStamp stamp;
+		uint32_t pathLength;
+		uint32_t padding;
+	};
+
+	MappedFile file;
+	MeshView view;
+	std::vector<std::string> dependencies;
+
+public:
+	// Bit flags for the optional streams stored in a cache
+	static const uint32_t NORMALS = 1;
+	static const uint32_t TEX_COORDS = 2;
+
+	// An invalid cache
+	MeshCache() {}
+
+	// Map the cache of the OBJ at sourcePath. The cache is invalid if it is missing, was written by a
+	// different version, holds different streams, or if the contents of the OBJ or of any of its dependencies
+	// changed since it was written
+	MeshCache(char const* sourcePath, char const* cachePath, uint32_t streams) : file(cachePath) {
+		if (!this->file.isValid() || this->file.getSize() < sizeof(Header)) {
+			this->file = MappedFile();
+			return;
+		}
+		auto header = (Header const*)this->file.getBytes();
+		FileStamp stamp;
+		if (header->magic != MAGIC || header->version != VERSION || header->streams != streams ||
+			this->file.getSize() != fileSize(*header) || !isFresh(header->source, sourcePath, stamp)
+		) {
+			this->file = MappedFile();
+			return;
+		}
+		// Where the modification times of touched files are stored, and their new times
+		auto restamps = std::vector<std::pair<size_t, int64_t>>();
+		auto modifiedOffset = offsetof(SourceStamp, modified);
+		if (stamp.modified != header->source.modified) {
+			restamps.push_back(std::make_pair(offsetof(Header, source) + modifiedOffset, stamp.modified));
+		}
+		auto recordOffset = dependenciesOffset(*header);
+		auto paths = (char const*)this->file.getBytes() + recordOffset;
+		paths += header->dependencyCount * sizeof(DependencyRecord);
+		auto pathsEnd = (char const*)this->file.getBytes() + this->file.getSize();
+		auto dependencies = std::vector<std::string>();
+		for (uint32_t i = 0; i < header->dependencyCount; i++, recordOffset += sizeof(DependencyRecord)) {
+			DependencyRecord record;
+			memcpy(&record, this->file.getBytes() + recordOffset, sizeof(record));
+			if (record.pathLength > (size_t)(pathsEnd - paths)) {
+				this->file = MappedFile();
+				return;
+			}
+			auto path = std::string(paths, record.pathLength);
+			paths += record.pathLength;
+			if (!isFresh(record.stamp, path.c_str(), stamp)) {
+				this->file = MappedFile();
+				return;
+			}
+			if (stamp.modified != record.stamp.modified) {
+				restamps.push_back(std::make_pair(
+					recordOffset + offsetof(DependencyRecord, stamp) + modifiedOffset, stamp.modified
+				));
+			}
+			dependencies.push_back(std::move(path));
+		}
+		if (!restamps.empty()) {
+			// Files were only touched, so record their new times, or every later run would hash them again. The
+			// mapping is read-only, and on Windows keeps the file from being written, so it is let go of meanwhile
+			auto size = this->file.getSize();
+			this->file = MappedFile();
+			restamp(cachePath, restamps);
+			this->file = MappedFile(cachePath);
+			if (this->file.getSize() != size) {
+				this->file = MappedFile();
+				return;
+			}
+			header = (Header const*)this->file.getBytes();
+		}
+		this->dependencies = std::move(dependencies);
+
+		auto bytes = this->file.getBytes() + sizeof(Header);
+		this->view.vertexCount = header->vertexCount;
+		this->view.vertices = (glm::vec3 const*)bytes;
+		bytes += header->vertexCount * sizeof(glm::vec3);
+		if (streams & NORMALS) {
+			this->view.normals = (glm::vec3 const*)bytes;
+			bytes += header->vertexCount * sizeof(glm::vec3);
+		}
+		if (streams & TEX_COORDS) {
+			this->view.texCoords = (glm::vec2 const*)bytes;
+			bytes += header->vertexCount * sizeof(glm::vec2);
+		}
+		this->view.indices = bytes;
+		this->view.indexType = header->indexType;
+		this->view.indexCount = header->indexCount;
+		bytes += align(header->indexCount * indexSize(header->indexType));
+		auto records = (SubmeshRecord const*)bytes;
+		auto names = (char const*)(records + header->submeshCount);
+		for (uint32_t i = 0; i < header->submeshCount; i++) {
+			this->view.submeshes.push_back(Submesh{
+				records[i].firstIndex, records[i].indexCount, std::string(names, records[i].textureNameLength)
+			});
+			names += records[i].textureNameLength;
+		}
+		this->view.boundsMin = glm::vec3(header->boundsMin[0], header->boundsMin[1], header->boundsMin[2]);
+		this->view.boundsMax = glm::vec3(header->boundsMax[0], header->boundsMax[1], header->boundsMax[2]);
+		this->view.sphereCentre = glm::vec3(header->sphere[0], header->sphere[1], header->sphere[2]);
+		this->view.sphereRadius = header->sphere[3];
+	}
+
+	MeshCache(MeshCache const&) = delete;
+	MeshCache& operator=(MeshCache const&) = delete;
+	// Moving the mapping does not move the mapped memory, so the view stays valid
+	MeshCache(MeshCache&&) noexcept = default;
+	MeshCache& operator=(MeshCache&&) noexcept = default;
+
+	bool isValid() const {
+		return this->file.isValid();
+	}
+
+	MeshView const& getView() const {
+		return this->view;
+	}
+
+	// Paths of the files besides the source that the cache was written from
+	std::vector<std::string> const& getDependencies() const {
+		return this->dependencies;
+	}
+
+	// Write the cache for the OBJ at sourcePath, which also depends on the files at the given paths. 32-bit
+	// indices are narrowed to 16 bits when they fit, so that they can be uploaded as they are when the cache is
+	// loaded. Failing to write the cache is not fatal, as the OBJ can still be parsed next time
+	static void write(
+		char const* sourcePath, char const* cachePath, MeshView const& mesh, uint32_t streams,
+		std::vector<std::string> const& dependencies = std::vector<std::string>()
+	) {
+		Header header = {};
+		if (!stampOf(sourcePath, header.source)) return;
+		auto records = std::vector<DependencyRecord>(dependencies.size());
+		for (size_t i = 0; i < dependencies.size(); i++) {
+			if (!stampOf(dependencies[i].c_str(), records[i].stamp)) return;
+			records[i].pathLength = (uint32_t)dependencies[i].size();
+			header.dependencyPathsLength += records[i].pathLength;
+		}
+
+		auto indices = std::vector<unsigned char>();
+		auto indexType = mesh.indexType;
+		if (indexType == GL_UNSIGNED_INT) {
+			auto wide = (GLuint const*)mesh.indices;
+			auto fits = true;
+			for (GLuint i = 0; i < mesh.indexCount && fits; i++) { fits = wide[i] <= 0xFFFF; }
+			if (fits) {
+				indexType = GL_UNSIGNED_SHORT;
+				indices.resize(mesh.indexCount * sizeof(GLushort));
+				auto narrow = (GLushort*)indices.data();
+				for (GLuint i = 0; i < mesh.indexCount; i++) { narrow[i] = (GLushort)wide[i]; }
+			}
+		}
+		if (indices.empty()) {
+			auto bytes = (unsigned char const*)mesh.indices;
+			indices.assign(bytes, bytes + mesh.indexCount * indexSize(indexType));
+		}
+
+		header.magic = MAGIC;
+		header.version = VERSION;
+		header.streams = streams;
+		header.indexType = indexType;
+		header.vertexCount = mesh.vertexCount;
+		header.indexCount = mesh.indexCount;
+		header.submeshCount = (uint32_t)mesh.submeshes.size();
+		for (auto& submesh : mesh.submeshes) { header.textureNamesLength += (uint32_t)submesh.textureName.size(); }
+		header.dependencyCount = (uint32_t)dependencies.size();
+		for (int i = 0; i < 3; i++) {
+			header.boundsMin[i] = mesh.boundsMin[i];
+			header.boundsMax[i] = mesh.boundsMax[i];
+			header.sphere[i] = mesh.sphereCentre[i];
+		}
+		header.sphere[3] = mesh.sphereRadius;
+
+		auto out = std::ofstream(cachePath, std::ios::binary | std::ios::trunc);
+		if (!out.is_open()) {
+			std::cerr << "Could not write mesh cache \"" << cachePath << "\"" << std::endl;
+			return;
+		}
+		out.write((char const*)&header, sizeof(Header));
+		out.write((char const*)mesh.vertices, mesh.vertexCount * sizeof(glm::vec3));
+		if (streams & NORMALS) { out.write((char const*)mesh.normals, mesh.vertexCount * sizeof(glm::vec3)); }
+		if (streams & TEX_COORDS) { out.write((char const*)mesh.texCoords, mesh.vertexCount * sizeof(glm::vec2)); }
+		out.write((char const*)indices.data(), indices.size());
+		char const padding[4] = {};
+		out.write(padding, align(indices.size()) - indices.size());
+		for (auto& submesh : mesh.submeshes) {
+			auto record = SubmeshRecord{ submesh.firstIndex, submesh.indexCount, (uint32_t)submesh.textureName.size() };
+			out.write((char const*)&record, sizeof(record));
+		}
+		for (auto& submesh : mesh.submeshes) { out.write(submesh.textureName.data(), submesh.textureName.size()); }
+		out.write((char const*)records.data(), records.size() * sizeof(DependencyRecord));
+		for (auto& path : dependencies) { out.write(path.data(), path.size()); }
+	}
+
+private:
+	static size_t indexSize(uint32_t indexType) {
+		return indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+	}
+
+	// Keeps the streams following the indices 4-byte aligned
+	static size_t align(size_t size) {
+		return (size + 3) & ~(size_t)3;
+	}
+
+	// Where the dependency records start
+	static size_t dependenciesOffset(Header const& header) {
+		size_t vertexSize = sizeof(glm::vec3);
+		if (header.streams & NORMALS) vertexSize += sizeof(glm::vec3);
+		if (header.streams & TEX_COORDS) vertexSize += sizeof(glm::vec2);
+		return sizeof(Header) + header.vertexCount * vertexSize +
+			align(header.indexCount * indexSize(header.indexType)) +
+			header.submeshCount * sizeof(SubmeshRecord) + header.textureNamesLength;
+	}
+
+	static size_t fileSize(Header const& header) {
+		return dependenciesOffset(header) + header.dependencyCount * sizeof(DependencyRecord) +
+			header.dependencyPathsLength;
+	}
+
+	// Returns false if the file cannot be read
+	static bool stampOf(char const* path, SourceStamp& stamp) {
+		auto file = MappedFile(path);
+		FileStamp current;
+		if (!file.isValid() || !FileStamp::of(path, current)) return false;
+		stamp.size = current.size;
+		stamp.modified = current.modified;
+		stamp.hash = file.hash();
+		return true;
+	}
+
+	// A matching size and modification time means a file is unchanged. Otherwise, fall back to hashing
+	// it, so that merely touching or checking out the OBJ again does not throw the cache away.
+	// current is set to the file's current stamp
+	static bool isFresh(SourceStamp const& stamp, char const* path, FileStamp& current) {
+		if (!FileStamp::of(path, current)) return false;
+		if (current.size != stamp.size) return false;
+		if (current.modified == stamp.modified) return true;
+		auto file = MappedFile(path);
+		return file.isValid() && file.hash() == stamp.hash;
+	}
+
+	// Overwrite the modification times stored at the given offsets of the cache at cachePath. Failing is not
+	// fatal, as the files are only hashed again next time
+	static void restamp(char const* cachePath, std::vector<std::pair<size_t, int64_t>> const& restamps) {
+		auto out = std::fstream(cachePath, std::ios::binary | std::ios::in | std::ios::out);
+		if (!out.is_open()) return;
+		for (auto& entry : restamps) {
+			out.seekp((std::streamoff)entry.first);
+			out.write((char const*)&entry.second, sizeof(entry.second));
+		}
+	}
+};
@@ -0,0 +1,155 @@
+#pragma once
+
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "mesh_cache.h"
+#include "mesh_optimizer.h"
+#include "mesh_simplifier.h"
+#include "meshlets.h"
+
+// A chain of levels of detail of a mesh, each simplified from the one before it down to a fraction of the
+// triangles of the full mesh. Every level indexes the same vertices, and has the same submeshes in the same order,
+// so the levels' indices go one after the other in a single index buffer, split into meshlets for culling.
+// Building one makes no OpenGL calls
+class MeshLods {
+public:
+	struct Level {
+		std::vector<Submesh> submeshes;	// into indices, parallel to the mesh's own
+		GLuint triangleCount;
+		float error;	// bound on how far the level strays from the full mesh, relative to radius
+		std::vector<std::vector<Meshlet>> meshlets;	// of each submesh
+	};
+
+	// Fraction of the full mesh's triangles each level after the first aims for
+	static std::vector<float> defaultRatios() {
+		return { 0.5f, 0.25f, 0.125f, 0.0625f };
+	}
+
+	// Largest error of a level, relative to radius, past which simplification stops
+	static constexpr float MAX_ERROR = 0.2f;
+	// A level that removes less than this fraction of the triangles of the one before it ends the chain
+	static constexpr float MIN_REDUCTION = 0.15f;
+
+	std::vector<GLuint> indices;
+	std::vector<Level> levels;	// level 0 is the full mesh
+	glm::vec3 centre;	// of the bounding sphere
+	float radius;
+
+	explicit MeshLods(MeshView const& mesh, std::vector<float> const& ratios = defaultRatios()) :
+		centre(mesh.sphereCentre), radius(mesh.sphereRadius == 0.f ? 1.f : mesh.sphereRadius)
+	{
+
+		if (mesh.indexType == GL_UNSIGNED_SHORT) {
+			auto shorts = (GLushort const*)mesh.indices;
+			this->indices.assign(shorts, shorts + mesh.indexCount);
+		} else {
+			auto ints = (GLuint const*)mesh.indices;
+			this->indices.assign(ints, ints + mesh.indexCount);
+		}
+		this->levels.push_back(Level{ mesh.submeshes, mesh.indexCount / 3, 0.f, {} });
+
+		for (auto ratio : ratios) {
+			auto& previous = this->levels.back();
+			auto level = Level{ {}, 0, previous.error, {} };
+			auto end = this->indices.size();
+			float stepError = 0.f;
+			for (size_t i = 0; i < previous.submeshes.size(); i++) {
+				auto& from = previous.submeshes[i];
+				auto simplified = std::vector<GLuint>(
+					this->indices.begin() + from.firstIndex, this->indices.begin() + from.firstIndex + from.indexCount
+				);
+				auto target = (size_t)(mesh.submeshes[i].indexCount / 3 * ratio) * 3;
+				float error = 0.f;
+				auto count = mesh_simplifier::simplify(
+					simplified.data(), simplified.size(), mesh.vertices, mesh.normals, mesh.vertexCount,
+					target, this->radius, MAX_ERROR, &error
+				);
+				mesh_optimizer::optimizeVertexCache(simplified.data(), count, mesh.vertexCount);
+				level.submeshes.push_back(Submesh{ (GLuint)this->indices.size(), (GLuint)count, from.textureName });
+				this->indices.insert(this->indices.end(), simplified.begin(), simplified.begin() + count);
+				level.triangleCount += (GLuint)count / 3;
+				stepError = std::max(stepError, error);
+			}
+			// Each level is simplified from the one before, so errors add up along the chain
+			level.error += stepError;
+			if (level.triangleCount > previous.triangleCount * (1.f - MIN_REDUCTION)) {
+				this->indices.resize(end);
+				break;
+			}
+			this->levels.push_back(std::move(level));
+		}
+
+		for (auto& level : this->levels) {
+			for (auto& submesh : level.submeshes) {
+				level.meshlets.push_back(buildMeshlets(
+					this->indices.data(), submesh.firstIndex, submesh.indexCount, mesh.vertices, mesh.vertexCount
+				));
+			}
+		}
+	}
+
+	void print(std::ostream& out) const {
+		out << "  LODs:";
+		for (auto& level : this->levels) { out << " " << level.triangleCount; }
+		out << " triangles, error";
+		for (auto& level : this->levels) { out << " " << level.error; }
+		out << " of radius " << this->radius << ", meshlets";
+		for (auto& level : this->levels) {
+			size_t count = 0;
+			for (auto& meshlets : level.meshlets) { count += meshlets.size(); }
+			out << " " << count;
+		}
+		out << std::endl;
+	}
+};
+
+// Picks the level of detail to draw a MeshLods at from how many pixels its error would cover on screen: the
+// coarsest level whose error, projected at the distance of the bounding sphere, stays under PIXEL_ERROR.
+// The choice only moves once the projected error is a margin past the threshold, so that an object sitting near
+// a switching distance does not pop back and forth between levels
+class LodSelection {
+	std::vector<float> errors;
+	glm::vec3 centre;
+	float radius;
+	size_t level;
+
+public:
+	static constexpr float PIXEL_ERROR = 1.f;
+	static constexpr float HYSTERESIS = 0.25f;	// fraction of PIXEL_ERROR
+
+	LodSelection() : centre(0.f), radius(0.f), level(0) {}
+
+	explicit LodSelection(MeshLods const& lods) : centre(lods.centre), radius(lods.radius), level(0) {
+		for (auto& level : lods.levels) { this->errors.push_back(level.error); }
+	}
+
+	// projectionScale is the number of pixels a unit covers at a distance of 1, i.e.
+	// viewportHeight / (2 * tan(fovY / 2)). Returns the level to draw
+	size_t select(glm::mat4 const& model, glm::vec3 cameraPosition, float projectionScale) {
+		auto centre = glm::vec3(model * glm::vec4(this->centre, 1.f));
+		auto scale = std::max(
+			glm::length(glm::vec3(model[0])), std::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2])))
+		);
+		auto radius = this->radius * scale;
+		auto distance = glm::length(centre - cameraPosition) - radius;
+		if (distance <= 0.f) { return this->level = 0; }
+
+		auto projectedRadius = radius / distance * projectionScale;
+		auto pixels = [&](size_t level) { return this->errors[level] * projectedRadius; };
+		while (this->level + 1 < this->errors.size() && pixels(this->level + 1) <= PIXEL_ERROR * (1.f - HYSTERESIS)) {
+			this->level++;
+		}
+		while (this->level > 0 && pixels(this->level) > PIXEL_ERROR * (1.f + HYSTERESIS)) { this->level--; }
+		return this->level;
+	}
+
+	size_t getLevel() const {
+		return this->level;
+	}
+};
\ No newline at end of file
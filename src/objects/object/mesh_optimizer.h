@@ -0,0 +1,304 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "mesh_cache.h"
+
+// Reordering of indexed meshes for the GPU, done once when a mesh is built and then kept in its cache:
+//  - triangles within each submesh for the post-transform vertex cache, after Forsyth's linear-speed
+//    vertex cache optimisation
+//  - clusters of those triangles for overdraw, outward-facing clusters first, cutting only where the cache
+//    had to start over anyway
+//  - vertices in the order the triangles first use them, for vertex fetch
+// Caches are simulated on the CPU, so the results can be checked without a GPU
+namespace mesh_optimizer {
+
+	// A post-transform cache of size vertices. FIFO caches evict the oldest vertex to enter, LRU caches the one
+	// used least recently
+	struct CacheModel {
+		enum Kind { FIFO, LRU };
+		Kind kind;
+		size_t size;
+	};
+
+	inline CacheModel defaultCacheModel() {
+		return CacheModel{ CacheModel::FIFO, 16 };
+	}
+
+	// ACMR: vertices transformed per triangle, from 3 with no reuse down to about 0.5 for a regular grid.
+	// ATVR: vertices transformed per vertex, 1 when each is transformed only once
+	struct CacheStats {
+		double acmr;
+		double atvr;
+	};
+
+	// Simulate the cache on the given triangles. misses, if given, receives the number of vertices each
+	// triangle transformed
+	inline CacheStats simulateCache(
+		GLuint const* indices, size_t indexCount, size_t vertexCount, CacheModel model, std::vector<int>* misses = nullptr
+	) {
+		size_t transformed = 0;
+		auto used = std::vector<bool>(vertexCount, false);
+		size_t usedCount = 0;
+		if (misses) misses->assign(indexCount / 3, 0);
+
+		// FIFO: a vertex is still cached if fewer than size vertices have entered since it did
+		auto entered = std::vector<size_t>(vertexCount, 0);
+		size_t clock = model.size + 1;
+		// LRU: most recent first
+		auto lru = std::vector<GLuint>();
+		lru.reserve(model.size + 1);
+
+		for (size_t i = 0; i < indexCount; i++) {
+			auto vertex = indices[i];
+			bool hit;
+			if (model.kind == CacheModel::FIFO) {
+				hit = clock - entered[vertex] <= model.size;
+				if (!hit) entered[vertex] = clock++;
+			} else {
+				auto found = std::find(lru.begin(), lru.end(), vertex);
+				hit = found != lru.end();
+				if (hit) lru.erase(found);
+				lru.insert(lru.begin(), vertex);
+				if (lru.size() > model.size) lru.pop_back();
+			}
+			if (!hit) {
+				transformed++;
+				if (misses) (*misses)[i / 3]++;
+			}
+			if (!used[vertex]) {
+				used[vertex] = true;
+				usedCount++;
+			}
+		}
+		auto triangleCount = indexCount / 3;
+		return CacheStats{
+			triangleCount ? (double)transformed / triangleCount : 0.0, usedCount ? (double)transformed / usedCount : 0.0
+		};
+	}
+
+	// Forsyth's scoring, modelling a 32-vertex LRU cache: vertices of the last triangle score a flat 0.75 so that
+	// strips do not run away, older ones less the deeper they are, and vertices with few triangles left get a
+	// boost so that none are left stranded
+	namespace forsyth {
+		const int CACHE_SIZE = 32;
+
+		inline float vertexScore(int cachePosition, int remaining) {
+			if (remaining == 0) return -1.f;
+			float score = 0.f;
+			if (cachePosition >= 0) {
+				if (cachePosition < 3) { score = 0.75f; }
+				else { score = std::pow(1.f - (float)(cachePosition - 3) / (CACHE_SIZE - 3), 1.5f); }
+			}
+			return score + 2.f / std::sqrt((float)remaining);
+		}
+	}
+
+	// Reorder triangles for the post-transform cache
+	inline void optimizeVertexCache(GLuint* indices, size_t indexCount, size_t vertexCount) {
+		auto triangleCount = indexCount / 3;
+		if (triangleCount == 0) return;
+
+		// Triangles of each vertex, as offsets into one shared list. remaining counts those not yet emitted,
+		// which are kept at the front of each vertex's run
+		auto remaining = std::vector<int>(vertexCount, 0);
+		for (size_t i = 0; i < indexCount; i++) { remaining[indices[i]]++; }
+		auto offsets = std::vector<size_t>(vertexCount + 1, 0);
+		for (size_t v = 0; v < vertexCount; v++) { offsets[v + 1] = offsets[v] + remaining[v]; }
+		auto triangles = std::vector<GLuint>(indexCount);
+		{
+			auto fill = std::vector<size_t>(offsets.begin(), offsets.end() - 1);
+			for (size_t i = 0; i < indexCount; i++) { triangles[fill[indices[i]]++] = (GLuint)(i / 3); }
+		}
+
+		auto cachePosition = std::vector<int>(vertexCount, -1);
+		auto vertexScores = std::vector<float>(vertexCount);
+		for (size_t v = 0; v < vertexCount; v++) { vertexScores[v] = forsyth::vertexScore(-1, remaining[v]); }
+		auto emitted = std::vector<bool>(triangleCount, false);
+
+		auto cache = std::vector<GLuint>();
+		auto nextCache = std::vector<GLuint>();
+		auto output = std::vector<GLuint>(indexCount);
+		size_t outputCount = 0;
+		size_t nextUnemitted = 0;
+		auto best = (size_t)-1;
+
+		while (outputCount < indexCount) {
+			// With nothing in the cache left to build on, start again from the first triangle not yet emitted
+			if (best == (size_t)-1) {
+				while (emitted[nextUnemitted]) nextUnemitted++;
+				best = nextUnemitted;
+			}
+			auto triangle = &indices[3 * best];
+			std::copy(triangle, triangle + 3, &output[outputCount]);
+			outputCount += 3;
+			emitted[best] = true;
+
+			// Move the triangle out of its vertices' remaining runs
+			for (int c = 0; c < 3; c++) {
+				auto vertex = triangle[c];
+				auto run = &triangles[offsets[vertex]];
+				auto position = std::find(run, run + remaining[vertex], (GLuint)best) - run;
+				std::swap(run[position], run[remaining[vertex] - 1]);
+				remaining[vertex]--;
+			}
+
+			// The triangle's vertices go to the front of the cache; vertices pushed past its end are evicted,
+			// but kept until their scores have been updated
+			nextCache.assign(triangle, triangle + 3);
+			for (auto vertex : cache) {
+				if (vertex != triangle[0] && vertex != triangle[1] && vertex != triangle[2]) nextCache.push_back(vertex);
+			}
+			for (size_t i = 0; i < nextCache.size(); i++) {
+				auto vertex = nextCache[i];
+				cachePosition[vertex] = i < (size_t)forsyth::CACHE_SIZE ? (int)i : -1;
+				vertexScores[vertex] = forsyth::vertexScore(cachePosition[vertex], remaining[vertex]);
+			}
+
+			// Only triangles of cached vertices changed score, so the next triangle is the best of those
+			best = (size_t)-1;
+			float bestScore = -1.f;
+			for (auto vertex : nextCache) {
+				for (int i = 0; i < remaining[vertex]; i++) {
+					auto t = triangles[offsets[vertex] + i];
+					auto score = vertexScores[indices[3 * t]] + vertexScores[indices[3 * t + 1]] +
+						vertexScores[indices[3 * t + 2]];
+					if (score > bestScore) {
+						bestScore = score;
+						best = t;
+					}
+				}
+			}
+			if (nextCache.size() > (size_t)forsyth::CACHE_SIZE) nextCache.resize(forsyth::CACHE_SIZE);
+			std::swap(cache, nextCache);
+		}
+		std::copy(output.begin(), output.end(), indices);
+	}
+
+	// Reorder clusters of triangles so that those facing away from the centre of the mesh come first, and so
+	// are drawn before the triangles they hide. Triangles are only cut into clusters where the cache simulation
+	// misses on all three vertices, so reordering clusters costs little in the cache; if it still costs more
+	// than threshold times the ACMR, the order is left as it was
+	inline void optimizeOverdraw(
+		GLuint* indices, size_t indexCount, glm::vec3 const* positions, size_t vertexCount, float threshold = 1.05f
+	) {
+		auto triangleCount = indexCount / 3;
+		if (triangleCount == 0) return;
+		auto model = defaultCacheModel();
+		auto misses = std::vector<int>();
+		auto before = simulateCache(indices, indexCount, vertexCount, model, &misses);
+
+		auto starts = std::vector<size_t>();
+		for (size_t t = 0; t < triangleCount; t++) {
+			if (t == 0 || misses[t] == 3) starts.push_back(t);
+		}
+		if (starts.size() < 2) return;
+		starts.push_back(triangleCount);
+
+		// Area-weighted centroid of the mesh, then of each cluster along with its area-weighted normal
+		auto triangleCentre = [&](size_t t) {
+			return (positions[indices[3 * t]] + positions[indices[3 * t + 1]] + positions[indices[3 * t + 2]]) / 3.f;
+		};
+		auto triangleNormal = [&](size_t t) {
+			auto a = positions[indices[3 * t]];
+			return glm::cross(positions[indices[3 * t + 1]] - a, positions[indices[3 * t + 2]] - a);
+		};
+		auto meshCentre = glm::vec3(0.f);
+		float meshArea = 0.f;
+		for (size_t t = 0; t < triangleCount; t++) {
+			auto area = glm::length(triangleNormal(t));
+			meshCentre += triangleCentre(t) * area;
+			meshArea += area;
+		}
+		if (meshArea > 0.f) meshCentre /= meshArea;
+
+		auto clusterCount = starts.size() - 1;
+		auto sortKeys = std::vector<float>(clusterCount);
+		for (size_t c = 0; c < clusterCount; c++) {
+			auto centre = glm::vec3(0.f);
+			auto normal = glm::vec3(0.f);
+			float area = 0.f;
+			for (size_t t = starts[c]; t < starts[c + 1]; t++) {
+				auto triangleArea = glm::length(triangleNormal(t));
+				centre += triangleCentre(t) * triangleArea;
+				normal += triangleNormal(t);
+				area += triangleArea;
+			}
+			if (area > 0.f) centre /= area;
+			auto normalLength = glm::length(normal);
+			sortKeys[c] = normalLength > 0.f ? glm::dot(centre - meshCentre, normal / normalLength) : 0.f;
+		}
+		auto order = std::vector<size_t>(clusterCount);
+		for (size_t c = 0; c < clusterCount; c++) { order[c] = c; }
+		std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return sortKeys[a] > sortKeys[b]; });
+
+		auto sorted = std::vector<GLuint>();
+		sorted.reserve(indexCount);
+		for (auto c : order) {
+			sorted.insert(sorted.end(), indices + 3 * starts[c], indices + 3 * starts[c + 1]);
+		}
+		auto after = simulateCache(sorted.data(), sorted.size(), vertexCount, model);
+		if (after.acmr <= before.acmr * threshold) { std::copy(sorted.begin(), sorted.end(), indices); }
+	}
+
+	// Renumber vertices in the order the indices first use them, so that vertex fetch walks memory forwards.
+	// Vertices no triangle uses go last. Returns the new index of each old vertex, for remapVertices
+	inline std::vector<GLuint> optimizeVertexFetch(GLuint* indices, size_t indexCount, size_t vertexCount) {
+		auto remap = std::vector<GLuint>(vertexCount, (GLuint)-1);
+		GLuint next = 0;
+		for (size_t i = 0; i < indexCount; i++) {
+			auto& to = remap[indices[i]];
+			if (to == (GLuint)-1) to = next++;
+			indices[i] = to;
+		}
+		for (auto& to : remap) {
+			if (to == (GLuint)-1) to = next++;
+		}
+		return remap;
+	}
+
+	// Move every vertex of a stream to its new index
+	template<typename T>
+	void remapVertices(T* stream, std::vector<GLuint> const& remap) {
+		auto old = std::vector<T>(stream, stream + remap.size());
+		for (size_t i = 0; i < remap.size(); i++) { stream[remap[i]] = old[i]; }
+	}
+
+	struct Result {
+		std::vector<GLuint> remap;	// new index of each old vertex, to apply to every vertex stream
+		CacheModel model;
+		CacheStats before;
+		CacheStats after;
+
+		void print(std::ostream& out) const {
+			out << "  vertex cache (" << (this->model.kind == CacheModel::FIFO ? "FIFO " : "LRU ") << this->model.size
+				<< "): ACMR " << this->before.acmr << " -> " << this->after.acmr
+				<< ", ATVR " << this->before.atvr << " -> " << this->after.atvr << std::endl;
+		}
+	};
+
+	// Run every stage on a mesh: the cache and overdraw orders within each submesh, so that submeshes keep their
+	// ranges, then the fetch order across the whole mesh. The caller applies the remap to its vertex streams
+	inline Result optimize(
+		GLuint* indices, size_t indexCount, std::vector<Submesh> const& submeshes,
+		glm::vec3 const* positions, size_t vertexCount, CacheModel model = defaultCacheModel()
+	) {
+		auto result = Result();
+		result.model = model;
+		result.before = simulateCache(indices, indexCount, vertexCount, model);
+		for (auto& submesh : submeshes) {
+			optimizeVertexCache(indices + submesh.firstIndex, submesh.indexCount, vertexCount);
+			optimizeOverdraw(indices + submesh.firstIndex, submesh.indexCount, positions, vertexCount);
+		}
+		result.remap = optimizeVertexFetch(indices, indexCount, vertexCount);
+		result.after = simulateCache(indices, indexCount, vertexCount, model);
+		return result;
+	}
+}
\ No newline at end of file
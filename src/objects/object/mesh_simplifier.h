@@ -0,0 +1,233 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+// Mesh simplification by quadric edge collapse, after Garland and Heckbert: each vertex accumulates the planes
+// of its triangles, and the cheapest collapses, as measured by the mean squared distance to those planes, go
+// first.
+//
+// Collapses are half-edge collapses onto an existing vertex, so that normals and texture coordinates are never
+// interpolated: the surviving vertex keeps its own. Vertices that share their position with another vertex
+// (UV seams and hard edges), that lie on an open border, or whose normal differs too much from the vertex they
+// would collapse onto, never move, so that seams stay closed and shading keeps its features
+namespace mesh_simplifier {
+
+	// Symmetric 4x4 matrix of the plane equations, in the order xx xy xz xw yy yz yw zz zw ww, and the number of
+	// planes summed into it
+	struct Quadric {
+		double m[10];
+		double planes;
+
+		Quadric() : planes(0.0) {
+			std::fill(this->m, this->m + 10, 0.0);
+		}
+
+		// The squared distance to the plane through point with the given unit normal
+		Quadric(glm::dvec3 normal, glm::dvec3 point) : planes(1.0) {
+			auto d = -glm::dot(normal, point);
+			double plane[4] = { normal.x, normal.y, normal.z, d };
+			int k = 0;
+			for (int i = 0; i < 4; i++) {
+				for (int j = i; j < 4; j++) { this->m[k++] = plane[i] * plane[j]; }
+			}
+		}
+
+		Quadric& operator+=(Quadric const& other) {
+			for (int i = 0; i < 10; i++) { this->m[i] += other.m[i]; }
+			this->planes += other.planes;
+			return *this;
+		}
+
+		// Sum of the squared distances from p to the planes
+		double error(glm::dvec3 p) const {
+			auto& m = this->m;
+			return
+				m[0] * p.x * p.x + 2 * m[1] * p.x * p.y + 2 * m[2] * p.x * p.z + 2 * m[3] * p.x +
+				m[4] * p.y * p.y + 2 * m[5] * p.y * p.z + 2 * m[6] * p.y +
+				m[7] * p.z * p.z + 2 * m[8] * p.z +
+				m[9];
+		}
+
+		// Mean squared distance from p to the planes, which unlike the sum does not grow with every collapse
+		double meanError(glm::dvec3 p) const {
+			return this->planes > 0.0 ? this->error(p) / this->planes : 0.0;
+		}
+	};
+
+	// Smallest cosine between the normals of two vertices for one to collapse onto the other
+	const float NORMAL_COSINE = 0.5f;
+
+	// Simplify the triangles of indices in place, down to targetIndexCount indices if that can be done without
+	// an error above maxError. Positions are divided by scale, so that errors are relative to it.
+	// normals may be null. Returns the new index count; error, if given, receives the largest error made
+	inline size_t simplify(
+		GLuint* indices, size_t indexCount, glm::vec3 const* positions, glm::vec3 const* normals, size_t vertexCount,
+		size_t targetIndexCount, float scale, float maxError, float* error = nullptr
+	) {
+		auto position = [&](GLuint v) { return glm::dvec3(positions[v]) / (double)scale; };
+
+		// Lock vertices with another vertex at the same position, and the ends of border edges, whose directed
+		// edge has no twin running the other way. Edges are keyed by position, so that seams are not borders
+		auto locked = std::vector<bool>(vertexCount, false);
+		{
+			auto positionHash = [](glm::vec3 const& p) {
+				uint32_t bits[3];
+				std::memcpy(bits, &p, sizeof(bits));
+				return (size_t)(bits[0] * 73856093u ^ bits[1] * 19349663u ^ bits[2] * 83492791u);
+			};
+			auto canonical = std::unordered_map<glm::vec3, GLuint, decltype(positionHash)>(16, positionHash);
+			auto sharedPosition = std::vector<GLuint>(vertexCount);
+			auto used = std::vector<bool>(vertexCount, false);
+			for (size_t i = 0; i < indexCount; i++) {
+				auto v = indices[i];
+				if (used[v]) continue;
+				used[v] = true;
+				auto inserted = canonical.emplace(positions[v], v);
+				sharedPosition[v] = inserted.first->second;
+				if (!inserted.second) {
+					locked[v] = true;
+					locked[inserted.first->second] = true;
+				}
+			}
+			auto edges = std::unordered_map<uint64_t, int>();
+			auto key = [&](GLuint a, GLuint b) { return ((uint64_t)sharedPosition[a] << 32) | sharedPosition[b]; };
+			for (size_t i = 0; i < indexCount; i += 3) {
+				for (int c = 0; c < 3; c++) { edges[key(indices[i + c], indices[i + (c + 1) % 3])]++; }
+			}
+			for (size_t i = 0; i < indexCount; i += 3) {
+				for (int c = 0; c < 3; c++) {
+					auto a = indices[i + c];
+					auto b = indices[i + (c + 1) % 3];
+					if (edges[key(a, b)] != 1 || edges.count(key(b, a)) == 0 || edges[key(b, a)] != 1) {
+						locked[a] = true;
+						locked[b] = true;
+					}
+				}
+			}
+		}
+
+		auto quadrics = std::vector<Quadric>(vertexCount);
+		for (size_t i = 0; i < indexCount; i += 3) {
+			auto a = position(indices[i]);
+			auto normal = glm::cross(position(indices[i + 1]) - a, position(indices[i + 2]) - a);
+			auto length = glm::length(normal);
+			if (length == 0.0) continue;
+			auto plane = Quadric(normal / length, a);
+			for (int c = 0; c < 3; c++) { quadrics[indices[i + c]] += plane; }
+		}
+
+		float largestError = 0.f;
+		auto maxCost = (double)maxError * maxError;
+		auto collapseTo = std::vector<GLuint>(vertexCount);
+		auto touched = std::vector<bool>(vertexCount);
+		auto offsets = std::vector<size_t>(vertexCount + 1);
+		auto adjacent = std::vector<GLuint>(indexCount);
+
+		// Each pass collapses the cheapest edges it can without two collapses touching the same triangles,
+		// then drops the triangles the collapses made degenerate
+		while (indexCount > targetIndexCount) {
+			std::fill(offsets.begin(), offsets.end(), 0);
+			for (size_t i = 0; i < indexCount; i++) { offsets[indices[i] + 1]++; }
+			for (size_t v = 0; v < vertexCount; v++) { offsets[v + 1] += offsets[v]; }
+			{
+				auto fill = std::vector<size_t>(offsets.begin(), offsets.end() - 1);
+				for (size_t i = 0; i < indexCount; i++) { adjacent[fill[indices[i]]++] = (GLuint)(i / 3); }
+			}
+
+			// The cheapest collapse of each vertex that may move
+			struct Candidate {
+				GLuint from;
+				GLuint to;
+				double cost;
+			};
+			auto best = std::vector<Candidate>();
+			auto bestOf = std::vector<size_t>(vertexCount, (size_t)-1);
+			for (size_t i = 0; i < indexCount; i += 3) {
+				for (int c = 0; c < 3; c++) {
+					for (int direction = 1; direction <= 2; direction++) {
+						auto from = indices[i + c];
+						auto to = indices[i + (c + direction) % 3];
+						if (locked[from] || from == to) continue;
+						if (normals && glm::dot(normals[from], normals[to]) < NORMAL_COSINE) continue;
+						auto combined = quadrics[from];
+						combined += quadrics[to];
+						auto cost = combined.meanError(position(to));
+						if (bestOf[from] == (size_t)-1) {
+							bestOf[from] = best.size();
+							best.push_back(Candidate{ from, to, cost });
+						} else if (cost < best[bestOf[from]].cost) {
+							best[bestOf[from]] = Candidate{ from, to, cost };
+						}
+					}
+				}
+			}
+			std::sort(best.begin(), best.end(), [](Candidate const& a, Candidate const& b) { return a.cost < b.cost; });
+
+			for (size_t v = 0; v < vertexCount; v++) { collapseTo[v] = (GLuint)v; }
+			std::fill(touched.begin(), touched.end(), false);
+			size_t removedIndices = 0;
+			size_t collapses = 0;
+			for (auto& candidate : best) {
+				if (candidate.cost > maxCost || indexCount - removedIndices <= targetIndexCount) break;
+				auto from = candidate.from;
+				auto to = candidate.to;
+				if (touched[from] || touched[to]) continue;
+
+				// Moving from onto to must not flip any of the triangles that survive
+				bool flips = false;
+				size_t collapsing = 0;
+				for (auto t = offsets[from]; t < offsets[from + 1] && !flips; t++) {
+					auto triangle = &indices[3 * adjacent[t]];
+					if (triangle[0] == to || triangle[1] == to || triangle[2] == to) {
+						collapsing++;
+						continue;
+					}
+					glm::dvec3 before[3];
+					glm::dvec3 after[3];
+					for (int c = 0; c < 3; c++) {
+						before[c] = position(triangle[c]);
+						after[c] = triangle[c] == from ? position(to) : before[c];
+					}
+					auto normalBefore = glm::cross(before[1] - before[0], before[2] - before[0]);
+					auto normalAfter = glm::cross(after[1] - after[0], after[2] - after[0]);
+					auto lengths = glm::length(normalBefore) * glm::length(normalAfter);
+					flips = lengths == 0.0 || glm::dot(normalBefore, normalAfter) < 0.25 * lengths;
+				}
+				if (flips || collapsing == 0) continue;
+
+				collapseTo[from] = to;
+				quadrics[to] += quadrics[from];
+				for (auto t = offsets[from]; t < offsets[from + 1]; t++) {
+					auto triangle = &indices[3 * adjacent[t]];
+					for (int c = 0; c < 3; c++) { touched[triangle[c]] = true; }
+				}
+				removedIndices += 3 * collapsing;
+				collapses++;
+				largestError = std::max(largestError, (float)std::sqrt(std::max(candidate.cost, 0.0)));
+			}
+			if (collapses == 0) break;
+
+			size_t kept = 0;
+			for (size_t i = 0; i < indexCount; i += 3) {
+				auto a = collapseTo[indices[i]];
+				auto b = collapseTo[indices[i + 1]];
+				auto c = collapseTo[indices[i + 2]];
+				if (a == b || b == c || a == c) continue;
+				indices[kept++] = a;
+				indices[kept++] = b;
+				indices[kept++] = c;
+			}
+			indexCount = kept;
+		}
+		if (error) *error = largestError;
+		return indexCount;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "mesh_cache.h"
+#include "streaming_builder.h"
+
+// The CPU side of a mesh, ready to be uploaded: either its up to date cache, memory-mapped, or the result
+// of streaming its OBJ, in which case the cache is rewritten.
+// Loading one makes no OpenGL calls, so it can be done on any thread
+class MeshSource {
+	MeshCache cache;
+	std::unique_ptr<StreamingBuilder> builder;
+
+public:
+	// Load the OBJ at the given path. streams is a combination of MeshCache::NORMALS and MeshCache::TEX_COORDS
+	MeshSource(char const* path, uint32_t streams) {
+		auto cachePath = std::string(path) + "." + std::to_string(streams) + ".meshcache";
+		this->cache = MeshCache(path, cachePath.c_str(), streams);
+		if (!this->cache.isValid()) {
+			this->builder.reset(new StreamingBuilder(path, streams));
+			MeshCache::write(
+				path, cachePath.c_str(), this->builder->view(), streams, this->builder->getMaterialLibraries()
+			);
+		}
+	}
+
+	MeshSource(MeshSource const&) = delete;
+	MeshSource& operator=(MeshSource const&) = delete;
+	MeshSource(MeshSource&&) noexcept = default;
+	MeshSource& operator=(MeshSource&&) noexcept = default;
+
+	// View of the mesh's streams, valid for as long as this source is
+	MeshView view() const {
+		return this->builder ? this->builder->view() : this->cache.getView();
+	}
+
+	// Paths of the material libraries the mesh's texture names came from
+	std::vector<std::string> const& getMaterialLibraries() const {
+		return this->builder ? this->builder->getMaterialLibraries() : this->cache.getDependencies();
+	}
+};
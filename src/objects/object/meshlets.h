@@ -0,0 +1,149 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "../../frustum_culling.h"
+
+// A run of consecutive triangles in an index buffer small enough to be culled as one: no more than
+// MAX_VERTICES distinct vertices and MAX_TRIANGLES triangles, with a bounding sphere and a cone bounding the
+// normals of its triangles
+struct Meshlet {
+	static const size_t MAX_VERTICES = 64;
+	static const size_t MAX_TRIANGLES = 124;
+
+	GLuint firstIndex;
+	GLuint indexCount;
+	glm::vec3 centre;
+	float radius;
+	glm::vec3 coneAxis;
+	// Sine of the cone's half angle, or 2 when the normals spread too far for the cluster to ever face away
+	float coneCutoff;
+};
+
+// Split the given index range, in its current triangle order, into meshlets. After the vertex cache optimisation
+// neighbouring triangles are close together, so consecutive runs make compact clusters without reordering
+// anything, and the meshlets just point into the existing index buffer
+inline std::vector<Meshlet> buildMeshlets(
+	GLuint const* indices, GLuint firstIndex, GLuint indexCount, glm::vec3 const* positions, size_t vertexCount
+) {
+	auto meshlets = std::vector<Meshlet>();
+	auto finish = [&](GLuint start, GLuint end) {
+		auto meshlet = Meshlet{ start, end - start, glm::vec3(0.f), 0.f, glm::vec3(0.f), 2.f };
+		auto boundsMin = positions[indices[start]];
+		auto boundsMax = boundsMin;
+		for (auto i = start; i < end; i++) {
+			boundsMin = glm::min(boundsMin, positions[indices[i]]);
+			boundsMax = glm::max(boundsMax, positions[indices[i]]);
+		}
+		meshlet.centre = (boundsMin + boundsMax) / 2.f;
+		for (auto i = start; i < end; i++) {
+			meshlet.radius = std::max(meshlet.radius, glm::length(positions[indices[i]] - meshlet.centre));
+		}
+
+		auto normals = std::vector<glm::vec3>();
+		auto axis = glm::vec3(0.f);
+		for (auto i = start; i < end; i += 3) {
+			auto a = positions[indices[i]];
+			auto normal = glm::cross(positions[indices[i + 1]] - a, positions[indices[i + 2]] - a);
+			auto length = glm::length(normal);
+			if (length == 0.f) continue;
+			normals.push_back(normal / length);
+			axis += normals.back();
+		}
+		auto axisLength = glm::length(axis);
+		if (axisLength > 0.f) {
+			meshlet.coneAxis = axis / axisLength;
+			auto cosine = 1.f;
+			for (auto& normal : normals) { cosine = std::min(cosine, glm::dot(normal, meshlet.coneAxis)); }
+			if (cosine > 0.f) { meshlet.coneCutoff = std::sqrt(1.f - cosine * cosine); }
+		}
+		meshlets.push_back(meshlet);
+	};
+
+	// Vertices are stamped with the meshlet that last used them, so finishing a meshlet clears the set
+	auto stamp = std::vector<size_t>(vertexCount, (size_t)-1);
+	auto start = firstIndex;
+	size_t vertices = 0;
+	for (auto i = firstIndex; i < firstIndex + indexCount; i += 3) {
+		size_t added = 0;
+		for (int c = 0; c < 3; c++) { added += stamp[indices[i + c]] != meshlets.size(); }
+		if (vertices + added > Meshlet::MAX_VERTICES || (i - start) / 3 + 1 > Meshlet::MAX_TRIANGLES) {
+			finish(start, i);
+			start = i;
+			vertices = 0;
+			added = 3;
+		}
+		for (int c = 0; c < 3; c++) { stamp[indices[i + c]] = meshlets.size(); }
+		vertices += added;
+	}
+	if (firstIndex + indexCount > start) { finish(start, firstIndex + indexCount); }
+	return meshlets;
+}
+
+// How much of what was submitted for drawing culling let through
+struct MeshletStats {
+	size_t meshlets;
+	size_t culledMeshlets;
+	size_t triangles;
+	size_t culledTriangles;
+
+	MeshletStats() : meshlets(0), culledMeshlets(0), triangles(0), culledTriangles(0) {}
+
+	MeshletStats& operator+=(MeshletStats const& other) {
+		this->meshlets += other.meshlets;
+		this->culledMeshlets += other.culledMeshlets;
+		this->triangles += other.triangles;
+		this->culledTriangles += other.culledTriangles;
+		return *this;
+	}
+};
+
+// Rejects the meshlets of one object that are outside the view frustum or face away from the camera. Everything
+// is tested in the object's model space, where the meshlet bounds are, by bringing the frustum planes and the
+// camera into it rather than every meshlet out of it
+class MeshletCulling {
+	glm::vec4 planes[6];	// normalised, pointing inwards
+	glm::vec3 cameraPosition;
+
+public:
+	MeshletCulling(glm::mat4 const& model, glm::mat4 const& viewProjection, glm::vec3 cameraPosition) :
+		cameraPosition(glm::vec3(glm::inverse(model) * glm::vec4(cameraPosition, 1.f)))
+	{
+		frustum_culling::extractPlanes(viewProjection * model, this->planes);
+	}
+
+	bool isVisible(Meshlet const& meshlet) const {
+		for (auto& plane : this->planes) {
+			if (glm::dot(glm::vec3(plane), meshlet.centre) + plane.w < -meshlet.radius) return false;
+		}
+		// Every triangle faces away if every direction from the camera into the bounding sphere is within 90
+		// degrees minus the cone's half angle of its axis
+		auto toCentre = meshlet.centre - this->cameraPosition;
+		return glm::dot(toCentre, meshlet.coneAxis) <
+			meshlet.coneCutoff * glm::length(toCentre) + meshlet.radius * (1.f + meshlet.coneCutoff);
+	}
+
+	// Add the visible meshlets to counts and offsets, as glMultiDrawElements takes them, given the size of an
+	// index, and count what was culled
+	void cull(
+		std::vector<Meshlet> const& meshlets, size_t indexSize,
+		std::vector<GLsizei>& counts, std::vector<void const*>& offsets, MeshletStats& stats
+	) const {
+		for (auto& meshlet : meshlets) {
+			stats.meshlets++;
+			stats.triangles += meshlet.indexCount / 3;
+			if (this->isVisible(meshlet)) {
+				counts.push_back(meshlet.indexCount);
+				offsets.push_back((void const*)(meshlet.firstIndex * indexSize));
+			} else {
+				stats.culledMeshlets++;
+				stats.culledTriangles += meshlet.indexCount / 3;
+			}
+		}
+	}
+};
\ No newline at end of file
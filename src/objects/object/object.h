@@ -1,111 +1,477 @@
 #pragma once
 
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <unordered_map>
 #include <vector>
 
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 
 #include "../attribute_array.h"
+#include "../gl_state.h"
+#include "../texture/compressed_image.h"
 #include "../texture/image.h"
+#include "../texture/mip_chain.h"
 #include "../texture/texture.h"
+#include "../texture/texture_array.h"
+#include "../vertex_array_object.h"
+#include "../vertex_layout.h"
 #include "data.h"
+#include "mesh_cache.h"
+#include "mesh_lods.h"
+#include "mesh_optimizer.h"
+#include "mesh_source.h"
+#include "meshlets.h"
+#include "quantized_mesh.h"
+#include "tangent_space.h"
 
 class Object {
+	// A submesh, with where its texture ended up in the material arrays
+	struct DrawRange {
+		GLuint firstIndex;
+		GLuint indexCount;
+		texture::MaterialSlot material;
+		std::vector<Meshlet> meshlets;
+	};
+
+	// Positions get a stream of their own, so that depth-only passes fetch nothing else
 	VertexArray vertices;
-	NormalArray normals;
-	TexCoordArray texCoords;
-	texture::Texture texture;
+	InterleavedArray surface;	// normals and texture coordinates
+	IndexArray indices;	// every level of detail, one after the other
+	VertexArrayObject vao;	// every stream
+	VertexArrayObject depthVao;	// positions alone
+	mutable InstanceArray instances;	// model matrices of the last instanced draw
+	VertexArrayObject instancedVao;	// every stream, and the instances
+	texture::MaterialArrays const* materials;
+	// The ranges of each level of detail, in array then layer order, so that ranges sharing an array share its bind
+	std::vector<std::vector<DrawRange>> levels;
+	LodSelection lod;
+	QuantizedMesh::Quantization quantization;
 	GLuint vertexCount;
+	// The visible meshlets of a range, as glMultiDrawElements takes them, kept to reuse their storage every frame
+	mutable std::vector<GLsizei> visibleCounts;
+	mutable std::vector<void const*> visibleOffsets;
 
 	Object(
-		VertexArray vertices, NormalArray normals, TexCoordArray texCoords, 
-		texture::Texture texture, GLuint vertexCount
-	) : 
-		vertices(std::move(vertices)), normals(std::move(normals)), texCoords(std::move(texCoords)),
-		texture(std::move(texture)), vertexCount(vertexCount)
-	{}
+		QuantizedMesh const& mesh, MeshLods const& lods, texture::MaterialArrays const& materials,
+		std::vector<texture::MaterialSlot> const& slots
+	) :
+		vertices(mesh.positions.bytes.data(), mesh.positions.bytes.size(), mesh.positions.format),
+		surface(surfaceOf(mesh)),
+		indices(lods.indices), instances(InstanceArray::create()), materials(&materials), lod(lods),
+		quantization(mesh.quantization), vertexCount(mesh.vertexCount)
+	{
+		for (auto& level : lods.levels) {
+			auto ranges = rangesOf(level, slots);
+			std::stable_sort(ranges.begin(), ranges.end(), [](DrawRange const& a, DrawRange const& b) {
+				if (a.material.array != b.material.array) return a.material.array < b.material.array;
+				return a.material.layer < b.material.layer;
+			});
+			this->levels.push_back(std::move(ranges));
+		}
+		this->vao = VertexArrayObject([this] {
+			this->vertices.bind();
+			this->surface.bind();
+			this->indices.bind();
+		});
+		this->depthVao = VertexArrayObject([this] {
+			this->vertices.bind();
+			this->indices.bind();
+		});
+		this->instancedVao = VertexArrayObject([this] {
+			this->vertices.bind();
+			this->surface.bind();
+			this->instances.bind();
+			this->indices.bind();
+		});
+	}
+
+	static std::vector<DrawRange> rangesOf(MeshLods::Level const& level, std::vector<texture::MaterialSlot> const& slots) {
+		auto ranges = std::vector<DrawRange>();
+		for (size_t i = 0; i < level.submeshes.size(); i++) {
+			auto& submesh = level.submeshes[i];
+			ranges.push_back(DrawRange{ submesh.firstIndex, submesh.indexCount, slots[i], level.meshlets[i] });
+		}
+		return ranges;
+	}
+
+	// Bind the streams of vao and set up the polygon mode for drawMode
+	void bindForDraw(VertexArrayObject const& vao, int drawMode) const {
+		vao.bind();
+
+		gl_state::pointSize(3.f);
+
+		gl_state::polygonMode(drawMode == 1 ? GL_LINE : GL_FILL);
+	}
+
+	// Interleave the normals and texture coordinates of a mesh, in the layout their encodings call for
+	static InterleavedArray surfaceOf(QuantizedMesh const& mesh) {
+		auto& quantization = mesh.quantization;
+		auto half = quantization.halfTexCoords;
+		switch (quantization.normals) {
+		case QuantizedMesh::NormalEncoding::PACKED_10_10_10:
+			return half ?
+				interleave<AttributeNormalPacked, AttributeTexCoordHalf>(mesh) :
+				interleave<AttributeNormalPacked, AttributeTexCoord>(mesh);
+		case QuantizedMesh::NormalEncoding::OCTAHEDRAL_16:
+			return half ?
+				interleave<AttributeNormalOctahedral, AttributeTexCoordHalf>(mesh) :
+				interleave<AttributeNormalOctahedral, AttributeTexCoord>(mesh);
+		default:
+			return half ?
+				interleave<AttributeNormal, AttributeTexCoordHalf>(mesh) :
+				interleave<AttributeNormal, AttributeTexCoord>(mesh);
+		}
+	}
+
+	template<typename Normal, typename TexCoord>
+	static InterleavedArray interleave(QuantizedMesh const& mesh) {
+		typedef VertexLayout<Normal, TexCoord> Layout;
+		return InterleavedArray::of<Layout>(Layout::interleave(
+			mesh.vertexCount,
+			(typename Normal::Element const*)mesh.normals.bytes.data(),
+			(typename TexCoord::Element const*)mesh.texCoords.bytes.data()
+		));
+	}
+
+	static const uint32_t CACHE_STREAMS = MeshCache::NORMALS | MeshCache::TEX_COORDS;
 
 public:
-	explicit Object(ObjectData const& data) {
-		*this = Builder(data).build();
+	// The textures of a mesh's submeshes, each cooked if a cooked version exists, or else decoded with its mip
+	// chain built. A texture shared by several submeshes is loaded once
+	struct Textures {
+		std::vector<std::string> names;
+		std::vector<MipChain> chains;
+		std::vector<CompressedImage> cooked;	// used instead of the chain of the same index unless empty
+		std::vector<texture::MaterialSlot> slots;	// of each texture, once handed over
+
+		Textures() {}
+
+		explicit Textures(std::vector<Submesh> const& submeshes) {
+			for (auto& submesh : submeshes) {
+				if (std::find(this->names.begin(), this->names.end(), submesh.textureName) != this->names.end()) continue;
+				this->names.push_back(submesh.textureName);
+				auto cookedName = CompressedImage::cookedPath(submesh.textureName);
+				if (CompressedImage::exists(cookedName)) {
+					this->chains.push_back(MipChain());
+					this->cooked.push_back(CompressedImage(cookedName.c_str()));
+				} else {
+					this->chains.push_back(MipChain(Image(submesh.textureName.c_str()), texture::TextureKind::SRGB));
+					this->cooked.push_back(CompressedImage());
+				}
+			}
+		}
+
+		// Hand the textures over to the material arrays, and return the slot of each submesh's texture. Only the
+		// first call hands them over, and later ones give the same slots, so that a mesh can go into a MeshBatch
+		// and into an Object both
+		std::vector<texture::MaterialSlot> add(std::vector<Submesh> const& submeshes, texture::MaterialArrays& materials) {
+			if (this->slots.empty()) {
+				for (size_t i = 0; i < this->names.size(); i++) {
+					this->slots.push_back(this->cooked[i].isEmpty() ?
+						materials.add(std::move(this->chains[i])) : materials.add(std::move(this->cooked[i])));
+				}
+			}
+			auto slots = std::vector<texture::MaterialSlot>();
+			for (auto& submesh : submeshes) {
+				auto name = std::find(this->names.begin(), this->names.end(), submesh.textureName);
+				slots.push_back(this->slots[name - this->names.begin()]);
+			}
+			return slots;
+		}
+	};
+
+	// Every constructor adds the object's textures to the given material arrays, which must outlive the object
+	// and be uploaded before it is drawn
+	Object(ObjectData const& data, texture::MaterialArrays& materials) {
+		*this = Builder(data).build(materials);
+	}
+
+	// Upload a mesh whose vertex streams are already encoded, and whose textures are already in the arrays,
+	// with slots holding the texture of each submesh
+	Object(
+		MeshView const& mesh, QuantizedMesh const& quantized, texture::MaterialArrays const& materials,
+		std::vector<texture::MaterialSlot> const& slots
+	) : Object(quantized, MeshLods(mesh), materials, slots) {}
+
+	Object(
+		MeshView const& mesh, texture::MaterialArrays& materials,
+		QuantizedMesh::Tolerance tolerance = QuantizedMesh::defaultTolerance()
+	) : Object(mesh, QuantizedMesh(mesh, tolerance), materials, Textures(mesh.submeshes).add(mesh.submeshes, materials))
+	{}
+
+	// The CPU side of an object: its mesh, its encoded vertex streams, its levels of detail and its textures.
+	// Loading one makes no OpenGL calls, so it can be done on any thread
+	struct Source {
+		MeshSource mesh;
+		QuantizedMesh quantized;
+		MeshLods lods;
+		Textures textures;
+
+		explicit Source(char const* path, QuantizedMesh::Tolerance tolerance = QuantizedMesh::defaultTolerance()) :
+			mesh(path, CACHE_STREAMS), quantized(this->mesh.view(), tolerance), lods(this->mesh.view()),
+			textures(this->mesh.view().submeshes)
+		{
+			this->quantized.quantization.print(std::cout, path);
+			this->lods.print(std::cout);
+		}
+	};
+
+	Object(Source source, texture::MaterialArrays& materials) : Object(
+		source.quantized, source.lods, materials, source.textures.add(source.mesh.view().submeshes, materials)
+	) {}
+
+	// Load the OBJ at the given path, going through its binary cache if it is up to date.
+	// Otherwise, the OBJ is streamed straight into its final vertex and index streams, and the cache rewritten
+	Object(char const* path, texture::MaterialArrays& materials) {
+		*this = Object(Source(path), materials);
+	}
+
+	// How the vertex streams were encoded. The dequantization matrix goes in front of the model matrix, and
+	// octahedral normals have to be unfolded by the shader
+	QuantizedMesh::Quantization const& getQuantization() const {
+		return this->quantization;
 	}
 
+	// Pick the level of detail the next draws use, from the projected size of the object under the given model
+	// matrix, without the dequantization. projectionScale is as for LodSelection::select
+	size_t selectLod(glm::mat4 const& model, glm::vec3 cameraPosition, float projectionScale) {
+		return this->lod.select(model, cameraPosition, projectionScale);
+	}
+
+	// Draw each submesh of the selected level of detail with its own texture. Ranges are in material order, so
+	// consecutive ranges in one array only change the layer
 	void draw(int drawMode) const {
-		this->texture.bind();
-		this->vertices.bind();
-		this->normals.bind();
-		this->texCoords.bind();
+		this->bindForDraw(this->vao, drawMode);
+
+		// Every unique vertex is a point, so there is no need to go through the indices. Their texture is that of
+		// the first range, which a mesh without faces does not have
+		if (drawMode == 2) {
+			if (this->levels[0].empty()) return;
+			this->materials->bind(this->levels[0][0].material);
+			glDrawArrays(GL_POINTS, 0, vertexCount);
+			return;
+		}
+		for (auto& range : this->levels[this->lod.getLevel()]) {
+			this->materials->bind(range.material);
+			this->indices.draw(GL_TRIANGLES, range.firstIndex, range.indexCount);
+		}
+	}
+
+	// Draw as draw() does, but only the meshlets that culling lets through, each submesh in one
+	// glMultiDrawElements. Points are not culled. Returns what was culled
+	MeshletStats draw(int drawMode, MeshletCulling const& culling) const {
+		if (drawMode == 2) {
+			this->draw(drawMode);
+			return MeshletStats();
+		}
+		this->bindForDraw(this->vao, drawMode);
+
+		auto stats = MeshletStats();
+		auto indexSize = IndexArray::indexSize(this->indices.getType());
+		for (auto& range : this->levels[this->lod.getLevel()]) {
+			this->visibleCounts.clear();
+			this->visibleOffsets.clear();
+			culling.cull(range.meshlets, indexSize, this->visibleCounts, this->visibleOffsets, stats);
+			if (this->visibleCounts.empty()) continue;
+			this->materials->bind(range.material);
+			this->indices.multiDraw(GL_TRIANGLES, this->visibleCounts, this->visibleOffsets);
+		}
+		return stats;
+	}
 
-		glPointSize(3.f);
+	// Draw the selected level of detail once for each of count model matrices, with a draw per range. The program
+	// must take the models per instance, with only the dequantization as its own model matrix, as
+	// ObjectProgram::setInstanced sets it up
+	void drawInstanced(int drawMode, glm::mat4 const* models, GLsizei count) const {
+		if (count == 0) return;
+		this->uploadInstances(models, count);
+		this->drawInstanceRange(drawMode, 0, count);
+	}
 
-		if (drawMode == 1) { glPolygonMode(GL_FRONT_AND_BACK, GL_LINE); }
-		else { glPolygonMode(GL_FRONT_AND_BACK, GL_FILL); }
+	// Replace the model matrices the instanced draws below read
+	void uploadInstances(glm::mat4 const* models, GLsizei count) const {
+		this->instances.upload(models, count);
+	}
 
-		if (drawMode == 2) { glDrawArrays(GL_POINTS, 0, vertexCount); }
-		else { glDrawArrays(GL_TRIANGLES, 0, vertexCount); }
+	// Replace count of the uploaded model matrices from first on, keeping the others
+	void updateInstances(glm::mat4 const* models, GLsizei first, GLsizei count) const {
+		this->instances.update(models, first, count);
+	}
+
+	// Draw as above, with count of the model matrices already uploaded, from first on
+	void drawInstanceRange(int drawMode, GLuint first, GLsizei count) const {
+		if (count == 0) return;
+		this->bindForDraw(this->instancedVao, drawMode);
+
+		if (drawMode == 2) {
+			if (this->levels[0].empty()) return;
+			this->materials->bind(this->levels[0][0].material);
+			glDrawArraysInstancedBaseInstance(GL_POINTS, 0, this->vertexCount, count, first);
+			return;
+		}
+		for (auto& range : this->levels[this->lod.getLevel()]) {
+			this->materials->bind(range.material);
+			this->indices.drawInstanced(GL_TRIANGLES, range.firstIndex, range.indexCount, count, first);
+		}
+	}
+
+	// Draw every triangle of the selected level of detail from the position stream alone, for depth and shadow
+	// passes
+	void drawDepth() const {
+		this->depthVao.bind();
+		gl_state::polygonMode(GL_FILL);
+		for (auto& range : this->levels[this->lod.getLevel()]) {
+			this->indices.draw(GL_TRIANGLES, range.firstIndex, range.indexCount);
+		}
 	}
 
 	struct Builder {
 		std::vector<glm::vec3> vertices;
 		std::vector<glm::vec3> normals;
 		std::vector<glm::vec2> texCoords;
-		Image texture;
+		std::vector<GLuint> indices;
+		glm::vec3 boundsMin;
+		glm::vec3 boundsMax;
+		glm::vec3 sphereCentre;
+		float sphereRadius;
+		std::vector<Submesh> submeshes;
+		std::string path;
+		QuantizedMesh::Tolerance tolerance;	// largest error allowed when build() encodes the vertex streams
 
-		explicit Builder(ObjectData const& data) {
-			auto vertexCount = 0;
+		// Build an indexed mesh, merging the face corners that share the same position, normal and
+		// texture coordinates into a single vertex. Corners without a normal get an area-weighted one, smoothed
+		// across the faces of their smoothing group
+		explicit Builder(ObjectData const& data) : path(data.path), tolerance(QuantizedMesh::defaultTolerance()) {
+			size_t cornerCount = 0;
 			for (auto& shape : data.shapes) {
-				vertexCount += shape.mesh.num_face_vertices.size() * 3; // 3 vertices for each face
+				cornerCount += shape.mesh.num_face_vertices.size() * 3; // 3 vertices for each face
 			}
+			this->indices.reserve(cornerCount);
 
-			auto vertices = std::vector<glm::vec3>();
-			vertices.reserve(vertexCount);
-			auto normals = std::vector<glm::vec3>();
-			normals.reserve(vertexCount);
-			auto texCoords = std::vector<glm::vec2>();
-			texCoords.reserve(vertexCount);
+			auto& attrib = data.attrib;
+			auto triangleMaterials = std::vector<int>();
+			triangleMaterials.reserve(cornerCount / 3);
+			auto uniqueVertices = std::unordered_map<tinyobj::index_t, GLuint, ObjectIndexHash, ObjectIndexEqual>();
+			uniqueVertices.reserve(cornerCount);
+			// Vertices missing a normal, and for every vertex the one whose generated normal it shares
+			auto missingNormals = std::vector<GLuint>();
+			auto normalGroups = std::vector<GLuint>();
+			auto groupOf = std::unordered_map<uint64_t, GLuint>();
 
+			size_t firstTriangle = 0;
 			for (auto& shape : data.shapes) {
-				size_t lastProcessedIndex = 0;
-				for (auto faceVertexCount : shape.mesh.num_face_vertices) {
-					for (size_t v = lastProcessedIndex; v < lastProcessedIndex + faceVertexCount; v++) {
-						auto idx = shape.mesh.indices[v]; //get the indices vertex/normal/texCoord
-
-						auto& attrib = data.attrib;
-
-						vertices.push_back(glm::vec3(
+				for (size_t corner = 0; corner < shape.mesh.indices.size(); corner++) {
+					auto idx = shape.mesh.indices[corner]; //get the indices vertex/normal/texCoord
+					// A missing normal is keyed by its smoothing group instead, so that corners only merge within a
+					// group. Faces outside any group are flat, so each gets a key of its own
+					auto missingNormal = idx.normal_index < 0;
+					if (missingNormal) {
+						auto triangle = firstTriangle + corner / 3;
+						auto group = shape.mesh.smoothing_group_ids[corner / 3];
+						idx.normal_index = group != 0 ? -1 - (int)group : INT_MIN + (int)triangle;
+					}
+					auto vertex = (GLuint)this->vertices.size();
+					auto inserted = uniqueVertices.emplace(idx, vertex);
+					if (inserted.second) {
+						this->vertices.push_back(glm::vec3(
 							attrib.vertices[3 * idx.vertex_index],
 							attrib.vertices[3 * idx.vertex_index + 1],
 							attrib.vertices[3 * idx.vertex_index + 2]
 						));
 
-						normals.push_back(glm::vec3(
+						this->normals.push_back(missingNormal ? glm::vec3(0.f) : glm::vec3(
 							attrib.normals[3 * idx.normal_index],
 							attrib.normals[3 * idx.normal_index + 1],
 							attrib.normals[3 * idx.normal_index + 2]
 						));
 
-						texCoords.push_back(glm::vec2(
+						this->texCoords.push_back(idx.texcoord_index < 0 ? glm::vec2(0.f) : glm::vec2(
 							attrib.texcoords[2 * idx.texcoord_index],
 							attrib.texcoords[2 * idx.texcoord_index + 1]
 						));
+
+						normalGroups.push_back(vertex);
+						if (missingNormal) {
+							missingNormals.push_back(vertex);
+							auto key = ((uint64_t)(uint32_t)idx.vertex_index << 32) | (uint32_t)idx.normal_index;
+							normalGroups.back() = groupOf.emplace(key, vertex).first->second;
+						}
 					}
-					lastProcessedIndex += faceVertexCount;
+					this->indices.push_back(inserted.first->second);
 				}
-				this->vertices = std::move(vertices);
-				this->normals = std::move(normals);
-				this->texCoords = std::move(texCoords);
-				this->texture = Image(data.material.diffuse_texname.c_str());
+				triangleMaterials.insert(
+					triangleMaterials.end(), shape.mesh.material_ids.begin(), shape.mesh.material_ids.end()
+				);
+				firstTriangle += shape.mesh.num_face_vertices.size();
 			}
+			if (!missingNormals.empty()) {
+				auto generated = tangent_space::generateNormals(
+					this->indices.data(), this->indices.size(), this->vertices.data(), this->vertices.size(),
+					normalGroups.data()
+				);
+				for (auto vertex : missingNormals) { this->normals[vertex] = generated[vertex]; }
+			}
+			this->submeshes = groupByMaterial(
+				this->indices.data(), this->indices.size(), triangleMaterials.data(), data.textureNames()
+			);
+			auto optimized = mesh_optimizer::optimize(
+				this->indices.data(), this->indices.size(), this->submeshes, this->vertices.data(), this->vertices.size()
+			);
+			mesh_optimizer::remapVertices(this->vertices.data(), optimized.remap);
+			mesh_optimizer::remapVertices(this->normals.data(), optimized.remap);
+			mesh_optimizer::remapVertices(this->texCoords.data(), optimized.remap);
+			computeBounds(this->vertices, this->boundsMin, this->boundsMax);
+			computeBoundingSphere(
+				this->vertices.data(), this->vertices.size(), this->boundsMin, this->boundsMax, this->sphereCentre,
+				this->sphereRadius
+			);
+
+			auto vertexSize = sizeof(glm::vec3) + sizeof(glm::vec3) + sizeof(glm::vec2);
+			auto indexSize = IndexArray::indexSize(IndexArray::typeFor(this->indices.data(), this->indices.size()));
+			std::cout << data.path << ": " << cornerCount << " -> " << this->vertices.size() << " vertices, "
+				<< cornerCount * vertexSize << " -> "
+				<< this->vertices.size() * vertexSize + this->indices.size() * indexSize << " bytes" << std::endl;
+			optimized.print(std::cout);
 		}
 
-		Object build() const {
-			return Object(
-				VertexArray(this->vertices),
-				NormalArray(this->normals),
-				TexCoordArray(this->texCoords),
-				texture::Texture(this->texture),
-				this->vertices.size()
+		// Tangents of every vertex for normal mapping, with the handedness of the texture mapping in w
+		std::vector<glm::vec4> generateTangents() const {
+			return tangent_space::generateTangents(
+				this->indices.data(), this->indices.size(), this->vertices.data(), this->normals.data(),
+				this->texCoords.data(), this->vertices.size()
 			);
 		}
+
+		// View of the builder's streams, valid for as long as the builder is
+		MeshView view() const {
+			auto view = MeshView();
+			view.vertices = this->vertices.data();
+			view.normals = this->normals.data();
+			view.texCoords = this->texCoords.data();
+			view.vertexCount = this->vertices.size();
+			view.indices = this->indices.data();
+			view.indexType = GL_UNSIGNED_INT;
+			view.indexCount = this->indices.size();
+			view.boundsMin = this->boundsMin;
+			view.boundsMax = this->boundsMax;
+			view.sphereCentre = this->sphereCentre;
+			view.sphereRadius = this->sphereRadius;
+			view.submeshes = this->submeshes;
+			return view;
+		}
+
+		Object build(texture::MaterialArrays& materials) const {
+			auto quantized = QuantizedMesh(this->view(), this->tolerance);
+			quantized.quantization.print(std::cout, this->path);
+			auto lods = MeshLods(this->view());
+			lods.print(std::cout);
+			auto slots = Textures(this->submeshes).add(this->submeshes, materials);
+			return Object(quantized, lods, materials, slots);
+		}
 	};
 };
\ No newline at end of file
@@ -1,75 +1,177 @@
 #pragma once
 
+#include <iostream>
 #include <vector>
 
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 
 #include "../attribute_array.h"
+#include "../gl_state.h"
+#include "../vertex_array_object.h"
 #include "data.h"
+#include "mesh_cache.h"
+#include "mesh_lods.h"
+#include "mesh_optimizer.h"
+#include "mesh_source.h"
+#include "meshlets.h"
 
 class ObjectPosition {
 	VertexArray vertices;
+	IndexArray indices;	// every level of detail, one after the other
+	VertexArrayObject vao;
+	std::vector<Submesh> levels;	// the single range of each level of detail
+	std::vector<std::vector<Meshlet>> meshlets;	// of each level of detail
+	LodSelection lod;
 	GLuint vertexCount;
-
-	ObjectPosition(VertexArray vertices, GLuint vertexCount) :
-		vertices(std::move(vertices)), vertexCount(vertexCount)
-	{}
+	// The visible meshlets, as glMultiDrawElements takes them, kept to reuse their storage every frame
+	mutable std::vector<GLsizei> visibleCounts;
+	mutable std::vector<void const*> visibleOffsets;
+
+	ObjectPosition(VertexArray vertices, MeshLods const& lods, GLuint vertexCount) :
+		vertices(std::move(vertices)), indices(lods.indices), lod(lods), vertexCount(vertexCount)
+	{
+		// A level's submeshes follow each other, so each level is drawn in one go
+		for (auto& level : lods.levels) {
+			this->levels.push_back(Submesh{ level.submeshes.front().firstIndex, level.triangleCount * 3, "" });
+			this->meshlets.push_back(std::vector<Meshlet>());
+			for (auto& meshlets : level.meshlets) {
+				this->meshlets.back().insert(this->meshlets.back().end(), meshlets.begin(), meshlets.end());
+			}
+		}
+		this->vao = VertexArrayObject([this] {
+			this->vertices.bind();
+			this->indices.bind();
+		});
+	}
 
 public:
 	explicit ObjectPosition(ObjectData const& data) {
 		*this = Builder(data).build();
 	}
 
+	// Upload a mesh whose streams are already in their final form. Only its positions are used
+	explicit ObjectPosition(MeshView const& mesh) : ObjectPosition(
+		VertexArray(mesh.vertices, mesh.vertexCount),
+		MeshLods(mesh),
+		mesh.vertexCount
+	) {}
+
+	explicit ObjectPosition(MeshSource const& source) : ObjectPosition(source.view()) {}
+
+	// Load the OBJ at the given path, going through its binary cache if it is up to date.
+	// Otherwise, the OBJ is streamed straight into its final vertex and index streams, and the cache rewritten
+	explicit ObjectPosition(char const* path) {
+		*this = ObjectPosition(MeshSource(path, 0));
+	}
+
+	// Pick the level of detail the next draws use, as for Object::selectLod
+	size_t selectLod(glm::mat4 const& model, glm::vec3 cameraPosition, float projectionScale) {
+		return this->lod.select(model, cameraPosition, projectionScale);
+	}
+
 	void draw(int drawMode) const {
-		this->vertices.bind();
+		this->vao.bind();
 
-		glPointSize(3.f);
+		gl_state::pointSize(3.f);
 
-		if (drawMode == 1) { glPolygonMode(GL_FRONT_AND_BACK, GL_LINE); }
-		else { glPolygonMode(GL_FRONT_AND_BACK, GL_FILL); }
+		gl_state::polygonMode(drawMode == 1 ? GL_LINE : GL_FILL);
 
 		if (drawMode == 2) { glDrawArrays(GL_POINTS, 0, vertexCount); }
-		else { glDrawArrays(GL_TRIANGLES, 0, vertexCount); }
+		else {
+			auto& level = this->levels[this->lod.getLevel()];
+			this->indices.draw(GL_TRIANGLES, level.firstIndex, level.indexCount);
+		}
+	}
+
+	// Draw only the meshlets that culling lets through, in one glMultiDrawElements, as for Object
+	MeshletStats draw(int drawMode, MeshletCulling const& culling) const {
+		if (drawMode == 2) {
+			this->draw(drawMode);
+			return MeshletStats();
+		}
+		this->vao.bind();
+
+		gl_state::polygonMode(drawMode == 1 ? GL_LINE : GL_FILL);
+
+		auto stats = MeshletStats();
+		this->visibleCounts.clear();
+		this->visibleOffsets.clear();
+		culling.cull(
+			this->meshlets[this->lod.getLevel()], IndexArray::indexSize(this->indices.getType()),
+			this->visibleCounts, this->visibleOffsets, stats
+		);
+		if (!this->visibleCounts.empty()) {
+			this->indices.multiDraw(GL_TRIANGLES, this->visibleCounts, this->visibleOffsets);
+		}
+		return stats;
 	}
 
 	struct Builder {
 		std::vector<glm::vec3> vertices;
+		std::vector<GLuint> indices;
+		glm::vec3 boundsMin;
+		glm::vec3 boundsMax;
+		glm::vec3 sphereCentre;
+		float sphereRadius;
 
+		// Only positions are kept, so the OBJ's own position indices can be used as-is
 		explicit Builder(ObjectData const& data) {
-			auto vertexCount = 0;
+			size_t cornerCount = 0;
 			for (auto& shape : data.shapes) {
-				vertexCount += shape.mesh.num_face_vertices.size() * 3; // 3 vertices for each face
+				cornerCount += shape.mesh.num_face_vertices.size() * 3; // 3 vertices for each face
 			}
+			this->indices.reserve(cornerCount);
 
-			auto vertices = std::vector<glm::vec3>();
-			vertices.reserve(vertexCount);
-
+			auto& positions = data.attrib.vertices;
+			for (size_t i = 0; i + 2 < positions.size(); i += 3) {
+				this->vertices.push_back(glm::vec3(positions[i], positions[i + 1], positions[i + 2]));
+			}
 			for (auto& shape : data.shapes) {
-				size_t lastProcessedIndex = 0;
-				for (auto faceVertexCount : shape.mesh.num_face_vertices) {
-					for (size_t v = lastProcessedIndex; v < lastProcessedIndex + faceVertexCount; v++) {
-						auto idx = shape.mesh.indices[v]; //get the indices vertex/normal/texCoord
-
-						auto& attrib = data.attrib;
-
-						vertices.push_back(glm::vec3(
-							attrib.vertices[3 * idx.vertex_index],
-							attrib.vertices[3 * idx.vertex_index + 1],
-							attrib.vertices[3 * idx.vertex_index + 2]
-						));
-					}
-					lastProcessedIndex += faceVertexCount;
+				for (auto idx : shape.mesh.indices) {
+					this->indices.push_back(idx.vertex_index);
 				}
 			}
-			this->vertices = std::move(vertices);
+
+			auto optimized = mesh_optimizer::optimize(
+				this->indices.data(), this->indices.size(), { Submesh{ 0, (GLuint)this->indices.size(), "" } },
+				this->vertices.data(), this->vertices.size()
+			);
+			mesh_optimizer::remapVertices(this->vertices.data(), optimized.remap);
+			computeBounds(this->vertices, this->boundsMin, this->boundsMax);
+			computeBoundingSphere(
+				this->vertices.data(), this->vertices.size(), this->boundsMin, this->boundsMax, this->sphereCentre,
+				this->sphereRadius
+			);
+
+			auto indexSize = IndexArray::indexSize(IndexArray::typeFor(this->indices.data(), this->indices.size()));
+			std::cout << data.path << ": " << cornerCount << " -> " << this->vertices.size() << " vertices, "
+				<< cornerCount * sizeof(glm::vec3) << " -> "
+				<< this->vertices.size() * sizeof(glm::vec3) + this->indices.size() * indexSize
+				<< " bytes" << std::endl;
+			optimized.print(std::cout);
+		}
+
+		// View of the builder's streams, valid for as long as the builder is
+		MeshView view() const {
+			auto view = MeshView();
+			view.vertices = this->vertices.data();
+			view.vertexCount = this->vertices.size();
+			view.indices = this->indices.data();
+			view.indexType = GL_UNSIGNED_INT;
+			view.indexCount = this->indices.size();
+			view.boundsMin = this->boundsMin;
+			view.boundsMax = this->boundsMax;
+			view.sphereCentre = this->sphereCentre;
+			view.sphereRadius = this->sphereRadius;
+			view.submeshes.push_back(Submesh{ 0, (GLuint)this->indices.size(), "" });
+			return view;
 		}
 
 		ObjectPosition build() const {
-			return ObjectPosition(
-				VertexArray(this->vertices),
-				this->vertices.size()
-			);
+			auto lods = MeshLods(this->view());
+			lods.print(std::cout);
+			return ObjectPosition(VertexArray(this->vertices), lods, this->vertices.size());
 		}
 	};
 };
\ No newline at end of file
@@ -0,0 +1,231 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+
+#include "../attribute_array.h"
+#include "mesh_cache.h"
+
+// The vertex streams of a mesh in compact encodings, each stream taking the smallest encoding whose error stays
+// within a tolerance, and floats when none does:
+//  - positions as 16-bit normalized values across the mesh bounds, mapped back into model space by the
+//    dequantization matrix, which goes in front of the model matrix
+//  - normals as GL_INT_2_10_10_10_REV, or else as two 16-bit octahedral coordinates that the shader unfolds
+//  - texture coordinates as half floats
+// Encoding makes no OpenGL calls
+class QuantizedMesh {
+public:
+	enum class NormalEncoding { FLOAT, PACKED_10_10_10, OCTAHEDRAL_16 };
+
+	// The largest error allowed: for positions as a fraction of the largest extent of the bounds, for normals
+	// in degrees, and for texture coordinates in texture space
+	struct Tolerance {
+		float position;
+		float normalDegrees;
+		float texCoord;
+	};
+
+	static Tolerance defaultTolerance() {
+		return Tolerance{ 1.f / 4096, 0.5f, 1.f / 4096 };
+	}
+
+	// What each stream was encoded as, and the largest error the encoding made on any vertex
+	struct Quantization {
+		bool shortPositions;
+		NormalEncoding normals;
+		bool halfTexCoords;
+		float positionError;	// in model space
+		float normalError;		// in degrees
+		float texCoordError;	// in texture space
+		size_t floatSize;		// bytes of the streams as floats
+		size_t size;			// bytes of the streams as encoded
+		glm::mat4 dequantization;
+
+		Quantization() :
+			shortPositions(false), normals(NormalEncoding::FLOAT), halfTexCoords(false),
+			positionError(0.f), normalError(0.f), texCoordError(0.f), floatSize(0), size(0), dequantization(1.f)
+		{}
+
+		void print(std::ostream& out, std::string const& name) const {
+			auto normalName =
+				this->normals == NormalEncoding::PACKED_10_10_10 ? "10:10:10" :
+				this->normals == NormalEncoding::OCTAHEDRAL_16 ? "octahedral 16-bit" : "float";
+			out << name << ": positions " << (this->shortPositions ? "16-bit" : "float")
+				<< " (error " << this->positionError << "), normals " << normalName
+				<< " (error " << this->normalError << " degrees), texture coordinates "
+				<< (this->halfTexCoords ? "half" : "float") << " (error " << this->texCoordError << "), "
+				<< this->floatSize << " -> " << this->size << " vertex bytes" << std::endl;
+		}
+	};
+
+	struct Stream {
+		std::vector<unsigned char> bytes;
+		VertexFormat format;
+	};
+
+	Stream positions;
+	Stream normals;
+	Stream texCoords;
+	Quantization quantization;
+	GLuint vertexCount;
+
+	// Encode the streams of a mesh. Streams the mesh does not have are left empty
+	explicit QuantizedMesh(MeshView const& mesh, Tolerance tolerance = defaultTolerance()) :
+		vertexCount(mesh.vertexCount)
+	{
+		if (mesh.vertices) this->encodePositions(mesh.vertices, tolerance.position);
+		if (mesh.normals) this->encodeNormals(mesh.normals, tolerance.normalDegrees);
+		if (mesh.texCoords) this->encodeTexCoords(mesh.texCoords, tolerance.texCoord);
+		auto& q = this->quantization;
+		q.size = this->positions.bytes.size() + this->normals.bytes.size() + this->texCoords.bytes.size();
+	}
+
+	// Octahedral mapping of a unit vector onto the [-1, 1] square: the vector is projected onto the octahedron
+	// |x| + |y| + |z| = 1, whose lower half is folded out over the corners of the square
+	static glm::vec2 octahedralEncode(glm::vec3 n) {
+		n /= std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+		auto e = glm::vec2(n.x, n.y);
+		if (n.z < 0.f) { e = (1.f - glm::abs(glm::vec2(e.y, e.x))) * signNotZero(e); }
+		return e;
+	}
+
+	// The inverse of octahedralEncode, as in object.vert
+	static glm::vec3 octahedralDecode(glm::vec2 e) {
+		auto n = glm::vec3(e.x, e.y, 1.f - std::abs(e.x) - std::abs(e.y));
+		if (n.z < 0.f) {
+			auto folded = (1.f - glm::abs(glm::vec2(n.y, n.x))) * signNotZero(glm::vec2(n.x, n.y));
+			n.x = folded.x;
+			n.y = folded.y;
+		}
+		return glm::normalize(n);
+	}
+
+private:
+	static glm::vec2 signNotZero(glm::vec2 v) {
+		return glm::vec2(v.x >= 0.f ? 1.f : -1.f, v.y >= 0.f ? 1.f : -1.f);
+	}
+
+	template<typename T>
+	static void store(std::vector<unsigned char>& bytes, size_t i, T value) {
+		std::memcpy(&bytes[i * sizeof(T)], &value, sizeof(T));
+	}
+
+	template<typename Attribute>
+	void storeFloats(Stream& stream, typename Attribute::Element const* values) {
+		stream.bytes.resize(this->vertexCount * sizeof(*values));
+		std::memcpy(stream.bytes.data(), values, stream.bytes.size());
+		stream.format = formatOf<Attribute>();
+	}
+
+	void encodePositions(glm::vec3 const* vertices, float tolerance) {
+		auto& q = this->quantization;
+		q.floatSize += this->vertexCount * sizeof(glm::vec3);
+		if (this->vertexCount == 0) { return this->storeFloats<AttributePosition>(this->positions, vertices); }
+
+		auto boundsMin = vertices[0];
+		auto boundsMax = vertices[0];
+		for (GLuint i = 1; i < this->vertexCount; i++) {
+			boundsMin = glm::min(boundsMin, vertices[i]);
+			boundsMax = glm::max(boundsMax, vertices[i]);
+		}
+		auto extent = boundsMax - boundsMin;
+		// A flat axis is encoded as 0 and scaled by 0 on the way back
+		auto scale = glm::vec3(
+			extent.x > 0.f ? 1.f / extent.x : 0.f, extent.y > 0.f ? 1.f / extent.y : 0.f, extent.z > 0.f ? 1.f / extent.z : 0.f
+		);
+
+		auto encoded = std::vector<unsigned char>(this->vertexCount * sizeof(uint64_t));
+		float error = 0.f;
+		for (GLuint i = 0; i < this->vertexCount; i++) {
+			auto packed = glm::packUnorm4x16(glm::vec4((vertices[i] - boundsMin) * scale, 0.f));
+			auto decoded = boundsMin + glm::vec3(glm::unpackUnorm4x16(packed)) * extent;
+			error = std::max(error, glm::length(decoded - vertices[i]));
+			store(encoded, i, packed);
+		}
+
+		if (error > tolerance * std::max(extent.x, std::max(extent.y, extent.z))) {
+			return this->storeFloats<AttributePosition>(this->positions, vertices);
+		}
+		this->positions.bytes = std::move(encoded);
+		this->positions.format = formatOf<AttributePositionShort>();
+		q.shortPositions = true;
+		q.positionError = error;
+		q.dequantization = glm::mat4(1.f);
+		q.dequantization[0][0] = extent.x;
+		q.dequantization[1][1] = extent.y;
+		q.dequantization[2][2] = extent.z;
+		q.dequantization[3] = glm::vec4(boundsMin, 1.f);
+	}
+
+	void encodeNormals(glm::vec3 const* normals, float tolerance) {
+		auto& q = this->quantization;
+		q.floatSize += this->vertexCount * sizeof(glm::vec3);
+		auto encoded = std::vector<unsigned char>(this->vertexCount * sizeof(uint32_t));
+		auto encode = [&](NormalEncoding encoding) {
+			float error = 0.f;
+			for (GLuint i = 0; i < this->vertexCount; i++) {
+				auto length = glm::length(normals[i]);
+				if (length == 0.f) {
+					store(encoded, i, (uint32_t)0);
+					continue;
+				}
+				auto normal = normals[i] / length;
+				uint32_t packed;
+				glm::vec3 decoded;
+				if (encoding == NormalEncoding::PACKED_10_10_10) {
+					packed = glm::packSnorm3x10_1x2(glm::vec4(normal, 0.f));
+					decoded = glm::normalize(glm::vec3(glm::unpackSnorm3x10_1x2(packed)));
+				} else {
+					packed = glm::packSnorm2x16(octahedralEncode(normal));
+					decoded = octahedralDecode(glm::unpackSnorm2x16(packed));
+				}
+				// The angle from the chord between the two, which unlike acos of their dot product keeps its
+				// precision for small angles
+				auto chord = std::min(glm::length(decoded - normal), 2.f);
+				error = std::max(error, glm::degrees(2.f * std::asin(chord / 2.f)));
+				store(encoded, i, packed);
+			}
+			return error;
+		};
+
+		auto error = encode(NormalEncoding::PACKED_10_10_10);
+		if (error <= tolerance) {
+			q.normals = NormalEncoding::PACKED_10_10_10;
+			this->normals.format = formatOf<AttributeNormalPacked>();
+		} else {
+			error = encode(NormalEncoding::OCTAHEDRAL_16);
+			if (error > tolerance) { return this->storeFloats<AttributeNormal>(this->normals, normals); }
+			q.normals = NormalEncoding::OCTAHEDRAL_16;
+			this->normals.format = formatOf<AttributeNormalOctahedral>();
+		}
+		this->normals.bytes = std::move(encoded);
+		q.normalError = error;
+	}
+
+	void encodeTexCoords(glm::vec2 const* texCoords, float tolerance) {
+		auto& q = this->quantization;
+		q.floatSize += this->vertexCount * sizeof(glm::vec2);
+		auto encoded = std::vector<unsigned char>(this->vertexCount * sizeof(uint32_t));
+		float error = 0.f;
+		for (GLuint i = 0; i < this->vertexCount; i++) {
+			auto packed = glm::packHalf2x16(texCoords[i]);
+			auto decoded = glm::unpackHalf2x16(packed);
+			error = std::max(error, std::max(std::abs(decoded.x - texCoords[i].x), std::abs(decoded.y - texCoords[i].y)));
+			store(encoded, i, packed);
+		}
+		if (error > tolerance) { return this->storeFloats<AttributeTexCoord>(this->texCoords, texCoords); }
+		this->texCoords.bytes = std::move(encoded);
+		this->texCoords.format = formatOf<AttributeTexCoordHalf>();
+		q.halfTexCoords = true;
+		q.texCoordError = error;
+	}
+};
\ No newline at end of file
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <vector>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "../attribute_array.h"
+#include "../gl_state.h"
+#include "../texture/texture_array.h"
+#include "../vertex_array_object.h"
+#include "../vertex_layout.h"
+#include "baked_scene.h"
+#include "meshlets.h"
+#include "object.h"
+
+// The static props of a scene, drawn from their bake. The chunks of each material are culled as meshlets would be,
+// with the visible ones going out in one glMultiDrawElements, so the draws grow with the materials, and the
+// meshlet culling with the chunks, but neither with the props. The batches are already in world space, so the
+// program's model matrix is the identity, as ObjectProgram::setStatic sets it up
+class StaticScene {
+	typedef VertexLayout<AttributeNormal, AttributeTexCoord> SurfaceLayout;
+
+	// The batches of one material, a chunk each. Their normals spread every way, so they are never back-face culled
+	struct MaterialRange {
+		texture::MaterialSlot material;
+		std::vector<Meshlet> chunks;
+	};
+
+	VertexArray vertices;
+	InterleavedArray surface;
+	IndexArray indices;
+	VertexArrayObject vao;
+	texture::MaterialArrays const* materials;
+	std::vector<MaterialRange> ranges;
+	size_t batchCount;
+	// The visible chunks of a range, as glMultiDrawElements takes them, kept to reuse their storage every frame
+	mutable std::vector<GLsizei> visibleCounts;
+	mutable std::vector<void const*> visibleOffsets;
+
+public:
+	// The CPU side of a static scene: its bake and its textures. Loading one makes no OpenGL calls, so it can be
+	// done on any thread
+	struct Source {
+		BakedScene baked;
+		Object::Textures textures;
+
+		explicit Source(char const* path) : baked(path), textures(this->baked.view().submeshes) {}
+	};
+
+	StaticScene() : materials(nullptr), batchCount(0) {}
+
+	// Adds the scene's textures to the given material arrays, which must outlive the scene and be uploaded before
+	// it is drawn
+	StaticScene(Source source, texture::MaterialArrays& materials) : materials(&materials) {
+		auto mesh = source.baked.view();
+		auto slots = source.textures.add(mesh.submeshes, materials);
+		this->vertices = VertexArray(mesh.vertices, mesh.vertexCount);
+		this->surface = InterleavedArray::of<SurfaceLayout>(
+			SurfaceLayout::interleave(mesh.vertexCount, mesh.normals, mesh.texCoords)
+		);
+		this->indices = IndexArray(mesh.indices, mesh.indexType, (GLsizei)mesh.indexCount);
+		this->vao = VertexArrayObject([this] {
+			this->vertices.bind();
+			this->surface.bind();
+			this->indices.bind();
+		});
+
+		// Batches come in material order, so each material's chunks are consecutive
+		for (size_t i = 0; i < mesh.submeshes.size(); i++) {
+			auto& submesh = mesh.submeshes[i];
+			if (i == 0 || submesh.textureName != mesh.submeshes[i - 1].textureName) {
+				this->ranges.push_back(MaterialRange{ slots[i], {} });
+			}
+			auto end = submesh.firstIndex + submesh.indexCount;
+			auto boundsMin = mesh.vertices[mesh.index(submesh.firstIndex)];
+			auto boundsMax = boundsMin;
+			for (auto index = submesh.firstIndex; index < end; index++) {
+				boundsMin = glm::min(boundsMin, mesh.vertices[mesh.index(index)]);
+				boundsMax = glm::max(boundsMax, mesh.vertices[mesh.index(index)]);
+			}
+			auto chunk = Meshlet{ submesh.firstIndex, submesh.indexCount, (boundsMin + boundsMax) / 2.f, 0.f,
+				glm::vec3(0.f), 2.f };
+			chunk.radius = glm::length(boundsMax - boundsMin) / 2.f;
+			this->ranges.back().chunks.push_back(chunk);
+		}
+		this->batchCount = mesh.submeshes.size();
+	}
+
+	// Draw the chunks that culling, set up with the identity as the model matrix, lets through. Returns what was
+	// culled, each chunk counting as a meshlet
+	MeshletStats draw(int drawMode, MeshletCulling const& culling) const {
+		this->vao.bind();
+		gl_state::pointSize(3.f);
+		gl_state::polygonMode(drawMode == 1 ? GL_LINE : drawMode == 2 ? GL_POINT : GL_FILL);
+
+		auto stats = MeshletStats();
+		auto indexSize = IndexArray::indexSize(this->indices.getType());
+		for (auto& range : this->ranges) {
+			this->visibleCounts.clear();
+			this->visibleOffsets.clear();
+			culling.cull(range.chunks, indexSize, this->visibleCounts, this->visibleOffsets, stats);
+			if (this->visibleCounts.empty()) continue;
+			this->materials->bind(range.material);
+			this->indices.multiDraw(GL_TRIANGLES, this->visibleCounts, this->visibleOffsets);
+		}
+		return stats;
+	}
+
+	// Materials times the chunks holding each
+	size_t getBatchCount() const {
+		return this->batchCount;
+	}
+};
\ No newline at end of file
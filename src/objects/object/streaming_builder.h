@@ -0,0 +1,390 @@
+#pragma once
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <istream>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "../attribute_array.h"
+#include "data.h"
+#include "mesh_cache.h"
+#include "mesh_optimizer.h"
+#include "tangent_space.h"
+
+// Builds the final, deduplicated vertex and index streams of a mesh while its OBJ is being parsed,
+// without going through ObjectData or Object::Builder.
+//
+// A quick pre-pass over the file counts the attributes and face corners, so that a single
+// staging allocation can hold the OBJ's attribute pools, the output streams, and the key of every vertex and
+// material of every triangle.
+// Everything is then written in place by the tinyobj callbacks. The output streams are sized for the
+// worst case of no shared vertices, but the pages past the vertices actually written are never touched,
+// so they never become resident. Only the deduplication table is allocated separately, as it has to grow
+// when a mesh has many more unique vertices than positions.
+// The file itself is read through small buffers rather than mapped, so it never becomes resident either
+class StreamingBuilder {
+	// Marks an unused slot of the deduplication table
+	static const GLuint EMPTY = 0xFFFFFFFF;
+
+	// Reads material libraries as tinyobj does on its own, keeping the path of every one it read
+	class RecordingMaterialReader : public tinyobj::MaterialFileReader {
+	public:
+		std::vector<std::string> paths;
+
+		RecordingMaterialReader() : tinyobj::MaterialFileReader("") {}
+
+		bool operator()(
+			std::string const& path, std::vector<tinyobj::material_t>* materials,
+			std::map<std::string, int>* materialMap, std::string* warn, std::string* err
+		) override {
+			auto read = tinyobj::MaterialFileReader::operator()(path, materials, materialMap, warn, err);
+			if (read && std::find(this->paths.begin(), this->paths.end(), path) == this->paths.end()) {
+				this->paths.push_back(path);
+			}
+			return read;
+		}
+	};
+
+	// Number of each kind of line in an OBJ, as tinyobj would see them
+	struct Counts {
+		size_t positions;
+		size_t normals;
+		size_t texCoords;
+		size_t corners; // after triangulation
+	};
+
+	std::unique_ptr<unsigned char[]> staging;
+	glm::vec3* positionPool;
+	glm::vec3* normalPool;
+	glm::vec2* texCoordPool;
+	size_t positionCount;
+	size_t normalCount;
+	size_t texCoordCount;
+	glm::vec3* vertices;
+	glm::vec3* normals;
+	glm::vec2* texCoords;
+	GLuint* indices;
+	int* triangleMaterials;	// material of each triangle, as given to groupByMaterial
+	GLuint vertexCount;
+	size_t indexCount;
+	// Open-addressing table of output vertices, hashed by their vertex/normal/texCoord triplet.
+	// The triplets are stored per output vertex rather than per slot, to keep the table small
+	std::unique_ptr<GLuint[]> table;
+	size_t tableMask;
+	tinyobj::index_t* keys;
+	Counts capacity;
+	uint32_t streams;
+	int currentMaterial;
+	std::vector<std::string> textureNames;	// of each material in the OBJ's material libraries
+	std::vector<std::string> materialLibraries;	// paths of the libraries read
+	std::vector<Submesh> submeshes;
+	std::string error;
+
+public:
+	// Stream the OBJ at the given path. streams is a combination of MeshCache::NORMALS and
+	// MeshCache::TEX_COORDS, and corners only differing in the streams left out are merged
+	StreamingBuilder(char const* path, uint32_t streams) :
+		positionCount(0), normalCount(0), texCoordCount(0), vertexCount(0), indexCount(0), streams(streams),
+		currentMaterial(-1)
+	{
+		auto stream = std::ifstream(path, std::ios::binary);
+		if (!stream.is_open()) {
+			std::cerr << "fatal error while loading \"" << path << "\": cannot open file, exiting" << std::endl;
+			exit(1);
+		}
+		this->capacity = count(stream);
+		this->allocate();
+		stream.clear();
+		stream.seekg(0);
+
+		tinyobj::callback_t callback;
+		callback.vertex_cb = onPosition;
+		callback.normal_cb = onNormal;
+		callback.texcoord_cb = onTexCoord;
+		callback.index_cb = onFace;
+		callback.mtllib_cb = onMaterials;
+		callback.usemtl_cb = onUseMaterial;
+
+		RecordingMaterialReader materialReader;
+		std::string warn;
+		std::string err;
+		bool ret = tinyobj::LoadObjWithCallback(stream, callback, this, &materialReader, &warn, &err);
+		if (!warn.empty()) {
+			std::cerr << warn << std::endl;
+		}
+		if (!err.empty()) {
+			std::cerr << err << std::endl;
+		}
+		if (!ret || !this->error.empty()) {
+			std::cerr << "fatal error while loading \"" << path << "\": " << this->error << " Exiting" << std::endl;
+			exit(1);
+		}
+		this->materialLibraries = std::move(materialReader.paths);
+
+		if (streams & MeshCache::NORMALS) this->generateMissingNormals();
+
+		// Triangles were emitted in file order, so gather those sharing a material
+		this->submeshes = groupByMaterial(this->indices, this->indexCount, this->triangleMaterials, this->textureNames);
+		// Then reorder them, and the vertices, for the GPU
+		auto optimized = mesh_optimizer::optimize(
+			this->indices, this->indexCount, this->submeshes, this->vertices, this->vertexCount
+		);
+		mesh_optimizer::remapVertices(this->vertices, optimized.remap);
+		if (streams & MeshCache::NORMALS) mesh_optimizer::remapVertices(this->normals, optimized.remap);
+		if (streams & MeshCache::TEX_COORDS) mesh_optimizer::remapVertices(this->texCoords, optimized.remap);
+
+		size_t vertexSize = sizeof(glm::vec3);
+		if (streams & MeshCache::NORMALS) vertexSize += sizeof(glm::vec3);
+		if (streams & MeshCache::TEX_COORDS) vertexSize += sizeof(glm::vec2);
+		auto indexSize = IndexArray::indexSize(IndexArray::typeFor(this->indices, this->indexCount));
+		std::cout << path << ": " << this->indexCount << " -> " << this->vertexCount << " vertices, "
+			<< this->indexCount * vertexSize << " -> "
+			<< this->vertexCount * vertexSize + this->indexCount * indexSize << " bytes" << std::endl;
+		optimized.print(std::cout);
+	}
+
+	StreamingBuilder(StreamingBuilder const&) = delete;
+	StreamingBuilder& operator=(StreamingBuilder const&) = delete;
+	StreamingBuilder(StreamingBuilder&&) noexcept = default;
+	StreamingBuilder& operator=(StreamingBuilder&&) noexcept = default;
+
+	// Paths of the material libraries the OBJ's textures came from, which its cache depends on
+	std::vector<std::string> const& getMaterialLibraries() const {
+		return this->materialLibraries;
+	}
+
+	// View of the built streams, valid for as long as the builder is
+	MeshView view() const {
+		auto view = MeshView();
+		view.vertices = this->vertices;
+		view.normals = (this->streams & MeshCache::NORMALS) ? this->normals : nullptr;
+		view.texCoords = (this->streams & MeshCache::TEX_COORDS) ? this->texCoords : nullptr;
+		view.vertexCount = this->vertexCount;
+		view.indices = this->indices;
+		view.indexType = GL_UNSIGNED_INT;
+		view.indexCount = this->indexCount;
+		view.submeshes = this->submeshes;
+		if (this->vertexCount > 0) {
+			view.boundsMin = view.boundsMax = this->vertices[0];
+			for (GLuint i = 0; i < this->vertexCount; i++) {
+				view.boundsMin = glm::min(view.boundsMin, this->vertices[i]);
+				view.boundsMax = glm::max(view.boundsMax, this->vertices[i]);
+			}
+			computeBoundingSphere(
+				this->vertices, this->vertexCount, view.boundsMin, view.boundsMax, view.sphereCentre, view.sphereRadius
+			);
+		}
+		return view;
+	}
+
+private:
+	// Give the vertices whose corners had no normal an area-weighted one, shared by every such vertex at the same
+	// position. The callbacks do not report smoothing groups, so these normals are smooth across the whole mesh
+	void generateMissingNormals() {
+		auto groups = std::vector<GLuint>(this->vertexCount);
+		auto groupOfPosition = std::vector<GLuint>(this->positionCount, EMPTY);
+		bool missing = false;
+		for (GLuint vertex = 0; vertex < this->vertexCount; vertex++) {
+			groups[vertex] = vertex;
+			if (this->keys[vertex].normal_index >= 0) continue;
+			auto& group = groupOfPosition[this->keys[vertex].vertex_index];
+			if (group == EMPTY) group = vertex;
+			groups[vertex] = group;
+			missing = true;
+		}
+		if (!missing) return;
+
+		auto generated = tangent_space::generateNormals(
+			this->indices, this->indexCount, this->vertices, this->vertexCount, groups.data()
+		);
+		for (GLuint vertex = 0; vertex < this->vertexCount; vertex++) {
+			if (this->keys[vertex].normal_index < 0) this->normals[vertex] = generated[vertex];
+		}
+	}
+
+	// Count the lines of the stream the same way tinyobj::LoadObjWithCallback recognises them
+	static Counts count(std::istream& stream) {
+		Counts counts = {};
+		auto buffer = std::vector<char>(1 << 16);
+		size_t carried = 0; // bytes of an unfinished line, moved to the start of the buffer
+		while (stream) {
+			if (carried == buffer.size()) buffer.resize(buffer.size() * 2);
+			stream.read(buffer.data() + carried, buffer.size() - carried);
+			auto end = buffer.data() + carried + stream.gcount();
+			auto last = end;
+			if (stream) {
+				while (last > buffer.data() && last[-1] != '\n') last--;
+			}
+			countLines(buffer.data(), last, counts);
+			carried = end - last;
+			std::copy(last, end, buffer.data());
+		}
+		return counts;
+	}
+
+	static void countLines(char const* bytes, char const* end, Counts& counts) {
+		for (auto p = bytes; p < end;) {
+			auto lineEnd = (char const*)memchr(p, '\n', end - p);
+			if (!lineEnd) lineEnd = end;
+			while (p < lineEnd && (*p == ' ' || *p == '\t')) p++;
+			auto isSpace = [&](char const* c) { return c < lineEnd && (*c == ' ' || *c == '\t'); };
+
+			if (p < lineEnd && p[0] == 'v') {
+				if (isSpace(p + 1)) counts.positions++;
+				else if (p + 1 < lineEnd && p[1] == 'n' && isSpace(p + 2)) counts.normals++;
+				else if (p + 1 < lineEnd && p[1] == 't' && isSpace(p + 2)) counts.texCoords++;
+			} else if (p < lineEnd && p[0] == 'f' && isSpace(p + 1)) {
+				size_t corners = 0;
+				for (auto c = p + 2; c < lineEnd; c++) {
+					auto startsCorner = !(*c == ' ' || *c == '\t' || *c == '\r') && (c[-1] == ' ' || c[-1] == '\t');
+					corners += startsCorner;
+				}
+				if (corners >= 3) counts.corners += 3 * (corners - 2);
+			}
+			p = lineEnd + 1;
+		}
+	}
+
+	// Carve the attribute pools, output streams, vertex keys and triangle materials out of a single allocation
+	void allocate() {
+		auto& c = this->capacity;
+		size_t offsets[9];
+		size_t size = 0;
+		size_t sizes[9] = {
+			c.positions * sizeof(glm::vec3), c.normals * sizeof(glm::vec3), c.texCoords * sizeof(glm::vec2),
+			c.corners * sizeof(glm::vec3), c.corners * sizeof(glm::vec3), c.corners * sizeof(glm::vec2),
+			c.corners * sizeof(GLuint), c.corners * sizeof(tinyobj::index_t), c.corners / 3 * sizeof(int),
+		};
+		for (int i = 0; i < 9; i++) {
+			offsets[i] = size;
+			size += (sizes[i] + 15) & ~(size_t)15;
+		}
+		this->staging.reset(new unsigned char[size]);
+		auto base = this->staging.get();
+		this->positionPool = (glm::vec3*)(base + offsets[0]);
+		this->normalPool = (glm::vec3*)(base + offsets[1]);
+		this->texCoordPool = (glm::vec2*)(base + offsets[2]);
+		this->vertices = (glm::vec3*)(base + offsets[3]);
+		this->normals = (glm::vec3*)(base + offsets[4]);
+		this->texCoords = (glm::vec2*)(base + offsets[5]);
+		this->indices = (GLuint*)(base + offsets[6]);
+		this->keys = (tinyobj::index_t*)(base + offsets[7]);
+		this->triangleMaterials = (int*)(base + offsets[8]);
+
+		// Most meshes have about as many unique vertices as positions
+		this->resizeTable(std::max<size_t>(16, c.positions * 2));
+	}
+
+	// Rebuild the deduplication table with at least the given number of slots
+	void resizeTable(size_t minimumSize) {
+		size_t size = 16;
+		while (size < minimumSize) size *= 2;
+		this->table.reset(new GLuint[size]);
+		this->tableMask = size - 1;
+		std::fill(this->table.get(), this->table.get() + size, EMPTY);
+		for (GLuint vertex = 0; vertex < this->vertexCount; vertex++) {
+			auto slot = ObjectIndexHash()(this->keys[vertex]) & this->tableMask;
+			while (this->table[slot] != EMPTY) slot = (slot + 1) & this->tableMask;
+			this->table[slot] = vertex;
+		}
+	}
+
+	// Turn a raw 1-based or negative (relative) OBJ index into a 0-based one, or -1 if it is missing
+	static int resolve(int index, size_t count) {
+		if (index > 0) return index - 1;
+		if (index < 0) return (int)count + index;
+		return -1;
+	}
+
+	// Find or create the output vertex for the given face corner, and return its index
+	GLuint vertexFor(tinyobj::index_t corner) {
+		if (!(this->streams & MeshCache::NORMALS)) corner.normal_index = -1;
+		if (!(this->streams & MeshCache::TEX_COORDS)) corner.texcoord_index = -1;
+
+		// Keep the table at most half full
+		if (2 * (size_t)(this->vertexCount + 1) > this->tableMask + 1) {
+			this->resizeTable(4 * (size_t)(this->vertexCount + 1));
+		}
+
+		auto equal = ObjectIndexEqual();
+		for (auto slot = ObjectIndexHash()(corner) & this->tableMask;; slot = (slot + 1) & this->tableMask) {
+			auto vertex = this->table[slot];
+			if (vertex == EMPTY) {
+				vertex = this->vertexCount++;
+				this->vertices[vertex] = this->positionPool[corner.vertex_index];
+				this->normals[vertex] = corner.normal_index >= 0 ?
+					this->normalPool[corner.normal_index] : glm::vec3(0.f);
+				this->texCoords[vertex] = corner.texcoord_index >= 0 ?
+					this->texCoordPool[corner.texcoord_index] : glm::vec2(0.f);
+				this->keys[vertex] = corner;
+				this->table[slot] = vertex;
+				return vertex;
+			}
+			if (equal(this->keys[vertex], corner)) return vertex;
+		}
+	}
+
+	static void onPosition(void* data, tinyobj::real_t x, tinyobj::real_t y, tinyobj::real_t z, tinyobj::real_t) {
+		auto self = (StreamingBuilder*)data;
+		if (self->positionCount < self->capacity.positions) {
+			self->positionPool[self->positionCount++] = glm::vec3(x, y, z);
+		}
+	}
+	static void onNormal(void* data, tinyobj::real_t x, tinyobj::real_t y, tinyobj::real_t z) {
+		auto self = (StreamingBuilder*)data;
+		if (self->normalCount < self->capacity.normals) {
+			self->normalPool[self->normalCount++] = glm::vec3(x, y, z);
+		}
+	}
+	static void onTexCoord(void* data, tinyobj::real_t x, tinyobj::real_t y, tinyobj::real_t) {
+		auto self = (StreamingBuilder*)data;
+		if (self->texCoordCount < self->capacity.texCoords) {
+			self->texCoordPool[self->texCoordCount++] = glm::vec2(x, y);
+		}
+	}
+
+	// Fan-triangulate the face, and emit its corners
+	static void onFace(void* data, tinyobj::index_t* corners, int cornerCount) {
+		auto self = (StreamingBuilder*)data;
+		for (int c = 0; c < cornerCount; c++) {
+			auto& corner = corners[c];
+			corner.vertex_index = resolve(corner.vertex_index, self->positionCount);
+			corner.normal_index = resolve(corner.normal_index, self->normalCount);
+			corner.texcoord_index = resolve(corner.texcoord_index, self->texCoordCount);
+			if (corner.vertex_index < 0 || (size_t)corner.vertex_index >= self->positionCount ||
+				corner.normal_index >= (int)self->normalCount || corner.texcoord_index >= (int)self->texCoordCount
+			) {
+				self->error = "Face index out of bounds.";
+				return;
+			}
+		}
+		for (int c = 2; c < cornerCount; c++) {
+			if (self->indexCount + 3 > self->capacity.corners) {
+				self->error = "More face corners than counted.";
+				return;
+			}
+			self->triangleMaterials[self->indexCount / 3] = self->currentMaterial;
+			self->indices[self->indexCount++] = self->vertexFor(corners[0]);
+			self->indices[self->indexCount++] = self->vertexFor(corners[c - 1]);
+			self->indices[self->indexCount++] = self->vertexFor(corners[c]);
+		}
+	}
+
+	// Called with every material loaded so far, each time a material library is loaded
+	static void onMaterials(void* data, tinyobj::material_t const* materials, int materialCount) {
+		auto self = (StreamingBuilder*)data;
+		self->textureNames.clear();
+		for (int i = 0; i < materialCount; i++) { self->textureNames.push_back(materials[i].diffuse_texname); }
+	}
+	static void onUseMaterial(void* data, char const*, int material) {
+		((StreamingBuilder*)data)->currentMaterial = material;
+	}
+};
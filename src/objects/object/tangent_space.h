@@ -0,0 +1,218 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TANGENT_SPACE_USE_SSE2
+#include <emmintrin.h>
+#endif
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "../../thread_pool.h"
+
+// Normals and tangents generated from a mesh's triangles, for OBJs that leave them out and for normal mapping.
+//
+// Each stage runs in two passes: one over triangles, four at a time with SSE2, working out what each triangle
+// contributes, and one over vertices, each gathering the contributions of its own triangles. Gathering rather
+// than scattering means no two threads ever write to the same vertex, so both passes split across threads
+// on large meshes
+namespace tangent_space {
+
+	// Triangles or vertices per thread below which a pass stays on the calling thread
+	const size_t MIN_SLICE = 16384;
+
+	// The triangles around each vertex, as a list of triangles per vertex. Vertices given the same group share
+	// their list, so that vertices only split by their texture coordinates see the same triangles
+	struct Adjacency {
+		std::vector<GLuint> offsets;	// into triangles, one more than there are vertices
+		std::vector<GLuint> triangles;
+
+		Adjacency(GLuint const* indices, size_t indexCount, size_t vertexCount, GLuint const* groups = nullptr) :
+			offsets(vertexCount + 1, 0), triangles(indexCount)
+		{
+			auto group = [&](GLuint v) { return groups ? groups[v] : v; };
+			for (size_t i = 0; i < indexCount; i++) { this->offsets[group(indices[i]) + 1]++; }
+			for (size_t v = 0; v < vertexCount; v++) { this->offsets[v + 1] += this->offsets[v]; }
+			auto fill = std::vector<GLuint>(this->offsets.begin(), this->offsets.end() - 1);
+			for (size_t i = 0; i < indexCount; i++) { this->triangles[fill[group(indices[i])]++] = (GLuint)(i / 3); }
+		}
+	};
+
+#ifdef TANGENT_SPACE_USE_SSE2
+	// One component of one corner of four consecutive triangles, one triangle per lane
+	template<typename Vector>
+	inline __m128 gather(Vector const* values, GLuint const* indices, size_t triangle, int corner, int component) {
+		auto i = indices + 3 * triangle + corner;
+		return _mm_setr_ps(
+			values[i[0]][component], values[i[3]][component], values[i[6]][component], values[i[9]][component]
+		);
+	}
+
+	// The edges from the first corner to the other two, for four triangles
+	template<typename Vector, int N>
+	inline void edges(
+		Vector const* values, GLuint const* indices, size_t triangle, __m128 (&first)[N], __m128 (&second)[N]
+	) {
+		for (int c = 0; c < N; c++) {
+			auto origin = gather(values, indices, triangle, 0, c);
+			first[c] = _mm_sub_ps(gather(values, indices, triangle, 1, c), origin);
+			second[c] = _mm_sub_ps(gather(values, indices, triangle, 2, c), origin);
+		}
+	}
+
+	inline void store(__m128 x, __m128 y, __m128 z, glm::vec3* out) {
+		float xs[4], ys[4], zs[4];
+		_mm_storeu_ps(xs, x);
+		_mm_storeu_ps(ys, y);
+		_mm_storeu_ps(zs, z);
+		for (int i = 0; i < 4; i++) { out[i] = glm::vec3(xs[i], ys[i], zs[i]); }
+	}
+#endif
+
+	// The cross product of two edges of each triangle in [begin, end): its normal scaled by twice its area
+	inline void faceNormals(GLuint const* indices, size_t begin, size_t end, glm::vec3 const* positions, glm::vec3* out) {
+		auto t = begin;
+#ifdef TANGENT_SPACE_USE_SSE2
+		for (; t + 4 <= end; t += 4) {
+			__m128 a[3], b[3];
+			edges(positions, indices, t, a, b);
+			store(
+				_mm_sub_ps(_mm_mul_ps(a[1], b[2]), _mm_mul_ps(a[2], b[1])),
+				_mm_sub_ps(_mm_mul_ps(a[2], b[0]), _mm_mul_ps(a[0], b[2])),
+				_mm_sub_ps(_mm_mul_ps(a[0], b[1]), _mm_mul_ps(a[1], b[0])),
+				out + t
+			);
+		}
+#endif
+		for (; t < end; t++) {
+			auto p = positions[indices[3 * t]];
+			out[t] = glm::cross(positions[indices[3 * t + 1]] - p, positions[indices[3 * t + 2]] - p);
+		}
+	}
+
+	// The direction of increasing u across each triangle in [begin, end), unnormalised, and the orientation of
+	// its texture mapping: 1, or -1 where the texture is mirrored, or 0 where it is degenerate
+	inline void faceTangents(
+		GLuint const* indices, size_t begin, size_t end, glm::vec3 const* positions, glm::vec2 const* texCoords,
+		glm::vec3* out, float* orientations
+	) {
+		auto t = begin;
+#ifdef TANGENT_SPACE_USE_SSE2
+		for (; t + 4 <= end; t += 4) {
+			__m128 d1[3], d2[3], t1[2], t2[2];
+			edges(positions, indices, t, d1, d2);
+			edges(texCoords, indices, t, t1, t2);
+			// Twice the signed area of the triangle in texture space gives the orientation, and
+			// orientation * (t2.v * d1 - t1.v * d2) the tangent
+			auto area = _mm_sub_ps(_mm_mul_ps(t1[0], t2[1]), _mm_mul_ps(t1[1], t2[0]));
+			auto positive = _mm_and_ps(_mm_cmpgt_ps(area, _mm_setzero_ps()), _mm_set1_ps(1.f));
+			auto negative = _mm_and_ps(_mm_cmplt_ps(area, _mm_setzero_ps()), _mm_set1_ps(1.f));
+			auto orientation = _mm_sub_ps(positive, negative);
+			_mm_storeu_ps(orientations + t, orientation);
+			__m128 tangent[3];
+			for (int c = 0; c < 3; c++) {
+				tangent[c] = _mm_mul_ps(orientation, _mm_sub_ps(_mm_mul_ps(t2[1], d1[c]), _mm_mul_ps(t1[1], d2[c])));
+			}
+			store(tangent[0], tangent[1], tangent[2], out + t);
+		}
+#endif
+		for (; t < end; t++) {
+			auto p = positions[indices[3 * t]];
+			auto uv = texCoords[indices[3 * t]];
+			auto d1 = positions[indices[3 * t + 1]] - p;
+			auto d2 = positions[indices[3 * t + 2]] - p;
+			auto t1 = texCoords[indices[3 * t + 1]] - uv;
+			auto t2 = texCoords[indices[3 * t + 2]] - uv;
+			auto area = t1.x * t2.y - t1.y * t2.x;
+			orientations[t] = area > 0.f ? 1.f : area < 0.f ? -1.f : 0.f;
+			out[t] = orientations[t] * (t2.y * d1 - t1.y * d2);
+		}
+	}
+
+	// Area-weighted smooth normals: each vertex gets the sum of the face normals of its triangles, each as long
+	// as its triangle is large. groups, if given, holds for each vertex the vertex whose normal it shares, so that
+	// vertices split by their texture coordinates or another stream do not split the shading with them
+	inline std::vector<glm::vec3> generateNormals(
+		GLuint const* indices, size_t indexCount, glm::vec3 const* positions, size_t vertexCount,
+		GLuint const* groups = nullptr
+	) {
+		auto triangleCount = indexCount / 3;
+		auto faces = std::vector<glm::vec3>(triangleCount);
+		parallelFor(triangleCount, MIN_SLICE, [&](size_t begin, size_t end) {
+			faceNormals(indices, begin, end, positions, faces.data());
+		});
+
+		auto adjacency = Adjacency(indices, indexCount, vertexCount, groups);
+		auto normals = std::vector<glm::vec3>(vertexCount);
+		parallelFor(vertexCount, MIN_SLICE, [&](size_t begin, size_t end) {
+			for (auto v = begin; v < end; v++) {
+				auto group = groups ? groups[v] : (GLuint)v;
+				auto sum = glm::vec3(0.f);
+				for (auto t = adjacency.offsets[group]; t < adjacency.offsets[group + 1]; t++) {
+					sum += faces[adjacency.triangles[t]];
+				}
+				auto length = glm::length(sum);
+				normals[v] = length > 0.f ? sum / length : glm::vec3(0.f, 1.f, 0.f);
+			}
+		});
+		return normals;
+	}
+
+	// Any unit vector perpendicular to n
+	inline glm::vec3 perpendicular(glm::vec3 n) {
+		auto axis = std::abs(n.x) < 0.9f ? glm::vec3(1.f, 0.f, 0.f) : glm::vec3(0.f, 1.f, 0.f);
+		return glm::normalize(glm::cross(n, axis));
+	}
+
+	// Tangents as MikkTSpace builds them: each triangle's tangent is projected onto the plane of the vertex normal,
+	// normalised, and weighted by the angle of the triangle's corner at the vertex. w holds the handedness of the
+	// texture mapping, so that the shader rebuilds the bitangent as w * cross(normal, tangent).
+	// MikkTSpace splits vertices where mirrored and unmirrored triangles meet; here the vertex keeps the
+	// handedness of most of its corners by angle instead, as the vertex streams are already final
+	inline std::vector<glm::vec4> generateTangents(
+		GLuint const* indices, size_t indexCount, glm::vec3 const* positions, glm::vec3 const* normals,
+		glm::vec2 const* texCoords, size_t vertexCount
+	) {
+		auto triangleCount = indexCount / 3;
+		auto faces = std::vector<glm::vec3>(triangleCount);
+		auto orientations = std::vector<float>(triangleCount);
+		parallelFor(triangleCount, MIN_SLICE, [&](size_t begin, size_t end) {
+			faceTangents(indices, begin, end, positions, texCoords, faces.data(), orientations.data());
+		});
+
+		auto adjacency = Adjacency(indices, indexCount, vertexCount);
+		auto tangents = std::vector<glm::vec4>(vertexCount);
+		parallelFor(vertexCount, MIN_SLICE, [&](size_t begin, size_t end) {
+			for (auto v = begin; v < end; v++) {
+				auto n = normals[v];
+				auto sum = glm::vec3(0.f);
+				float handedness = 0.f;
+				for (auto a = adjacency.offsets[v]; a < adjacency.offsets[v + 1]; a++) {
+					auto t = adjacency.triangles[a];
+					if (orientations[t] == 0.f) continue;
+					auto projected = faces[t] - n * glm::dot(n, faces[t]);
+					auto length = glm::length(projected);
+					if (length == 0.f) continue;
+
+					auto corner = indices[3 * t] == v ? 0 : indices[3 * t + 1] == v ? 1 : 2;
+					auto p = positions[v];
+					auto e1 = positions[indices[3 * t + (corner + 1) % 3]] - p;
+					auto e2 = positions[indices[3 * t + (corner + 2) % 3]] - p;
+					auto lengths = glm::length(e1) * glm::length(e2);
+					if (lengths == 0.f) continue;
+					auto angle = std::acos(glm::clamp(glm::dot(e1, e2) / lengths, -1.f, 1.f));
+
+					sum += projected / length * angle;
+					handedness += orientations[t] * angle;
+				}
+				auto length = glm::length(sum);
+				tangents[v] = glm::vec4(length > 0.f ? sum / length : perpendicular(n), handedness < 0.f ? -1.f : 1.f);
+			}
+		});
+		return tangents;
+	}
+}
\ No newline at end of file
@@ -9,6 +9,8 @@
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 
+#include "gl_state.h"
+
 class UniformLocation {
 	friend class Program;
 	GLuint location;
@@ -19,6 +21,10 @@ public:
 	void set(GLuint _1ui) {
 		glUniform1ui(this->location, _1ui);
 	}
+	// Samplers take their texture unit as a signed int, and glUniform1ui fails on them
+	void setSampler(GLuint unit) {
+		glUniform1i(this->location, (GLint)unit);
+	}
 	void set(glm::vec3 _3fv) {
 		glUniform3fv(this->location, 1, &_3fv[0]);
 	}
@@ -27,6 +33,12 @@ public:
 	}
 };
 
+// A member of a uniform block as the C++ struct mirroring the block lays it out
+struct UniformBlockMember {
+	char const* name;
+	GLint offset;
+};
+
 class Program {
 public:
 	GLuint program;
@@ -86,12 +98,12 @@ public:
 		return *this;
 	}
 	~Program() {
-		if (this->program != -1) glDeleteProgram(this->program);
+		if (this->program != -1) gl_state::deleteProgram(this->program);
 	}
 
 	void use() const {
 		assert(this->program != -1);
-		glUseProgram(this->program);
+		gl_state::useProgram(this->program);
 	}
 
 	UniformLocation getUniformLocation(char const* name) const {
@@ -99,6 +111,39 @@ public:
 		return UniformLocation(glGetUniformLocation(this->program, name));
 	}
 
+	// Attach the uniform block Block::name() to Block::BINDING, after checking that the GLSL block has the size
+	// and the member offsets Block::members() lists. A program that does not use the block is left as it is
+	template<typename Block>
+	void bindUniformBlock() const {
+		assert(this->program != (GLuint)-1);
+		auto index = glGetUniformBlockIndex(this->program, Block::name());
+		if (index == GL_INVALID_INDEX) return;
+
+		auto members = Block::members();
+		GLint size, memberCount;
+		glGetActiveUniformBlockiv(this->program, index, GL_UNIFORM_BLOCK_DATA_SIZE, &size);
+		glGetActiveUniformBlockiv(this->program, index, GL_UNIFORM_BLOCK_ACTIVE_UNIFORMS, &memberCount);
+		if (size != (GLint)sizeof(Block) || memberCount != (GLint)members.size()) {
+			std::cerr << "Uniform block " << Block::name() << " has " << memberCount << " members in " << size
+				<< " bytes, but its struct has " << members.size() << " in " << sizeof(Block) << std::endl;
+			exit(1);
+		}
+		for (auto& member : members) {
+			GLuint uniform;
+			glGetUniformIndices(this->program, 1, &member.name, &uniform);
+			GLint offset = -1;
+			if (uniform != GL_INVALID_INDEX) {
+				glGetActiveUniformsiv(this->program, 1, &uniform, GL_UNIFORM_OFFSET, &offset);
+			}
+			if (offset != member.offset) {
+				std::cerr << "Uniform block " << Block::name() << " has " << member.name << " at offset " << offset
+					<< ", but its struct has it at " << member.offset << std::endl;
+				exit(1);
+			}
+		}
+		glUniformBlockBinding(this->program, index, Block::BINDING);
+	}
+
 private:
 	// Build a single shader as the specified shader type, and return its ID.
 	static GLuint buildShader(GLenum shaderType, const std::string& shaderText) {
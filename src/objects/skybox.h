@@ -3,12 +3,15 @@
 #include <glad/glad.h>
 
 #include "attribute_array.h"
+#include "gl_state.h"
 #include "program.h"
+#include "vertex_array_object.h"
 #include "texture/cubemap.h"
 
 class Skybox {
     Cubemap cubemap;
     VertexArray vertices;
+    VertexArrayObject vao;
 
     static constexpr std::array<glm::vec3, 36> VERTICES = {
         glm::vec3(-1.0f,  1.0f, -1.0f),
@@ -54,9 +57,13 @@ class Skybox {
         glm::vec3( 1.0f, -1.0f,  1.0f)
     };
 
+    VertexArrayObject recordVertices() const {
+        return VertexArrayObject([this] { this->vertices.bind(); });
+    }
+
 public:
     explicit Skybox(std::array<const char*, 6> faces) :
-        vertices(VertexArray(VERTICES))
+        vertices(VertexArray(VERTICES)), vao(this->recordVertices())
     {
         std::array<Image, 6> images;
         for (int i = 0; i < 6; i++) {
@@ -64,23 +71,33 @@ public:
         }
         this->cubemap = Cubemap(images);
     }
+    // Upload already decoded faces, in the same order as above
+    explicit Skybox(std::array<Image, 6> const& faces) :
+        cubemap(Cubemap(faces)), vertices(VertexArray(VERTICES)), vao(this->recordVertices())
+    {}
+    // Upload faces whose mip chains are already built, in the same order as above
+    explicit Skybox(std::array<MipChain, 6> const& faces) :
+        cubemap(Cubemap(faces)), vertices(VertexArray(VERTICES)), vao(this->recordVertices())
+    {}
+    // Upload a cubemap cooked with --compress
+    explicit Skybox(CompressedImage const& faces) :
+        cubemap(Cubemap(faces)), vertices(VertexArray(VERTICES)), vao(this->recordVertices())
+    {}
     Skybox(Skybox const&) = delete;
     Skybox& operator=(Skybox const&) = delete;
     Skybox(Skybox&&) noexcept = default;
     Skybox& operator=(Skybox&& from) = default;
 
     void draw(int drawMode) const {
-        this->vertices.bind();
+        this->vao.bind();
         this->cubemap.bind();
 
-        glDepthFunc(GL_LEQUAL);
-
-        if (drawMode == 1) { glPolygonMode(GL_FRONT_AND_BACK, GL_LINE); }
-        else { glPolygonMode(GL_FRONT_AND_BACK, GL_FILL); }
+        // The skybox is drawn at the far plane, which GL_LESS would clip away. The depth function is left as it
+        // is afterwards, as GL_LEQUAL does for everything else too, rather than flipped back every frame
+        gl_state::depthFunc(GL_LEQUAL);
+        gl_state::polygonMode(drawMode == 1 ? GL_LINE : GL_FILL);
 
         if (drawMode == 2) { glDrawArrays(GL_POINTS, 0, VERTICES.size()); } 
         else { glDrawArrays(GL_TRIANGLES, 0, VERTICES.size()); }
-
-        glDepthFunc(GL_LESS);
     }
 };
\ No newline at end of file
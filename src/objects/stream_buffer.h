@@ -0,0 +1,68 @@
+#pragma once
+
+#include <algorithm>
+#include <utility>
+
+#include <glad/glad.h>
+
+#include "gl_state.h"
+
+// A buffer the CPU refills every frame and the GPU reads that frame. Each upload orphans the old storage rather
+// than writing over it, so that it does not wait for draws still reading the last frame's data. Storage only
+// grows, and the name never changes, so vertex array objects recorded with it stay valid
+class StreamBuffer {
+	GLuint name;
+	GLenum target;	// bound to for uploads
+	size_t capacity;	// in bytes
+
+public:
+	StreamBuffer() : name(0), target(GL_ARRAY_BUFFER), capacity(0) {}
+
+	explicit StreamBuffer(GLenum target) : target(target), capacity(0) {
+		glGenBuffers(1, &this->name);
+		this->bind();
+		glBufferData(this->target, 0, nullptr, GL_STREAM_DRAW);
+	}
+
+	StreamBuffer(StreamBuffer const&) = delete;
+	StreamBuffer& operator=(StreamBuffer const&) = delete;
+	StreamBuffer(StreamBuffer&& from) noexcept : StreamBuffer() {
+		*this = std::move(from);
+	}
+	// Deletes the buffer this held, if any, and leaves from owning none, with name 0
+	StreamBuffer& operator=(StreamBuffer&& from) noexcept {
+		if (this == &from) return *this;
+		if (this->name != 0) { gl_state::deleteBuffer(this->name); }
+		this->name = from.name;
+		this->target = from.target;
+		this->capacity = from.capacity;
+		from.name = 0;
+		return *this;
+	}
+	~StreamBuffer() {
+		if (this->name != 0) { gl_state::deleteBuffer(this->name); }
+	}
+
+	// Replace the contents with size bytes of data. Leaves the buffer bound to its target
+	void upload(void const* data, size_t size) {
+		this->bind();
+		this->capacity = std::max(this->capacity, size);
+		glBufferData(this->target, this->capacity, nullptr, GL_STREAM_DRAW);
+		glBufferSubData(this->target, 0, size, data);
+	}
+
+	// Overwrite size bytes from offset, keeping the rest, within what the last upload allocated. Unlike an upload,
+	// this may wait for draws still reading the buffer, so it suits small changes to data kept across frames
+	void update(size_t offset, void const* data, size_t size) {
+		this->bind();
+		glBufferSubData(this->target, offset, size, data);
+	}
+
+	// Bind to the buffer's own target, or to another, as when pointing attributes at it
+	void bind() const {
+		this->bind(this->target);
+	}
+	void bind(GLenum target) const {
+		gl_state::bindBuffer(target, this->name);
+	}
+};
\ No newline at end of file
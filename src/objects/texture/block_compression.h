@@ -0,0 +1,483 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define BC_USE_SSE2
+#include <emmintrin.h>
+#endif
+
+// Encoders and decoders for the block-compressed texture formats BC1, BC3, BC4, BC5 and BC7.
+// Every block covers 4x4 pixels, given to and returned from these functions as 16 row-major RGBA8 pixels.
+//
+// The encoders fit endpoints along the principal axis of the block's colours, refine them with a
+// least-squares fit to the chosen indices, and keep whichever of the two fits has the smaller error.
+// BC7 blocks are always encoded in mode 6 (one subset, RGBA endpoints, 16 levels), which is the mode that
+// suits smooth photographic textures best; the BC7 decoder only handles that mode
+namespace bc {
+
+	const int BLOCK_PIXELS = 16;
+
+	// A block with each of its channels in a separate array, the layout the SIMD index search works on
+	struct Block {
+		alignas(16) float channels[4][BLOCK_PIXELS];
+
+		explicit Block(unsigned char const* rgba) {
+			for (int i = 0; i < BLOCK_PIXELS; i++) {
+				for (int c = 0; c < 4; c++) { this->channels[c][i] = rgba[4 * i + c]; }
+			}
+		}
+	};
+
+	// Index of the nearest palette entry for each pixel, by squared distance over the first channelCount
+	// channels starting at firstChannel. Returns the total squared error
+	inline float nearestIndices(
+		Block const& block, int firstChannel, int channelCount,
+		float const (*palette)[4], int paletteSize, uint8_t* indices
+	) {
+		float error = 0.f;
+#ifdef BC_USE_SSE2
+		for (int group = 0; group < BLOCK_PIXELS; group += 4) {
+			auto best = _mm_set1_ps(INFINITY);
+			auto bestIndex = _mm_setzero_si128();
+			for (int p = 0; p < paletteSize; p++) {
+				auto distance = _mm_setzero_ps();
+				for (int c = 0; c < channelCount; c++) {
+					auto pixel = _mm_load_ps(&block.channels[firstChannel + c][group]);
+					auto difference = _mm_sub_ps(pixel, _mm_set1_ps(palette[p][firstChannel + c]));
+					distance = _mm_add_ps(distance, _mm_mul_ps(difference, difference));
+				}
+				auto closer = _mm_castps_si128(_mm_cmplt_ps(distance, best));
+				best = _mm_min_ps(distance, best);
+				bestIndex = _mm_or_si128(
+					_mm_and_si128(closer, _mm_set1_epi32(p)), _mm_andnot_si128(closer, bestIndex)
+				);
+			}
+			alignas(16) int32_t groupIndices[4];
+			alignas(16) float groupErrors[4];
+			_mm_store_si128((__m128i*)groupIndices, bestIndex);
+			_mm_store_ps(groupErrors, best);
+			for (int i = 0; i < 4; i++) {
+				indices[group + i] = (uint8_t)groupIndices[i];
+				error += groupErrors[i];
+			}
+		}
+#else
+		for (int i = 0; i < BLOCK_PIXELS; i++) {
+			float best = INFINITY;
+			for (int p = 0; p < paletteSize; p++) {
+				float distance = 0.f;
+				for (int c = firstChannel; c < firstChannel + channelCount; c++) {
+					float difference = block.channels[c][i] - palette[p][c];
+					distance += difference * difference;
+				}
+				if (distance < best) {
+					best = distance;
+					indices[i] = (uint8_t)p;
+				}
+			}
+			error += best;
+		}
+#endif
+		return error;
+	}
+
+	// Endpoints of the segment spanning the block's pixels along their principal axis
+	inline void principalEndpoints(Block const& block, int firstChannel, int channelCount, float* low, float* high) {
+		float mean[4] = {};
+		for (int c = 0; c < channelCount; c++) {
+			for (int i = 0; i < BLOCK_PIXELS; i++) { mean[c] += block.channels[firstChannel + c][i]; }
+			mean[c] /= BLOCK_PIXELS;
+		}
+		float covariance[4][4] = {};
+		for (int i = 0; i < BLOCK_PIXELS; i++) {
+			for (int a = 0; a < channelCount; a++) {
+				for (int b = 0; b < channelCount; b++) {
+					covariance[a][b] +=
+						(block.channels[firstChannel + a][i] - mean[a]) * (block.channels[firstChannel + b][i] - mean[b]);
+				}
+			}
+		}
+		// Power iteration, starting from the diagonal of the bounding box
+		float axis[4] = {};
+		for (int c = 0; c < channelCount; c++) {
+			auto channel = block.channels[firstChannel + c];
+			axis[c] = *std::max_element(channel, channel + BLOCK_PIXELS) - *std::min_element(channel, channel + BLOCK_PIXELS);
+		}
+		for (int iteration = 0; iteration < 8; iteration++) {
+			float next[4] = {};
+			float length = 0.f;
+			for (int a = 0; a < channelCount; a++) {
+				for (int b = 0; b < channelCount; b++) { next[a] += covariance[a][b] * axis[b]; }
+				length = std::max(length, std::fabs(next[a]));
+			}
+			if (length < 1e-6f) break;
+			for (int c = 0; c < channelCount; c++) { axis[c] = next[c] / length; }
+		}
+
+		float minT = 0.f;
+		float maxT = 0.f;
+		float axisLength = 0.f;
+		for (int c = 0; c < channelCount; c++) { axisLength += axis[c] * axis[c]; }
+		if (axisLength > 1e-12f) {
+			minT = INFINITY;
+			maxT = -INFINITY;
+			for (int i = 0; i < BLOCK_PIXELS; i++) {
+				float t = 0.f;
+				for (int c = 0; c < channelCount; c++) { t += (block.channels[firstChannel + c][i] - mean[c]) * axis[c]; }
+				minT = std::min(minT, t / axisLength);
+				maxT = std::max(maxT, t / axisLength);
+			}
+		}
+		for (int c = 0; c < channelCount; c++) {
+			low[c] = std::min(255.f, std::max(0.f, mean[c] + axis[c] * minT));
+			high[c] = std::min(255.f, std::max(0.f, mean[c] + axis[c] * maxT));
+		}
+	}
+
+	// Least-squares endpoints for the given indices, where weights[i] is how far index i lies from the first
+	// endpoint towards the second. Returns false if the indices do not constrain both endpoints
+	inline bool fitEndpoints(
+		Block const& block, int firstChannel, int channelCount,
+		uint8_t const* indices, float const* weights, float* first, float* second
+	) {
+		float alpha2 = 0.f, beta2 = 0.f, alphaBeta = 0.f;
+		float alphaX[4] = {}, betaX[4] = {};
+		for (int i = 0; i < BLOCK_PIXELS; i++) {
+			float beta = weights[indices[i]];
+			float alpha = 1.f - beta;
+			alpha2 += alpha * alpha;
+			beta2 += beta * beta;
+			alphaBeta += alpha * beta;
+			for (int c = 0; c < channelCount; c++) {
+				alphaX[c] += alpha * block.channels[firstChannel + c][i];
+				betaX[c] += beta * block.channels[firstChannel + c][i];
+			}
+		}
+		float determinant = alpha2 * beta2 - alphaBeta * alphaBeta;
+		if (std::fabs(determinant) < 1e-6f) return false;
+		for (int c = 0; c < channelCount; c++) {
+			first[c] = std::min(255.f, std::max(0.f, (alphaX[c] * beta2 - betaX[c] * alphaBeta) / determinant));
+			second[c] = std::min(255.f, std::max(0.f, (betaX[c] * alpha2 - alphaX[c] * alphaBeta) / determinant));
+		}
+		return true;
+	}
+
+	// Reads and writes of little-endian bit fields, least significant bit first
+	inline void writeBits(uint8_t* bytes, int& position, uint32_t value, int bitCount) {
+		for (int i = 0; i < bitCount; i++, position++) {
+			if ((value >> i) & 1) bytes[position / 8] |= (uint8_t)(1 << (position % 8));
+		}
+	}
+	inline uint32_t readBits(uint8_t const* bytes, int& position, int bitCount) {
+		uint32_t value = 0;
+		for (int i = 0; i < bitCount; i++, position++) {
+			value |= (uint32_t)((bytes[position / 8] >> (position % 8)) & 1) << i;
+		}
+		return value;
+	}
+
+	// BC1 ------------------------------------------------------------------------------------------------
+
+	inline uint16_t to565(float const* rgb) {
+		auto r = (uint16_t)std::lround(rgb[0] * 31.f / 255.f);
+		auto g = (uint16_t)std::lround(rgb[1] * 63.f / 255.f);
+		auto b = (uint16_t)std::lround(rgb[2] * 31.f / 255.f);
+		return (uint16_t)((r << 11) | (g << 5) | b);
+	}
+	inline void from565(uint16_t colour, int* rgb) {
+		int r = (colour >> 11) & 31, g = (colour >> 5) & 63, b = colour & 31;
+		rgb[0] = (r << 3) | (r >> 2);
+		rgb[1] = (g << 2) | (g >> 4);
+		rgb[2] = (b << 3) | (b >> 2);
+	}
+
+	// The four colours a BC1 block can pick from, as the decoder computes them
+	inline void bc1Palette(uint16_t colour0, uint16_t colour1, int (*palette)[4]) {
+		from565(colour0, palette[0]);
+		from565(colour1, palette[1]);
+		palette[0][3] = palette[1][3] = palette[2][3] = 255;
+		palette[3][3] = colour0 > colour1 ? 255 : 0;
+		for (int c = 0; c < 3; c++) {
+			if (colour0 > colour1) {
+				palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+				palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+			} else {
+				palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+				palette[3][c] = 0;
+			}
+		}
+	}
+
+	// Evaluate a pair of endpoints in four-colour mode, returning the error and filling in the indices
+	inline float bc1Evaluate(Block const& block, uint16_t colour0, uint16_t colour1, uint8_t* indices) {
+		int palette[4][4];
+		bc1Palette(colour0, colour1, palette);
+		float palettef[4][4];
+		for (int p = 0; p < 4; p++) {
+			for (int c = 0; c < 4; c++) { palettef[p][c] = (float)palette[p][c]; }
+		}
+		return nearestIndices(block, 0, 3, palettef, colour0 == colour1 ? 1 : 4, indices);
+	}
+
+	// Encode the colour of a block, ignoring its alpha, into 8 bytes
+	inline void encodeBC1(unsigned char const* rgba, uint8_t* out) {
+		auto block = Block(rgba);
+		static const float WEIGHTS[4] = { 0.f, 1.f, 1.f / 3.f, 2.f / 3.f };
+
+		float low[4], high[4];
+		principalEndpoints(block, 0, 3, low, high);
+		uint16_t bestColours[2] = { to565(high), to565(low) };
+		uint8_t bestIndices[BLOCK_PIXELS] = {};
+		if (bestColours[0] < bestColours[1]) std::swap(bestColours[0], bestColours[1]);
+		float bestError = bc1Evaluate(block, bestColours[0], bestColours[1], bestIndices);
+
+		for (int iteration = 0; iteration < 2; iteration++) {
+			float first[4], second[4];
+			if (!fitEndpoints(block, 0, 3, bestIndices, WEIGHTS, first, second)) break;
+			uint16_t colours[2] = { to565(first), to565(second) };
+			if (colours[0] < colours[1]) std::swap(colours[0], colours[1]);
+			uint8_t indices[BLOCK_PIXELS];
+			float error = bc1Evaluate(block, colours[0], colours[1], indices);
+			if (error >= bestError) break;
+			bestError = error;
+			bestColours[0] = colours[0];
+			bestColours[1] = colours[1];
+			std::copy(indices, indices + BLOCK_PIXELS, bestIndices);
+		}
+
+		uint32_t packed = 0;
+		for (int i = 0; i < BLOCK_PIXELS; i++) { packed |= (uint32_t)bestIndices[i] << (2 * i); }
+		memcpy(out, &bestColours[0], 2);
+		memcpy(out + 2, &bestColours[1], 2);
+		memcpy(out + 4, &packed, 4);
+	}
+
+	inline void decodeBC1(uint8_t const* in, unsigned char* rgba) {
+		uint16_t colour0, colour1;
+		uint32_t packed;
+		memcpy(&colour0, in, 2);
+		memcpy(&colour1, in + 2, 2);
+		memcpy(&packed, in + 4, 4);
+		int palette[4][4];
+		bc1Palette(colour0, colour1, palette);
+		for (int i = 0; i < BLOCK_PIXELS; i++) {
+			auto& colour = palette[(packed >> (2 * i)) & 3];
+			for (int c = 0; c < 4; c++) { rgba[4 * i + c] = (unsigned char)colour[c]; }
+		}
+	}
+
+	// BC4 ------------------------------------------------------------------------------------------------
+
+	// The eight values a BC4 block can pick from, as the decoder computes them
+	inline void bc4Palette(int value0, int value1, int* palette) {
+		palette[0] = value0;
+		palette[1] = value1;
+		for (int i = 2; i < 8; i++) {
+			palette[i] = value0 > value1 ?
+				((8 - i) * value0 + (i - 1) * value1 + 3) / 7 :
+				(i < 6 ? ((6 - i) * value0 + (i - 1) * value1 + 2) / 5 : (i == 6 ? 0 : 255));
+		}
+	}
+
+	inline float bc4Evaluate(Block const& block, int channel, int value0, int value1, uint8_t* indices) {
+		int palette[8];
+		bc4Palette(value0, value1, palette);
+		float palettef[8][4] = {};
+		for (int p = 0; p < 8; p++) { palettef[p][channel] = (float)palette[p]; }
+		return nearestIndices(block, channel, 1, palettef, value0 == value1 ? 1 : 8, indices);
+	}
+
+	// Encode a single channel of a block into 8 bytes
+	inline void encodeBC4(Block const& block, int channel, uint8_t* out) {
+		static const float WEIGHTS[8] = { 0.f, 1.f, 1.f / 7, 2.f / 7, 3.f / 7, 4.f / 7, 5.f / 7, 6.f / 7 };
+		auto values = block.channels[channel];
+		int bestValues[2] = {
+			(int)*std::max_element(values, values + BLOCK_PIXELS),
+			(int)*std::min_element(values, values + BLOCK_PIXELS),
+		};
+		uint8_t bestIndices[BLOCK_PIXELS] = {};
+		float bestError = bc4Evaluate(block, channel, bestValues[0], bestValues[1], bestIndices);
+
+		float first, second;
+		if (bestError > 0.f && fitEndpoints(block, channel, 1, bestIndices, WEIGHTS, &first, &second)) {
+			int fitted[2] = { (int)std::lround(std::max(first, second)), (int)std::lround(std::min(first, second)) };
+			uint8_t indices[BLOCK_PIXELS];
+			float error = bc4Evaluate(block, channel, fitted[0], fitted[1], indices);
+			if (error < bestError) {
+				bestValues[0] = fitted[0];
+				bestValues[1] = fitted[1];
+				std::copy(indices, indices + BLOCK_PIXELS, bestIndices);
+			}
+		}
+
+		memset(out, 0, 8);
+		out[0] = (uint8_t)bestValues[0];
+		out[1] = (uint8_t)bestValues[1];
+		int position = 16;
+		for (int i = 0; i < BLOCK_PIXELS; i++) { writeBits(out, position, bestIndices[i], 3); }
+	}
+
+	inline void decodeBC4(uint8_t const* in, unsigned char* rgba, int channel) {
+		int palette[8];
+		bc4Palette(in[0], in[1], palette);
+		int position = 16;
+		for (int i = 0; i < BLOCK_PIXELS; i++) {
+			rgba[4 * i + channel] = (unsigned char)palette[readBits(in, position, 3)];
+		}
+	}
+
+	// BC3 and BC5 ----------------------------------------------------------------------------------------
+
+	// Encode a block into 16 bytes: a BC4 block for alpha, then a BC1 block for colour
+	inline void encodeBC3(unsigned char const* rgba, uint8_t* out) {
+		encodeBC4(Block(rgba), 3, out);
+		encodeBC1(rgba, out + 8);
+	}
+
+	inline void decodeBC3(uint8_t const* in, unsigned char* rgba) {
+		decodeBC1(in + 8, rgba);
+		decodeBC4(in, rgba, 3);
+	}
+
+	// Encode the red and green channels of a block into 16 bytes, as two BC4 blocks
+	inline void encodeBC5(unsigned char const* rgba, uint8_t* out) {
+		auto block = Block(rgba);
+		encodeBC4(block, 0, out);
+		encodeBC4(block, 1, out + 8);
+	}
+
+	inline void decodeBC5(uint8_t const* in, unsigned char* rgba) {
+		decodeBC4(in, rgba, 0);
+		decodeBC4(in + 8, rgba, 1);
+		for (int i = 0; i < BLOCK_PIXELS; i++) {
+			rgba[4 * i + 2] = 0;
+			rgba[4 * i + 3] = 255;
+		}
+	}
+
+	// BC7 ------------------------------------------------------------------------------------------------
+
+	const int BC7_WEIGHTS[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+	// Quantize an endpoint to 7 bits per channel plus a shared low bit, picking the low bit that fits best.
+	// Opaque endpoints always set the low bit, so that opaque textures stay exactly opaque
+	inline void bc7Quantize(float const* endpoint, int* quantized, int& pBit) {
+		float bestError = INFINITY;
+		for (int p = endpoint[3] >= 255.f ? 1 : 0; p < 2; p++) {
+			int candidate[4];
+			float error = 0.f;
+			for (int c = 0; c < 4; c++) {
+				candidate[c] = std::min(127, std::max(0, (int)std::lround((endpoint[c] - p) / 2.f)));
+				float difference = (float)((candidate[c] << 1) | p) - endpoint[c];
+				error += difference * difference;
+			}
+			if (error < bestError) {
+				bestError = error;
+				pBit = p;
+				std::copy(candidate, candidate + 4, quantized);
+			}
+		}
+	}
+
+	inline void bc7Palette(int const* quantized0, int pBit0, int const* quantized1, int pBit1, int (*palette)[4]) {
+		for (int c = 0; c < 4; c++) {
+			int value0 = (quantized0[c] << 1) | pBit0;
+			int value1 = (quantized1[c] << 1) | pBit1;
+			for (int i = 0; i < 16; i++) {
+				palette[i][c] = ((64 - BC7_WEIGHTS[i]) * value0 + BC7_WEIGHTS[i] * value1 + 32) >> 6;
+			}
+		}
+	}
+
+	inline float bc7Evaluate(
+		Block const& block, int const* quantized0, int pBit0, int const* quantized1, int pBit1, uint8_t* indices
+	) {
+		int palette[16][4];
+		bc7Palette(quantized0, pBit0, quantized1, pBit1, palette);
+		float palettef[16][4];
+		for (int p = 0; p < 16; p++) {
+			for (int c = 0; c < 4; c++) { palettef[p][c] = (float)palette[p][c]; }
+		}
+		return nearestIndices(block, 0, 4, palettef, 16, indices);
+	}
+
+	// Encode a block into 16 bytes, in mode 6
+	inline void encodeBC7(unsigned char const* rgba, uint8_t* out) {
+		auto block = Block(rgba);
+		static float WEIGHTS[16];
+		for (int i = 0; i < 16; i++) { WEIGHTS[i] = BC7_WEIGHTS[i] / 64.f; }
+
+		float endpoints[2][4];
+		principalEndpoints(block, 0, 4, endpoints[0], endpoints[1]);
+		int quantized[2][4], pBits[2];
+		bc7Quantize(endpoints[0], quantized[0], pBits[0]);
+		bc7Quantize(endpoints[1], quantized[1], pBits[1]);
+		uint8_t indices[BLOCK_PIXELS];
+		float error = bc7Evaluate(block, quantized[0], pBits[0], quantized[1], pBits[1], indices);
+
+		for (int iteration = 0; iteration < 2; iteration++) {
+			float fitted[2][4];
+			if (!fitEndpoints(block, 0, 4, indices, WEIGHTS, fitted[0], fitted[1])) break;
+			int candidate[2][4], candidatePBits[2];
+			bc7Quantize(fitted[0], candidate[0], candidatePBits[0]);
+			bc7Quantize(fitted[1], candidate[1], candidatePBits[1]);
+			uint8_t candidateIndices[BLOCK_PIXELS];
+			float candidateError = bc7Evaluate(
+				block, candidate[0], candidatePBits[0], candidate[1], candidatePBits[1], candidateIndices
+			);
+			if (candidateError >= error) break;
+			error = candidateError;
+			memcpy(quantized, candidate, sizeof(quantized));
+			memcpy(pBits, candidatePBits, sizeof(pBits));
+			std::copy(candidateIndices, candidateIndices + BLOCK_PIXELS, indices);
+		}
+
+		// The first pixel's index is stored without its top bit, so it must be below 8
+		if (indices[0] >= 8) {
+			std::swap(quantized[0], quantized[1]);
+			std::swap(pBits[0], pBits[1]);
+			for (auto& index : indices) { index = (uint8_t)(15 - index); }
+		}
+
+		memset(out, 0, 16);
+		int position = 0;
+		writeBits(out, position, 1 << 6, 7);
+		for (int c = 0; c < 4; c++) {
+			writeBits(out, position, quantized[0][c], 7);
+			writeBits(out, position, quantized[1][c], 7);
+		}
+		writeBits(out, position, pBits[0], 1);
+		writeBits(out, position, pBits[1], 1);
+		writeBits(out, position, indices[0], 3);
+		for (int i = 1; i < BLOCK_PIXELS; i++) { writeBits(out, position, indices[i], 4); }
+	}
+
+	// Decode a mode 6 block. Blocks in any other mode decode to opaque magenta
+	inline void decodeBC7(uint8_t const* in, unsigned char* rgba) {
+		int position = 0;
+		if (readBits(in, position, 7) != 1 << 6) {
+			for (int i = 0; i < BLOCK_PIXELS; i++) {
+				rgba[4 * i] = rgba[4 * i + 2] = rgba[4 * i + 3] = 255;
+				rgba[4 * i + 1] = 0;
+			}
+			return;
+		}
+		int quantized[2][4];
+		for (int c = 0; c < 4; c++) {
+			quantized[0][c] = (int)readBits(in, position, 7);
+			quantized[1][c] = (int)readBits(in, position, 7);
+		}
+		int pBit0 = (int)readBits(in, position, 1);
+		int pBit1 = (int)readBits(in, position, 1);
+		int palette[16][4];
+		bc7Palette(quantized[0], pBit0, quantized[1], pBit1, palette);
+		for (int i = 0; i < BLOCK_PIXELS; i++) {
+			auto& colour = palette[readBits(in, position, i == 0 ? 3 : 4)];
+			for (int c = 0; c < 4; c++) { rgba[4 * i + c] = (unsigned char)colour[c]; }
+		}
+	}
+}
\ No newline at end of file
@@ -0,0 +1,324 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include <glad/glad.h>
+
+#include "../../thread_pool.h"
+#include "block_compression.h"
+#include "image.h"
+#include "mip_chain.h"
+
+// S3TC is an extension rather than part of the core profile, so glad does not define its formats
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+// The block-compressed formats textures can be cooked into
+enum class BlockFormat {
+	BC1,	// RGB, 4 bits per pixel. Colour textures without alpha
+	BC3,	// RGBA, 8 bits per pixel. Colour textures with alpha
+	BC5,	// RG, 8 bits per pixel. Normal maps, with z rebuilt in the shader
+	BC7,	// RGBA, 8 bits per pixel. Higher quality than BC1 and BC3
+};
+
+// A block-compressed texture with its full mip chain, as produced offline and stored in a KTX 1.1 file.
+// Loading one makes no OpenGL calls, so it can be done on any thread
+class CompressedImage {
+	GLenum format;
+	int width;
+	int height;
+	int faceCount;
+	int levelCount;
+	std::vector<unsigned char> bytes;
+	std::vector<size_t> offsets;	// of each face of each level, level by level
+
+public:
+	CompressedImage() : format(0), width(0), height(0), faceCount(0), levelCount(0) {}
+
+	// Load a KTX file. Exits if it is missing, malformed, or not in one of the formats above
+	explicit CompressedImage(char const* path) : CompressedImage() {
+		auto fail = [path](char const* reason) {
+			std::cerr << "Error while loading compressed image \"" << path << "\": " << reason << ". Exiting" << std::endl;
+			exit(1);
+		};
+		auto file = std::ifstream(path, std::ios::binary);
+		if (!file) fail("Could not open the file");
+		auto contents = std::vector<unsigned char>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+
+		KtxHeader header;
+		if (contents.size() < sizeof(header)) fail("File too short");
+		memcpy(&header, contents.data(), sizeof(header));
+		if (memcmp(header.identifier, KTX_IDENTIFIER, sizeof(KTX_IDENTIFIER)) != 0) fail("Not a KTX 1.1 file");
+		if (header.endianness != KTX_ENDIANNESS) fail("Byte order does not match this machine's");
+		if (header.glType != 0 || blockSize(header.glInternalFormat) == 0) fail("Not in a supported compressed format");
+		if (header.numberOfFaces != 1 && header.numberOfFaces != 6) fail("Neither a 2D texture nor a cubemap");
+		if (header.pixelDepth > 1 || header.numberOfArrayElements > 0) fail("3D textures and arrays are not supported");
+
+		this->format = header.glInternalFormat;
+		this->width = (int)header.pixelWidth;
+		this->height = (int)header.pixelHeight;
+		this->faceCount = (int)header.numberOfFaces;
+		this->levelCount = (int)std::max(1u, header.numberOfMipmapLevels);
+
+		auto position = sizeof(header) + header.bytesOfKeyValueData;
+		for (int level = 0; level < this->levelCount; level++) {
+			uint32_t imageSize;
+			if (position + sizeof(imageSize) > contents.size()) fail("File truncated");
+			memcpy(&imageSize, contents.data() + position, sizeof(imageSize));
+			position += sizeof(imageSize);
+			if (imageSize != this->getSize(level)) fail("Level size does not match its dimensions");
+			for (int face = 0; face < this->faceCount; face++) {
+				if (position + imageSize > contents.size()) fail("File truncated");
+				this->offsets.push_back(this->bytes.size());
+				this->bytes.insert(this->bytes.end(), contents.begin() + position, contents.begin() + position + imageSize);
+				position += (imageSize + 3) & ~3u;
+			}
+		}
+	}
+
+	// Compress the given faces, which must all have the same size: one for a 2D texture, six for a cubemap.
+	// Every level of each face's mip chain is encoded on the workers of pool and the calling thread. Colour formats
+	// average their mips in linear space, while BC5 normal maps average them as stored
+	static CompressedImage compress(std::vector<Image const*> const& faces, BlockFormat blockFormat, ThreadPool& pool) {
+		auto image = CompressedImage();
+		image.format = glFormat(blockFormat);
+		image.width = faces[0]->getWidth();
+		image.height = faces[0]->getHeight();
+		image.faceCount = (int)faces.size();
+		image.levelCount = MipChain::levelCountFor(image.width, image.height);
+
+		auto chains = std::vector<MipChain>();
+		for (auto face : faces) { chains.push_back(MipChain(*face, blockFormat != BlockFormat::BC5)); }
+
+		for (int level = 0; level < image.levelCount; level++) {
+			for (auto& chain : chains) {
+				image.offsets.push_back(image.bytes.size());
+				image.bytes.resize(image.bytes.size() + image.getSize(level));
+				encode(
+					chain.getData(level), image.getWidth(level), image.getHeight(level), blockFormat,
+					&image.bytes[image.offsets.back()], pool
+				);
+			}
+		}
+		return image;
+	}
+
+	// Write the image as a KTX 1.1 file. Returns false if the file could not be written
+	bool write(char const* path) const {
+		auto header = KtxHeader();
+		memcpy(header.identifier, KTX_IDENTIFIER, sizeof(KTX_IDENTIFIER));
+		header.endianness = KTX_ENDIANNESS;
+		header.glTypeSize = 1;
+		header.glInternalFormat = this->format;
+		header.glBaseInternalFormat = baseFormat(this->format);
+		header.pixelWidth = (uint32_t)this->width;
+		header.pixelHeight = (uint32_t)this->height;
+		header.numberOfFaces = (uint32_t)this->faceCount;
+		header.numberOfMipmapLevels = (uint32_t)this->levelCount;
+
+		auto out = std::ofstream(path, std::ios::binary | std::ios::trunc);
+		out.write((char const*)&header, sizeof(header));
+		// Block sizes are multiples of 4 bytes, so KTX's padding never applies
+		for (int level = 0; level < this->levelCount; level++) {
+			auto imageSize = (uint32_t)this->getSize(level);
+			out.write((char const*)&imageSize, sizeof(imageSize));
+			for (int face = 0; face < this->faceCount; face++) {
+				out.write((char const*)this->getData(level, face), imageSize);
+			}
+		}
+		return (bool)out;
+	}
+
+	// Decode one face of one level back to RGBA8, to measure the encoder's error
+	std::vector<unsigned char> decode(int level, int face) const {
+		auto width = this->getWidth(level);
+		auto height = this->getHeight(level);
+		auto blockBytes = blockSize(this->format);
+		auto blocksWide = (width + 3) / 4;
+		auto data = this->getData(level, face);
+
+		auto pixels = std::vector<unsigned char>((size_t)width * height * 4);
+		unsigned char block[bc::BLOCK_PIXELS * 4];
+		for (int blockY = 0; blockY < (height + 3) / 4; blockY++) {
+			for (int blockX = 0; blockX < blocksWide; blockX++) {
+				auto in = data + ((size_t)blockY * blocksWide + blockX) * blockBytes;
+				switch (this->format) {
+				case GL_COMPRESSED_RGB_S3TC_DXT1_EXT: bc::decodeBC1(in, block); break;
+				case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT: bc::decodeBC3(in, block); break;
+				case GL_COMPRESSED_RG_RGTC2: bc::decodeBC5(in, block); break;
+				case GL_COMPRESSED_RGBA_BPTC_UNORM: bc::decodeBC7(in, block); break;
+				}
+				for (int y = 0; y < 4 && blockY * 4 + y < height; y++) {
+					for (int x = 0; x < 4 && blockX * 4 + x < width; x++) {
+						memcpy(
+							&pixels[(((size_t)blockY * 4 + y) * width + blockX * 4 + x) * 4],
+							&block[(y * 4 + x) * 4], 4
+						);
+					}
+				}
+			}
+		}
+		return pixels;
+	}
+
+	// Peak signal-to-noise ratio in dB of the top level of a face against the image it was compressed from,
+	// over the channels the format stores
+	double psnr(Image const& original, int face) const {
+		auto source = toRGBA(original);
+		auto decoded = this->decode(0, face);
+		auto channels = this->format == GL_COMPRESSED_RG_RGTC2 ? 2 : (this->format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT ? 3 : 4);
+		double squaredError = 0.0;
+		for (size_t i = 0; i < source.size(); i += 4) {
+			for (int c = 0; c < channels; c++) {
+				double difference = (double)source[i + c] - decoded[i + c];
+				squaredError += difference * difference;
+			}
+		}
+		auto meanSquaredError = squaredError / (source.size() / 4 * channels);
+		return meanSquaredError == 0.0 ? INFINITY : 10.0 * std::log10(255.0 * 255.0 / meanSquaredError);
+	}
+
+	// Path of the cooked version of a texture: the same path with a .ktx extension
+	static std::string cookedPath(std::string const& path) {
+		auto extension = path.find_last_of('.');
+		auto separator = path.find_last_of("/\\");
+		if (extension == std::string::npos || (separator != std::string::npos && extension < separator)) return path + ".ktx";
+		return path.substr(0, extension) + ".ktx";
+	}
+
+	static bool exists(std::string const& path) {
+		return std::ifstream(path).good();
+	}
+
+	bool isEmpty() const {
+		return this->levelCount == 0;
+	}
+	GLenum getFormat() const {
+		return this->format;
+	}
+	int getFaceCount() const {
+		return this->faceCount;
+	}
+	int getLevelCount() const {
+		return this->levelCount;
+	}
+	int getWidth(int level = 0) const {
+		return std::max(1, this->width >> level);
+	}
+	int getHeight(int level = 0) const {
+		return std::max(1, this->height >> level);
+	}
+	// Size in bytes of one face of the given level
+	size_t getSize(int level) const {
+		return (size_t)((this->getWidth(level) + 3) / 4) * ((this->getHeight(level) + 3) / 4) * blockSize(this->format);
+	}
+	size_t getTotalSize() const {
+		return this->bytes.size();
+	}
+	unsigned char const* getData(int level, int face) const {
+		return this->bytes.data() + this->offsets[level * this->faceCount + face];
+	}
+
+	static GLenum glFormat(BlockFormat format) {
+		switch (format) {
+		case BlockFormat::BC1: return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+		case BlockFormat::BC3: return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+		case BlockFormat::BC5: return GL_COMPRESSED_RG_RGTC2;
+		default: return GL_COMPRESSED_RGBA_BPTC_UNORM;
+		}
+	}
+
+	// Bytes per 4x4 block of the given format, or 0 if it is not a supported format
+	static size_t blockSize(GLenum format) {
+		switch (format) {
+		case GL_COMPRESSED_RGB_S3TC_DXT1_EXT: return 8;
+		case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+		case GL_COMPRESSED_RG_RGTC2:
+		case GL_COMPRESSED_RGBA_BPTC_UNORM: return 16;
+		default: return 0;
+		}
+	}
+
+private:
+	struct KtxHeader {
+		uint8_t identifier[12];
+		uint32_t endianness;
+		uint32_t glType;
+		uint32_t glTypeSize;
+		uint32_t glFormat;
+		uint32_t glInternalFormat;
+		uint32_t glBaseInternalFormat;
+		uint32_t pixelWidth;
+		uint32_t pixelHeight;
+		uint32_t pixelDepth;
+		uint32_t numberOfArrayElements;
+		uint32_t numberOfFaces;
+		uint32_t numberOfMipmapLevels;
+		uint32_t bytesOfKeyValueData;
+	};
+	static constexpr uint8_t KTX_IDENTIFIER[12] = { 0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n' };
+	static const uint32_t KTX_ENDIANNESS = 0x04030201;
+
+	static GLenum baseFormat(GLenum format) {
+		switch (format) {
+		case GL_COMPRESSED_RGB_S3TC_DXT1_EXT: return GL_RGB;
+		case GL_COMPRESSED_RG_RGTC2: return GL_RG;
+		default: return GL_RGBA;
+		}
+	}
+
+	static std::vector<unsigned char> toRGBA(Image const& image) {
+		auto pixelCount = (size_t)image.getWidth() * image.getHeight();
+		auto channelCount = image.getChannelCount();
+		auto rgba = std::vector<unsigned char>(pixelCount * 4, 255);
+		for (size_t i = 0; i < pixelCount; i++) {
+			memcpy(&rgba[i * 4], image.getBytes() + i * channelCount, channelCount);
+		}
+		return rgba;
+	}
+
+	// Encode an RGBA8 image block by block, a band of block rows per thread.
+	// Blocks hanging over the right or bottom edge repeat the edge pixels
+	static void encode(
+		unsigned char const* pixels, int width, int height, BlockFormat format, unsigned char* out, ThreadPool& pool
+	) {
+		auto blockBytes = blockSize(glFormat(format));
+		auto blocksWide = (width + 3) / 4;
+		auto blocksHigh = (size_t)(height + 3) / 4;
+		parallelFor(pool, blocksHigh, 16, [=](size_t begin, size_t end) {
+			unsigned char block[bc::BLOCK_PIXELS * 4];
+			for (auto blockY = begin; blockY < end; blockY++) {
+				for (int blockX = 0; blockX < blocksWide; blockX++) {
+					for (int y = 0; y < 4; y++) {
+						auto row = std::min((int)blockY * 4 + y, height - 1);
+						for (int x = 0; x < 4; x++) {
+							auto column = std::min(blockX * 4 + x, width - 1);
+							memcpy(&block[(y * 4 + x) * 4], &pixels[((size_t)row * width + column) * 4], 4);
+						}
+					}
+					auto target = out + (blockY * blocksWide + blockX) * blockBytes;
+					switch (format) {
+					case BlockFormat::BC1: bc::encodeBC1(block, target); break;
+					case BlockFormat::BC3: bc::encodeBC3(block, target); break;
+					case BlockFormat::BC5: bc::encodeBC5(block, target); break;
+					case BlockFormat::BC7: bc::encodeBC7(block, target); break;
+					}
+				}
+			}
+		});
+	}
+};
+
+constexpr uint8_t CompressedImage::KTX_IDENTIFIER[12];
\ No newline at end of file
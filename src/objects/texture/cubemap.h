@@ -5,33 +5,60 @@
 
 #include <glad/glad.h>
 
+#include "../gl_state.h"
+#include "compressed_image.h"
 #include "image.h"
+#include "mip_chain.h"
 
 class Cubemap {
 	GLuint name;
 public:
+	static const GLuint UNIT = 0;
+
 	Cubemap() : name(0) {}
 
-	Cubemap(std::array<Image, 6> const& faces) {
+	Cubemap(std::array<Image, 6> const& faces) : Cubemap(chainsOf(faces)) {}
+
+	// Upload every level of each face's mip chain into immutable storage, sampled trilinearly
+	Cubemap(std::array<MipChain, 6> const& faces) {
 		GLuint name;
 		glGenTextures(1, &name);
-		glBindTexture(GL_TEXTURE_CUBE_MAP, name);
+		gl_state::bindTexture(UNIT, GL_TEXTURE_CUBE_MAP, name);
+		glTexStorage2D(GL_TEXTURE_CUBE_MAP, faces[0].getLevelCount(), GL_RGBA8, faces[0].getWidth(), faces[0].getHeight());
 
 		GLuint i = 0;
 		for (auto& face : faces) {
-			assert(face.getBytes());
-			glTexImage2D(
-				GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0,
-				face.getPixelFormat(), face.getWidth(), face.getHeight(),
-				0, face.getPixelFormat(), GL_UNSIGNED_BYTE, face.getBytes()
-			);
+			assert(face.getLevelCount() == faces[0].getLevelCount());
+			for (int level = 0; level < face.getLevelCount(); level++) {
+				glTexSubImage2D(
+					GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, level, 0, 0, face.getWidth(level), face.getHeight(level),
+					GL_RGBA, GL_UNSIGNED_BYTE, face.getData(level)
+				);
+			}
 			i++;
 		}
-		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+		setParameters();
+
+		this->name = name;
+	}
+
+	// Upload a cooked cubemap with every level of its mip chain
+	Cubemap(CompressedImage const& faces) {
+		assert(faces.getFaceCount() == 6);
+		GLuint name;
+		glGenTextures(1, &name);
+		gl_state::bindTexture(UNIT, GL_TEXTURE_CUBE_MAP, name);
+
+		glTexStorage2D(GL_TEXTURE_CUBE_MAP, faces.getLevelCount(), faces.getFormat(), faces.getWidth(), faces.getHeight());
+		for (int level = 0; level < faces.getLevelCount(); level++) {
+			for (GLuint i = 0; i < 6; i++) {
+				glCompressedTexSubImage2D(
+					GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, level, 0, 0, faces.getWidth(level), faces.getHeight(level),
+					faces.getFormat(), (GLsizei)faces.getSize(level), faces.getData(level, i)
+				);
+			}
+		}
+		setParameters();
 
 		this->name = name;
 	}
@@ -47,10 +74,28 @@ public:
 		return *this;
 	}
 	~Cubemap() {
-		if (this->name != 0) glDeleteTextures(1, &this->name);
+		if (this->name != 0) gl_state::deleteTexture(this->name);
 	}
 
 	void bind() const {
-		glBindTexture(GL_TEXTURE_2D, this->name);
+		gl_state::bindTexture(UNIT, GL_TEXTURE_CUBE_MAP, this->name);
+	}
+
+private:
+	static std::array<MipChain, 6> chainsOf(std::array<Image, 6> const& faces) {
+		std::array<MipChain, 6> chains;
+		for (size_t i = 0; i < 6; i++) {
+			assert(faces[i].getBytes());
+			chains[i] = MipChain(faces[i], true);
+		}
+		return chains;
+	}
+
+	static void setParameters() {
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
 	}
 };
\ No newline at end of file
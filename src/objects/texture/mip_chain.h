@@ -0,0 +1,226 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MIP_USE_SSE2
+#include <emmintrin.h>
+#endif
+
+#include "image.h"
+
+// The full mip chain of an image, built on the CPU so that it can be built on a loader thread or cooked offline.
+// Every level is RGBA8, and each is a 2x2 box filter of the one above it.
+//
+// Colour channels of sRGB images are averaged in linear space, so that mips do not darken: the average of
+// black and white is the sRGB value that emits half as much light, not the value halfway between the two.
+// Alpha, and every channel of non-colour data like normal maps, is averaged as stored
+class MipChain {
+	std::vector<std::vector<unsigned char>> levels;
+	int width;
+	int height;
+
+public:
+	MipChain() : width(0), height(0) {}
+
+	// Build the chain of an image with 3 (RGB) or 4 (RGBA) channels per pixel
+	MipChain(unsigned char const* pixels, int width, int height, int channelCount, bool srgb) :
+		width(width), height(height)
+	{
+		auto levelCount = levelCountFor(width, height);
+		this->levels.resize(levelCount);
+		auto& top = this->levels[0];
+		top.resize((size_t)width * height * 4);
+		if (channelCount == 4) { std::copy(pixels, pixels + top.size(), top.begin()); }
+		else {
+			for (size_t i = 0; i < (size_t)width * height; i++) {
+				top[4 * i + 3] = 255;
+				std::copy(pixels + i * channelCount, pixels + i * channelCount + std::min(channelCount, 4), &top[4 * i]);
+			}
+		}
+		if (levelCount == 1) return;
+
+		// Level 1 is filtered straight from the bytes of level 0, two rows at a time, so that only the smaller
+		// levels are ever held as floats
+		auto rows = std::vector<float>((size_t)width * 4 * 2);
+		auto level = std::vector<float>((size_t)this->getWidth(1) * this->getHeight(1) * 4);
+		for (int y = 0; y < this->getHeight(1); y++) {
+			decode(&top[(size_t)std::min(2 * y, height - 1) * width * 4], (size_t)width, srgb, &rows[0]);
+			decode(&top[(size_t)std::min(2 * y + 1, height - 1) * width * 4], (size_t)width, srgb, &rows[(size_t)width * 4]);
+			halveRows(&rows[0], &rows[(size_t)width * 4], width, &level[(size_t)y * this->getWidth(1) * 4]);
+		}
+		this->store(1, level, srgb);
+
+		for (int i = 2; i < levelCount; i++) {
+			auto aboveWidth = this->getWidth(i - 1);
+			auto aboveHeight = this->getHeight(i - 1);
+			auto next = std::vector<float>((size_t)this->getWidth(i) * this->getHeight(i) * 4);
+			for (int y = 0; y < this->getHeight(i); y++) {
+				halveRows(
+					&level[(size_t)std::min(2 * y, aboveHeight - 1) * aboveWidth * 4],
+					&level[(size_t)std::min(2 * y + 1, aboveHeight - 1) * aboveWidth * 4],
+					aboveWidth, &next[(size_t)y * this->getWidth(i) * 4]
+				);
+			}
+			level = std::move(next);
+			this->store(i, level, srgb);
+		}
+	}
+
+	MipChain(Image const& image, bool srgb) :
+		MipChain(image.getBytes(), image.getWidth(), image.getHeight(), image.getChannelCount(), srgb)
+	{}
+
+	static int levelCountFor(int width, int height) {
+		int count = 1;
+		while ((std::max(width, height) >> count) > 0) count++;
+		return count;
+	}
+
+	int getLevelCount() const {
+		return (int)this->levels.size();
+	}
+	int getWidth(int level = 0) const {
+		return std::max(1, this->width >> level);
+	}
+	int getHeight(int level = 0) const {
+		return std::max(1, this->height >> level);
+	}
+	unsigned char const* getData(int level) const {
+		return this->levels[level].data();
+	}
+
+	// Average two rows of linear RGBA floats, each width pixels long, down to one row of max(1, width / 2) pixels.
+	// An odd last pixel is dropped, and a single pixel is averaged with itself
+	static void halveRows(float const* row0, float const* row1, int width, float* out) {
+		int x = 0;
+		int halfWidth = width / 2;
+#if defined(__AVX2__)
+		auto quarter8 = _mm256_set1_ps(0.25f);
+		for (; x + 2 <= halfWidth; x += 2) {
+			// Pixels 0-1 and 2-3 of both rows, summed down the columns
+			auto left = _mm256_add_ps(_mm256_loadu_ps(row0 + 8 * x), _mm256_loadu_ps(row1 + 8 * x));
+			auto right = _mm256_add_ps(_mm256_loadu_ps(row0 + 8 * x + 8), _mm256_loadu_ps(row1 + 8 * x + 8));
+			// Then across: pixels 0 and 2 plus pixels 1 and 3
+			auto sum = _mm256_add_ps(_mm256_permute2f128_ps(left, right, 0x20), _mm256_permute2f128_ps(left, right, 0x31));
+			_mm256_storeu_ps(out + 4 * x, _mm256_mul_ps(sum, quarter8));
+		}
+#endif
+#ifdef MIP_USE_SSE2
+		auto quarter = _mm_set1_ps(0.25f);
+		for (; x < halfWidth; x++) {
+			auto sum = _mm_add_ps(
+				_mm_add_ps(_mm_loadu_ps(row0 + 8 * x), _mm_loadu_ps(row0 + 8 * x + 4)),
+				_mm_add_ps(_mm_loadu_ps(row1 + 8 * x), _mm_loadu_ps(row1 + 8 * x + 4))
+			);
+			_mm_storeu_ps(out + 4 * x, _mm_mul_ps(sum, quarter));
+		}
+#endif
+		for (; x < std::max(1, halfWidth); x++) {
+			int column0 = std::min(2 * x, width - 1);
+			int column1 = std::min(2 * x + 1, width - 1);
+			for (int c = 0; c < 4; c++) {
+				out[4 * x + c] = 0.25f * (
+					row0[4 * column0 + c] + row0[4 * column1 + c] + row1[4 * column0 + c] + row1[4 * column1 + c]
+				);
+			}
+		}
+	}
+
+	// The same filter without SIMD, for checking and benchmarking the one above
+	static void halveRowsScalar(float const* row0, float const* row1, int width, float* out) {
+		for (int x = 0; x < std::max(1, width / 2); x++) {
+			int column0 = std::min(2 * x, width - 1);
+			int column1 = std::min(2 * x + 1, width - 1);
+			for (int c = 0; c < 4; c++) {
+				out[4 * x + c] = 0.25f * (
+					row0[4 * column0 + c] + row0[4 * column1 + c] + row1[4 * column0 + c] + row1[4 * column1 + c]
+				);
+			}
+		}
+	}
+
+private:
+	static const int ENCODE_STEPS = 4096;
+
+	// Byte to intensity: table 0 scales linearly, table 1 decodes sRGB
+	static float const* decodeTable(bool srgb) {
+		static auto tables = [] {
+			auto tables = std::vector<float>(512);
+			for (int i = 0; i < 256; i++) {
+				auto value = i / 255.f;
+				tables[i] = value;
+				tables[256 + i] = value <= 0.04045f ? value / 12.92f : std::pow((value + 0.055f) / 1.055f, 2.4f);
+			}
+			return tables;
+		}();
+		return tables.data() + (srgb ? 256 : 0);
+	}
+
+	// Linear intensity, in ENCODE_STEPS steps, to sRGB byte
+	static unsigned char const* encodeTable() {
+		static auto table = [] {
+			auto table = std::vector<unsigned char>(ENCODE_STEPS + 1);
+			for (int i = 0; i <= ENCODE_STEPS; i++) {
+				auto value = (float)i / ENCODE_STEPS;
+				auto encoded = value <= 0.0031308f ? value * 12.92f : 1.055f * std::pow(value, 1.f / 2.4f) - 0.055f;
+				table[i] = (unsigned char)std::lround(encoded * 255.f);
+			}
+			return table;
+		}();
+		return table.data();
+	}
+
+	static void decode(unsigned char const* pixels, size_t pixelCount, bool srgb, float* out) {
+		auto colourTable = decodeTable(srgb);
+		auto alphaTable = decodeTable(false);
+		for (size_t i = 0; i < pixelCount * 4; i += 4) {
+			out[i] = colourTable[pixels[i]];
+			out[i + 1] = colourTable[pixels[i + 1]];
+			out[i + 2] = colourTable[pixels[i + 2]];
+			out[i + 3] = alphaTable[pixels[i + 3]];
+		}
+	}
+
+	void store(int level, std::vector<float> const& pixels, bool srgb) {
+		auto& bytes = this->levels[level];
+		bytes.resize(pixels.size());
+		size_t i = 0;
+#ifdef MIP_USE_SSE2
+		if (!srgb) {
+			auto scale = _mm_set1_ps(255.f);
+			for (; i + 16 <= pixels.size(); i += 16) {
+				auto a = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(&pixels[i]), scale));
+				auto b = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(&pixels[i + 4]), scale));
+				auto c = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(&pixels[i + 8]), scale));
+				auto d = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(&pixels[i + 12]), scale));
+				_mm_storeu_si128((__m128i*)&bytes[i], _mm_packus_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d)));
+			}
+		}
+		else {
+			// Colour channels go through the table, alpha is scaled like the channels above
+			auto scale = _mm_setr_ps((float)ENCODE_STEPS, (float)ENCODE_STEPS, (float)ENCODE_STEPS, 255.f);
+			auto table = encodeTable();
+			alignas(16) int32_t steps[4];
+			for (; i + 4 <= pixels.size(); i += 4) {
+				_mm_store_si128((__m128i*)steps, _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(&pixels[i]), scale)));
+				bytes[i] = table[steps[0]];
+				bytes[i + 1] = table[steps[1]];
+				bytes[i + 2] = table[steps[2]];
+				bytes[i + 3] = (unsigned char)steps[3];
+			}
+		}
+#endif
+		auto table = encodeTable();
+		for (; i < pixels.size(); i++) {
+			bytes[i] = srgb && i % 4 != 3 ?
+				table[std::lround(pixels[i] * ENCODE_STEPS)] : (unsigned char)std::lround(pixels[i] * 255.f);
+		}
+	}
+};
\ No newline at end of file
@@ -5,7 +5,10 @@
 
 #include <glad/glad.h>
 
+#include "../gl_state.h"
+#include "compressed_image.h"
 #include "image.h"
+#include "mip_chain.h"
 
 namespace texture {
 
@@ -17,16 +20,39 @@ namespace texture {
 
 		Texture2D() : name(0) {}
 
-		Texture2D(Image const& image) {
-			assert(image.getBytes());
+		Texture2D(Image const& image) : Texture2D(MipChain(image, Kind::SRGB)) {}
+
+		// Upload every level of a mip chain into immutable storage, sampled trilinearly
+		Texture2D(MipChain const& mips) {
+			assert(mips.getLevelCount() > 0);
+			GLuint name;
+			glGenTextures(1, &name);
+			gl_state::bindTexture(UNIT, GL_TEXTURE_2D, name);
+			glTexStorage2D(GL_TEXTURE_2D, mips.getLevelCount(), GL_RGBA8, mips.getWidth(), mips.getHeight());
+			for (int level = 0; level < mips.getLevelCount(); level++) {
+				glTexSubImage2D(
+					GL_TEXTURE_2D, level, 0, 0, mips.getWidth(level), mips.getHeight(level),
+					GL_RGBA, GL_UNSIGNED_BYTE, mips.getData(level));
+			}
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+			this->name = name;
+		}
+
+		// Upload a cooked texture with every level of its mip chain, sampled trilinearly
+		Texture2D(CompressedImage const& image) {
+			assert(image.getFaceCount() == 1);
 			GLuint name;
 			glGenTextures(1, &name);
-			glActiveTexture(UNIT);
-			glBindTexture(GL_TEXTURE_2D, name);
-			glTexImage2D(
-				GL_TEXTURE_2D, 0, image.getPixelFormat(), image.getWidth(),
-				image.getHeight(), 0, image.getPixelFormat(), GL_UNSIGNED_BYTE, image.getBytes());
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+			gl_state::bindTexture(UNIT, GL_TEXTURE_2D, name);
+			glTexStorage2D(GL_TEXTURE_2D, image.getLevelCount(), image.getFormat(), image.getWidth(), image.getHeight());
+			for (int level = 0; level < image.getLevelCount(); level++) {
+				glCompressedTexSubImage2D(
+					GL_TEXTURE_2D, level, 0, 0, image.getWidth(level), image.getHeight(level),
+					image.getFormat(), (GLsizei)image.getSize(level), image.getData(level, 0));
+			}
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 			this->name = name;
 		}
 
@@ -41,19 +67,21 @@ namespace texture {
 			return *this;
 		}
 		~Texture2D() {
-			if (this->name != -1) { glDeleteTextures(1, &this->name); }
+			if (this->name != -1) { gl_state::deleteTexture(this->name); }
 		}
 
 		void bind() const {
-			glActiveTexture(UNIT);
-			glBindTexture(GL_TEXTURE_2D, this->name);
+			gl_state::bindTexture(UNIT, GL_TEXTURE_2D, this->name);
 		}
 	};
+	// SRGB is whether the texture holds sRGB-encoded colours, which its mips average in linear space
 	struct TextureKind {
 		static const GLuint UNIT = 0;
+		static const bool SRGB = true;
 	};
 	struct NormalMapKind {
 		static const GLuint UNIT = 1;
+		static const bool SRGB = false;
 	};
 
 	typedef Texture2D<TextureKind> Texture;
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <cassert>
+#include <utility>
+#include <vector>
+
+#include <glad/glad.h>
+
+#include "../attribute_array.h"
+#include "../gl_state.h"
+#include "compressed_image.h"
+#include "mip_chain.h"
+
+namespace texture {
+
+	// Where a texture ended up in MaterialArrays: which array, and which layer of it
+	struct MaterialSlot {
+		GLuint array;
+		GLuint layer;
+	};
+
+	// Packs diffuse textures into the layers of GL_TEXTURE_2D_ARRAYs, one array per size and format, so that
+	// objects sharing an array share a single bind and tell their textures apart by a layer index alone.
+	//
+	// Textures are added on the CPU while objects are built, then uploaded together once every object is in
+	class MaterialArrays {
+		struct Group {
+			GLenum format;		// GL_RGBA8 for mip chains, the compressed format for cooked textures
+			int width;
+			int height;
+			int levelCount;
+			std::vector<MipChain> chains;
+			std::vector<CompressedImage> cooked;
+			GLuint name;
+		};
+		std::vector<Group> groups;
+
+	public:
+		static const GLuint UNIT = 2;
+
+		MaterialArrays() {}
+
+		MaterialArrays(MaterialArrays const&) = delete;
+		MaterialArrays& operator=(MaterialArrays const&) = delete;
+		MaterialArrays(MaterialArrays&&) = default;
+		MaterialArrays& operator=(MaterialArrays&&) = default;
+		~MaterialArrays() {
+			for (auto& group : this->groups) {
+				if (group.name != 0) gl_state::deleteTexture(group.name);
+			}
+		}
+
+		MaterialSlot add(MipChain chain) {
+			auto& group = this->groupFor(GL_RGBA8, chain.getWidth(), chain.getHeight(), chain.getLevelCount());
+			group.chains.push_back(std::move(chain));
+			return MaterialSlot{ (GLuint)(&group - &this->groups[0]), (GLuint)group.chains.size() - 1 };
+		}
+
+		MaterialSlot add(CompressedImage image) {
+			assert(image.getFaceCount() == 1);
+			auto& group = this->groupFor(image.getFormat(), image.getWidth(), image.getHeight(), image.getLevelCount());
+			group.cooked.push_back(std::move(image));
+			return MaterialSlot{ (GLuint)(&group - &this->groups[0]), (GLuint)group.cooked.size() - 1 };
+		}
+
+		// Upload every texture added so far into immutable storage, and free the CPU copies.
+		// Arrays are sampled trilinearly
+		void upload() {
+			for (auto& group : this->groups) {
+				if (group.name != 0) continue;
+				auto layerCount = (GLsizei)(group.chains.size() + group.cooked.size());
+				glGenTextures(1, &group.name);
+				gl_state::bindTexture(UNIT, GL_TEXTURE_2D_ARRAY, group.name);
+				glTexStorage3D(GL_TEXTURE_2D_ARRAY, group.levelCount, group.format, group.width, group.height, layerCount);
+				for (GLsizei layer = 0; layer < (GLsizei)group.chains.size(); layer++) {
+					auto& chain = group.chains[layer];
+					for (int level = 0; level < group.levelCount; level++) {
+						glTexSubImage3D(
+							GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, chain.getWidth(level), chain.getHeight(level), 1,
+							GL_RGBA, GL_UNSIGNED_BYTE, chain.getData(level));
+					}
+				}
+				for (GLsizei layer = 0; layer < (GLsizei)group.cooked.size(); layer++) {
+					auto& image = group.cooked[layer];
+					for (int level = 0; level < group.levelCount; level++) {
+						glCompressedTexSubImage3D(
+							GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, image.getWidth(level), image.getHeight(level), 1,
+							group.format, (GLsizei)image.getSize(level), image.getData(level, 0));
+					}
+				}
+				glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+				glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+				group.chains = std::vector<MipChain>();
+				group.cooked = std::vector<CompressedImage>();
+			}
+		}
+
+		// Bind the array holding the slot, unless it is already bound, and select the slot's layer
+		void bind(MaterialSlot slot) const {
+			assert(this->groups[slot.array].name != 0);
+			gl_state::bindTexture(UNIT, GL_TEXTURE_2D_ARRAY, this->groups[slot.array].name);
+			glVertexAttrib1f(AttributeMaterialLayer::ATTRIBUTE, (GLfloat)slot.layer);
+		}
+
+		GLuint getArrayCount() const {
+			return (GLuint)this->groups.size();
+		}
+
+	private:
+		Group& groupFor(GLenum format, int width, int height, int levelCount) {
+			for (auto& group : this->groups) {
+				if (
+					group.name == 0 && group.format == format && group.width == width && group.height == height &&
+					group.levelCount == levelCount
+				) return group;
+			}
+			this->groups.push_back(Group{ format, width, height, levelCount, {}, {}, 0 });
+			return this->groups.back();
+		}
+	};
+}
\ No newline at end of file
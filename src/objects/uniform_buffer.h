@@ -0,0 +1,48 @@
+#pragma once
+
+#include <utility>
+
+#include <glad/glad.h>
+
+#include "gl_state.h"
+
+// A uniform buffer holding one Block, attached to Block::BINDING for its whole life, so that every program using
+// the block reads it without a bind per program. Block must be laid out as std140 lays out the GLSL block, which
+// Program::bindUniformBlock checks against what the driver reports
+template<typename Block>
+class UniformBuffer {
+	GLuint name;
+
+public:
+	UniformBuffer() : name(0) {}
+
+	explicit UniformBuffer(Block const& block) {
+		glGenBuffers(1, &this->name);
+		gl_state::bindBuffer(GL_UNIFORM_BUFFER, this->name);
+		glBufferData(GL_UNIFORM_BUFFER, sizeof(Block), &block, GL_DYNAMIC_DRAW);
+		// Also binds the buffer to GL_UNIFORM_BUFFER itself, which it already is
+		glBindBufferBase(GL_UNIFORM_BUFFER, Block::BINDING, this->name);
+	}
+
+	UniformBuffer(UniformBuffer const&) = delete;
+	UniformBuffer& operator=(UniformBuffer const&) = delete;
+	UniformBuffer(UniformBuffer&& from) noexcept : UniformBuffer() {
+		*this = std::move(from);
+	}
+	// GL never names a buffer 0, so a default constructed or moved from buffer holds 0 and owns nothing
+	UniformBuffer& operator=(UniformBuffer&& from) noexcept {
+		if (this == &from) return *this;
+		if (this->name != 0) { gl_state::deleteBuffer(this->name); }
+		this->name = from.name;
+		from.name = 0;
+		return *this;
+	}
+	~UniformBuffer() {
+		if (this->name != 0) { gl_state::deleteBuffer(this->name); }
+	}
+
+	void update(Block const& block) const {
+		gl_state::bindBuffer(GL_UNIFORM_BUFFER, this->name);
+		glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(Block), &block);
+	}
+};
\ No newline at end of file
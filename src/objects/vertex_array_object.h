@@ -0,0 +1,47 @@
+#pragma once
+
+#include <utility>
+
+#include <glad/glad.h>
+
+#include "gl_state.h"
+
+// Which buffer feeds each attribute, in what format, and which index buffer is drawn from. Recorded once when its
+// mesh is built, so that drawing the mesh only takes binding it rather than setting up every attribute again
+class VertexArrayObject {
+	GLuint name;
+
+public:
+	VertexArrayObject() : name(0) {}
+
+	// Record what setup does to the attributes and to GL_ELEMENT_ARRAY_BUFFER. Whatever vertex array object was
+	// bound before is bound again afterwards
+	template<typename Setup>
+	explicit VertexArrayObject(Setup setup) {
+		auto previous = gl_state::boundVertexArray();
+		glGenVertexArrays(1, &this->name);
+		gl_state::bindVertexArray(this->name);
+		setup();
+		gl_state::bindVertexArray(previous);
+	}
+
+	VertexArrayObject(VertexArrayObject const&) = delete;
+	VertexArrayObject& operator=(VertexArrayObject const&) = delete;
+	VertexArrayObject(VertexArrayObject&& from) noexcept : VertexArrayObject() {
+		*this = std::move(from);
+	}
+	VertexArrayObject& operator=(VertexArrayObject&& from) noexcept {
+		if (this == &from) return *this;
+		if (this->name != 0) { gl_state::deleteVertexArray(this->name); }
+		this->name = from.name;
+		from.name = 0;
+		return *this;
+	}
+	~VertexArrayObject() {
+		if (this->name != 0) { gl_state::deleteVertexArray(this->name); }
+	}
+
+	void bind() const {
+		gl_state::bindVertexArray(this->name);
+	}
+};
\ No newline at end of file
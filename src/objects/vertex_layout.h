@@ -0,0 +1,158 @@
+#pragma once
+
+#include <initializer_list>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include <glad/glad.h>
+
+#include "attribute_array.h"
+#include "gl_state.h"
+
+// One element of each attribute, in order
+template<typename... Elements>
+struct PackedVertex;
+
+template<typename Last>
+struct PackedVertex<Last> {
+	Last first;
+};
+
+template<typename First, typename Second, typename... Rest>
+struct PackedVertex<First, Second, Rest...> {
+	First first;
+	PackedVertex<Second, Rest...> rest;
+};
+
+// The I-th element of a PackedVertex
+template<size_t I>
+struct PackedField {
+	template<typename Vertex>
+	static auto& of(Vertex& vertex) {
+		return PackedField<I - 1>::of(vertex.rest);
+	}
+};
+
+template<>
+struct PackedField<0> {
+	template<typename Vertex>
+	static auto& of(Vertex& vertex) {
+		return vertex.first;
+	}
+};
+
+// Offset in bytes of the element at index in a PackedVertex of the given elements
+template<typename... Elements>
+constexpr size_t packedOffset(size_t index) {
+	size_t sizes[] = { sizeof(Elements)... };
+	size_t offset = 0;
+	for (size_t i = 0; i < index; i++) { offset += sizes[i]; }
+	return offset;
+}
+
+// Interleaved vertices of the given attributes, each described by a trait struct as for AttributeArray.
+// The vertex struct, its stride and the offset of each attribute are all worked out at compile time, so that
+// a single buffer feeds every attribute and each vertex fetch reads one contiguous run of bytes
+template<typename... Attributes>
+class VertexLayout {
+public:
+	typedef PackedVertex<typename Attributes::Element...> Vertex;
+
+	template<size_t I>
+	using Attribute = typename std::tuple_element<I, std::tuple<Attributes...>>::type;
+
+	static const GLsizei STRIDE = (GLsizei)packedOffset<typename Attributes::Element...>(sizeof...(Attributes));
+	// Elements keep their natural alignment, so that they can be read in place
+	static_assert(sizeof(Vertex) == STRIDE, "order the attributes so that none of them needs padding");
+
+	template<size_t I>
+	static constexpr size_t offset() {
+		return packedOffset<typename Attributes::Element...>(I);
+	}
+
+	template<size_t I>
+	static typename Attribute<I>::Element& get(Vertex& vertex) {
+		return PackedField<I>::of(vertex);
+	}
+
+	template<size_t I>
+	static typename Attribute<I>::Element const& get(Vertex const& vertex) {
+		return PackedField<I>::of(vertex);
+	}
+
+	// Interleave one stream per attribute, each count elements long
+	static std::vector<Vertex> interleave(size_t count, typename Attributes::Element const*... streams) {
+		auto vertices = std::vector<Vertex>(count);
+		for (size_t i = 0; i < count; i++) {
+			setAll(vertices[i], i, std::index_sequence_for<Attributes...>(), streams...);
+		}
+		return vertices;
+	}
+
+	// Point every attribute at its place in the interleaved buffer bound to GL_ARRAY_BUFFER
+	static void setup() {
+		setupAll(std::index_sequence_for<Attributes...>());
+	}
+
+private:
+	template<size_t... I>
+	static void setAll(
+		Vertex& vertex, size_t i, std::index_sequence<I...>, typename Attributes::Element const*... streams
+	) {
+		(void)std::initializer_list<int>{ (get<I>(vertex) = streams[i], 0)... };
+	}
+
+	template<size_t... I>
+	static void setupAll(std::index_sequence<I...>) {
+		(void)std::initializer_list<int>{ (setupAttribute<Attributes>(offset<I>()), 0)... };
+	}
+
+	template<typename A>
+	static void setupAttribute(size_t offset) {
+		glEnableVertexAttribArray(A::ATTRIBUTE);
+		glVertexAttribPointer(A::ATTRIBUTE, A::SIZE, A::TYPE, A::NORMALIZED, STRIDE, (void const*)offset);
+	}
+};
+
+// Vertex buffer of interleaved vertices in any VertexLayout. The layout only matters when the buffer is built,
+// so its owner can choose one at run time
+class InterleavedArray {
+	GLuint name;
+	void (*setup)();
+
+public:
+	InterleavedArray() : name(0), setup(nullptr) {}
+
+	template<typename Layout>
+	static InterleavedArray of(std::vector<typename Layout::Vertex> const& vertices) {
+		auto array = InterleavedArray();
+		glGenBuffers(1, &array.name);
+		gl_state::bindBuffer(GL_ARRAY_BUFFER, array.name);
+		glBufferData(GL_ARRAY_BUFFER, vertices.size() * Layout::STRIDE, vertices.data(), GL_STATIC_DRAW);
+		array.setup = &Layout::setup;
+		return array;
+	}
+
+	InterleavedArray(InterleavedArray const&) = delete;
+	InterleavedArray& operator=(InterleavedArray const&) = delete;
+	InterleavedArray(InterleavedArray&& from) noexcept : InterleavedArray() {
+		*this = std::move(from);
+	}
+	InterleavedArray& operator=(InterleavedArray&& from) noexcept {
+		if (this == &from) return *this;
+		if (this->name != 0) { gl_state::deleteBuffer(this->name); }
+		this->name = from.name;
+		this->setup = from.setup;
+		from.name = 0;
+		return *this;
+	}
+	~InterleavedArray() {
+		if (this->name != 0) { gl_state::deleteBuffer(this->name); }
+	}
+
+	void bind() const {
+		gl_state::bindBuffer(GL_ARRAY_BUFFER, this->name);
+		this->setup();
+	}
+};
\ No newline at end of file
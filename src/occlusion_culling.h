@@ -0,0 +1,586 @@
+#pragma once
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define OCCLUSION_CULLING_USE_SSE2
+#include <emmintrin.h>
+#endif
+
+#include <glm/glm.hpp>
+
+#include "frustum_culling.h"
+#include "objects/object/mesh_cache.h"
+#include "thread_pool.h"
+
+// Occlusion culling on the CPU. The triangles of designated occluders are rasterized into a small depth buffer,
+// and the farthest depth of each 8x8 tile of it is kept as a coarser level. A box is hidden when its nearest
+// point is still farther than that, in every tile its screen rectangle covers, or failing that, in every pixel.
+//
+// Vertices are transformed, and triangles set up, four at a time with SSE2, in slices across threads. Each slice
+// bins the triangles it set up into the parts of the screen they touch. Bins are then rasterized in parallel, a
+// thread each, taking the triangles of every slice in turn, and their pixels four at a time. A reference path
+// does the same one at a time on one thread, and has to agree with it exactly.
+//
+// Depths are z / w, with near triangles clipped against the near plane. A pixel keeps the farthest depth its
+// triangle reaches within it, so that depths never err towards hiding things. Pixels are covered when their
+// centre is, though, so something peeking out from behind an occluder by less than a pixel of the buffer can be
+// culled
+class OcclusionCulling {
+public:
+	static const int WIDTH = 320;
+	static const int HEIGHT = 192;
+	static const int TILE = 8;	// pixels on each side of a tile of the coarse level
+	static const int TILES_X = WIDTH / TILE;
+	static const int TILES_Y = HEIGHT / TILE;
+	// Bins are whole tiles, and rows of them whole SIMD registers
+	static const int BIN_WIDTH = 64;
+	static const int BIN_HEIGHT = 32;
+	static const int BINS_X = WIDTH / BIN_WIDTH;
+	static const int BINS_Y = HEIGHT / BIN_HEIGHT;
+	// Vertices, triangles or boxes per thread below which work stays on the calling thread
+	static const size_t MIN_SLICE = 4096;
+
+	// Since the last reset
+	struct Stats {
+		size_t frames;
+		size_t triangles;	// rasterized, after back-face culling
+		size_t tested;
+		size_t culled;
+		double rasterSeconds;
+		double testSeconds;
+	};
+
+private:
+	// A triangle set up for rasterizing: its edge functions, positive inside, and its depth plane, in pixels
+	struct ScreenTriangle {
+		float edgeA[3];
+		float edgeB[3];
+		float edgeC[3];
+		float depthA;
+		float depthB;
+		float depthC;
+		int minX;
+		int minY;
+		int maxX;
+		int maxY;
+	};
+	// The triangles one thread set up, and which of them each bin holds
+	struct Slice {
+		std::vector<ScreenTriangle> triangles;
+		std::vector<uint32_t> bins[BINS_X * BINS_Y];
+	};
+
+	std::vector<glm::vec3> vertices;	// of every occluder, in world space
+	std::vector<uint32_t> indices;
+	// Clip space positions of the vertices, one array per component, as of the last render
+	std::vector<float> clipX;
+	std::vector<float> clipY;
+	std::vector<float> clipZ;
+	std::vector<float> clipW;
+	std::vector<Slice> slices;
+	std::vector<float> depth;	// rows from the bottom of the screen
+	std::vector<float> tileDepth;	// farthest depth of each tile
+	glm::mat4 viewProjection;
+	std::vector<uint8_t> keep;	// whether each volume cull tests is visible, kept to reuse its storage
+	ThreadPool* pool;
+	Stats stats;
+
+public:
+	// Render and cull on the workers of the given pool, which has to outlive this
+	explicit OcclusionCulling(ThreadPool& pool) :
+		depth(WIDTH * HEIGHT, FLT_MAX), tileDepth(TILES_X * TILES_Y, FLT_MAX), viewProjection(1.f), pool(&pool),
+		stats()
+	{}
+
+	// Add the triangles of a mesh, placed by model, as occluders
+	void addOccluder(MeshView const& mesh, glm::mat4 const& model) {
+		auto baseVertex = (uint32_t)this->vertices.size();
+		for (GLuint i = 0; i < mesh.vertexCount; i++) {
+			this->vertices.push_back(glm::vec3(model * glm::vec4(mesh.vertices[i], 1.f)));
+		}
+		for (GLuint i = 0; i < mesh.indexCount; i++) { this->indices.push_back(baseVertex + mesh.index(i)); }
+	}
+
+	// Add triangles, with three indices into positions each, placed by model, as occluders
+	void addOccluder(
+		std::vector<glm::vec3> const& positions, std::vector<uint32_t> const& triangles, glm::mat4 const& model
+	) {
+		auto baseVertex = (uint32_t)this->vertices.size();
+		for (auto& position : positions) { this->vertices.push_back(glm::vec3(model * glm::vec4(position, 1.f))); }
+		for (auto index : triangles) { this->indices.push_back(baseVertex + index); }
+	}
+
+	size_t getTriangleCount() const {
+		return this->indices.size() / 3;
+	}
+
+	// Rasterize the front faces of every occluder as seen through viewProjection, replacing what was there
+	void render(glm::mat4 const& viewProjection) {
+		auto start = std::chrono::steady_clock::now();
+		this->viewProjection = viewProjection;
+		auto vertexCount = this->vertices.size();
+		this->resizeClip(vertexCount);
+		parallelFor(*this->pool, vertexCount, MIN_SLICE, [&](size_t begin, size_t end) {
+			this->transform(begin, end, true);
+		});
+
+		auto triangleCount = this->getTriangleCount();
+		auto threadCount = (size_t)this->pool->getThreadCount() + 1;
+		auto sliceCount = std::max<size_t>(1, std::min(threadCount, triangleCount / MIN_SLICE));
+		this->slices.resize(sliceCount);
+		parallelFor(*this->pool, sliceCount, 1, [&](size_t first, size_t last) {
+			for (auto slice = first; slice < last; slice++) {
+				this->setUp(this->slices[slice], triangleCount * slice / sliceCount,
+					triangleCount * (slice + 1) / sliceCount, true);
+			}
+		});
+		parallelFor(*this->pool, BINS_X * BINS_Y, 1, [&](size_t first, size_t last) {
+			for (auto bin = first; bin < last; bin++) { this->rasterize((int)bin, true); }
+		});
+		this->finishFrame(start);
+	}
+
+	// As render, one triangle and one pixel at a time, on the calling thread
+	void renderReference(glm::mat4 const& viewProjection) {
+		auto start = std::chrono::steady_clock::now();
+		this->viewProjection = viewProjection;
+		this->resizeClip(this->vertices.size());
+		this->transform(0, this->vertices.size(), false);
+		this->slices.resize(1);
+		this->setUp(this->slices[0], 0, this->getTriangleCount(), false);
+		for (int bin = 0; bin < BINS_X * BINS_Y; bin++) { this->rasterize(bin, false); }
+		this->finishFrame(start);
+	}
+
+	// Whether any of a box, by its centre and half extents, may be in front of the occluders of the last render
+	bool isVisible(glm::vec3 centre, glm::vec3 extent) const {
+		// Each corner is the centre plus or minus each of the box's axes, all in clip space
+		auto& m = this->viewProjection;
+		auto clipCentre = m * glm::vec4(centre, 1.f);
+		glm::vec4 axes[3] = { m[0] * extent.x, m[1] * extent.y, m[2] * extent.z };
+		auto screenMin = glm::vec2(FLT_MAX);
+		auto screenMax = glm::vec2(-FLT_MAX);
+		auto nearest = FLT_MAX;
+#if defined(OCCLUSION_CULLING_USE_SSE2)
+		// The eight corners as two registers of four per component, the first four on the minus side of the
+		// third axis
+		auto signX = _mm_setr_ps(-1.f, 1.f, -1.f, 1.f);
+		auto signY = _mm_setr_ps(-1.f, -1.f, 1.f, 1.f);
+		__m128 low[4], high[4];
+		for (int component = 0; component < 4; component++) {
+			auto sides = _mm_add_ps(_mm_set1_ps(clipCentre[component]), _mm_add_ps(
+				_mm_mul_ps(signX, _mm_set1_ps(axes[0][component])), _mm_mul_ps(signY, _mm_set1_ps(axes[1][component]))
+			));
+			auto third = _mm_set1_ps(axes[2][component]);
+			low[component] = _mm_sub_ps(sides, third);
+			high[component] = _mm_add_ps(sides, third);
+		}
+		// Boxes reaching past the near plane are too close to hide
+		auto zero = _mm_setzero_ps();
+		if (_mm_movemask_ps(_mm_or_ps(
+			_mm_cmple_ps(_mm_add_ps(low[2], low[3]), zero), _mm_cmple_ps(_mm_add_ps(high[2], high[3]), zero)
+		))) return true;
+		auto one = _mm_set1_ps(1.f);
+		auto lowInverse = _mm_div_ps(one, low[3]);
+		auto highInverse = _mm_div_ps(one, high[3]);
+		auto least = [](__m128 value) {
+			value = _mm_min_ps(value, _mm_shuffle_ps(value, value, _MM_SHUFFLE(2, 3, 0, 1)));
+			return _mm_cvtss_f32(_mm_min_ps(value, _mm_shuffle_ps(value, value, _MM_SHUFFLE(1, 0, 3, 2))));
+		};
+		auto most = [](__m128 value) {
+			value = _mm_max_ps(value, _mm_shuffle_ps(value, value, _MM_SHUFFLE(2, 3, 0, 1)));
+			return _mm_cvtss_f32(_mm_max_ps(value, _mm_shuffle_ps(value, value, _MM_SHUFFLE(1, 0, 3, 2))));
+		};
+		__m128 lowProjected[3], highProjected[3];
+		for (int component = 0; component < 3; component++) {
+			lowProjected[component] = _mm_mul_ps(low[component], lowInverse);
+			highProjected[component] = _mm_mul_ps(high[component], highInverse);
+		}
+		for (int component = 0; component < 2; component++) {
+			screenMin[component] = least(_mm_min_ps(lowProjected[component], highProjected[component]));
+			screenMax[component] = most(_mm_max_ps(lowProjected[component], highProjected[component]));
+		}
+		nearest = least(_mm_min_ps(lowProjected[2], highProjected[2]));
+#else
+		for (int corner = 0; corner < 8; corner++) {
+			auto clip = clipCentre;
+			for (int axis = 0; axis < 3; axis++) { clip += (corner & (1 << axis)) ? axes[axis] : -axes[axis]; }
+			// Boxes reaching past the near plane are too close to hide
+			if (clip.z + clip.w <= 0.f) return true;
+			auto screen = glm::vec2(clip) / clip.w;
+			screenMin = glm::min(screenMin, screen);
+			screenMax = glm::max(screenMax, screen);
+			nearest = std::min(nearest, clip.z / clip.w);
+		}
+#endif
+		auto size = glm::vec2(WIDTH, HEIGHT);
+		screenMin = glm::max((screenMin * 0.5f + 0.5f) * size, glm::vec2(0.f));
+		screenMax = glm::min((screenMax * 0.5f + 0.5f) * size, size - 1.f);
+		// Off the screen is the frustum culling's to decide
+		if (screenMin.x > screenMax.x || screenMin.y > screenMax.y) return true;
+
+		auto minX = (int)screenMin.x;
+		auto minY = (int)screenMin.y;
+		auto maxX = (int)screenMax.x;
+		auto maxY = (int)screenMax.y;
+		for (auto tileY = minY / TILE; tileY <= maxY / TILE; tileY++) {
+			for (auto tileX = minX / TILE; tileX <= maxX / TILE; tileX++) {
+				if (this->tileDepth[tileY * TILES_X + tileX] < nearest) continue;
+				// Some of the tile is farther than the box. It is only seen if that is within the box's rectangle
+				auto x0 = std::max(minX, tileX * TILE);
+				auto x1 = std::min(maxX, tileX * TILE + TILE - 1);
+				auto y1 = std::min(maxY, tileY * TILE + TILE - 1);
+				for (auto y = std::max(minY, tileY * TILE); y <= y1; y++) {
+					auto row = this->depth.data() + y * WIDTH;
+					for (auto x = x0; x <= x1; x++) {
+						if (row[x] >= nearest) return true;
+					}
+				}
+			}
+		}
+		return false;
+	}
+
+	// Remove from visible the volumes whose boxes the occluders of the last render hide, keeping the order of the
+	// rest
+	void cull(frustum_culling::Volumes const& volumes, std::vector<uint32_t>& visible) {
+		auto start = std::chrono::steady_clock::now();
+		auto tested = visible.size();
+		// Boxes are tested across threads, and the visible ones kept afterwards
+		this->keep.resize(tested);
+		parallelFor(*this->pool, tested, MIN_SLICE, [&](size_t begin, size_t end) {
+			for (auto i = begin; i < end; i++) {
+				auto volume = visible[i];
+				this->keep[i] = this->isVisible(
+					glm::vec3(volumes.centreX[volume], volumes.centreY[volume], volumes.centreZ[volume]),
+					glm::vec3(volumes.extentX[volume], volumes.extentY[volume], volumes.extentZ[volume])
+				);
+			}
+		});
+		size_t kept = 0;
+		for (size_t i = 0; i < tested; i++) {
+			if (this->keep[i]) { visible[kept++] = visible[i]; }
+		}
+		visible.resize(kept);
+		this->stats.tested += tested;
+		this->stats.culled += tested - visible.size();
+		this->stats.testSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	// WIDTH x HEIGHT depths, rows from the bottom of the screen, FLT_MAX where no occluder is
+	float const* getDepth() const {
+		return this->depth.data();
+	}
+
+	Stats const& getStats() const {
+		return this->stats;
+	}
+
+	void resetStats() {
+		this->stats = Stats();
+	}
+
+private:
+	void resizeClip(size_t count) {
+		for (auto array : { &this->clipX, &this->clipY, &this->clipZ, &this->clipW }) { array->resize(count); }
+	}
+
+	void finishFrame(std::chrono::steady_clock::time_point start) {
+		for (auto& slice : this->slices) { this->stats.triangles += slice.triangles.size(); }
+		this->stats.frames++;
+		this->stats.rasterSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	// Clip space positions of the vertices among [begin, end). Sums are in the same order with and without SIMD,
+	// so that both round the same way
+	void transform(size_t begin, size_t end, bool simd) {
+		auto& m = this->viewProjection;
+		auto i = begin;
+#if defined(OCCLUSION_CULLING_USE_SSE2)
+		if (simd) {
+			__m128 columns[4][4];
+			for (int column = 0; column < 4; column++) {
+				for (int row = 0; row < 4; row++) { columns[column][row] = _mm_set1_ps(m[column][row]); }
+			}
+			float* outputs[4] = { this->clipX.data(), this->clipY.data(), this->clipZ.data(), this->clipW.data() };
+			for (; i + 4 <= end; i += 4) {
+				auto v = this->vertices.data() + i;
+				auto x = _mm_setr_ps(v[0].x, v[1].x, v[2].x, v[3].x);
+				auto y = _mm_setr_ps(v[0].y, v[1].y, v[2].y, v[3].y);
+				auto z = _mm_setr_ps(v[0].z, v[1].z, v[2].z, v[3].z);
+				for (int row = 0; row < 4; row++) {
+					auto clip = _mm_add_ps(_mm_mul_ps(columns[0][row], x), _mm_mul_ps(columns[1][row], y));
+					clip = _mm_add_ps(_mm_add_ps(clip, _mm_mul_ps(columns[2][row], z)), columns[3][row]);
+					_mm_storeu_ps(outputs[row] + i, clip);
+				}
+			}
+		}
+#endif
+		for (; i < end; i++) {
+			auto& v = this->vertices[i];
+			this->clipX[i] = m[0][0] * v.x + m[1][0] * v.y + m[2][0] * v.z + m[3][0];
+			this->clipY[i] = m[0][1] * v.x + m[1][1] * v.y + m[2][1] * v.z + m[3][1];
+			this->clipZ[i] = m[0][2] * v.x + m[1][2] * v.y + m[2][2] * v.z + m[3][2];
+			this->clipW[i] = m[0][3] * v.x + m[1][3] * v.y + m[2][3] * v.z + m[3][3];
+		}
+	}
+
+	// Set up and bin the triangles among [begin, end) into slice, four at a time with SIMD. Triangles reaching
+	// past the near plane are clipped, one at a time
+	void setUp(Slice& slice, size_t begin, size_t end, bool simd) {
+		slice.triangles.clear();
+		for (auto& bin : slice.bins) { bin.clear(); }
+		auto i = begin;
+#if defined(OCCLUSION_CULLING_USE_SSE2)
+		if (simd) {
+			auto zero = _mm_setzero_ps();
+			auto one = _mm_set1_ps(1.f);
+			auto half = _mm_set1_ps(0.5f);
+			auto width = _mm_set1_ps((float)WIDTH);
+			auto height = _mm_set1_ps((float)HEIGHT);
+			auto notSign = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+			for (; i + 4 <= end; i += 4) {
+				auto corners = this->indices.data() + 3 * i;
+				__m128 x[3], y[3], z[3];
+				auto inFront = _mm_castsi128_ps(_mm_set1_epi32(-1));
+				for (int c = 0; c < 3; c++) {
+					auto gather = [&](std::vector<float> const& component) {
+						return _mm_setr_ps(component[corners[c]], component[corners[3 + c]], component[corners[6 + c]],
+							component[corners[9 + c]]);
+					};
+					auto w = gather(this->clipW);
+					z[c] = gather(this->clipZ);
+					inFront = _mm_and_ps(inFront, _mm_cmpge_ps(_mm_add_ps(z[c], w), zero));
+					auto inverse = _mm_div_ps(one, w);
+					auto toScreen = [&](__m128 clip, __m128 size) {
+						return _mm_mul_ps(_mm_add_ps(_mm_mul_ps(_mm_mul_ps(clip, inverse), half), half), size);
+					};
+					x[c] = toScreen(gather(this->clipX), width);
+					y[c] = toScreen(gather(this->clipY), height);
+					z[c] = _mm_mul_ps(z[c], inverse);
+				}
+				// Edge c is opposite corner c, and weighs its depth
+				__m128 a[3], b[3], constant[3];
+				for (int c = 0; c < 3; c++) {
+					auto from = (c + 1) % 3;
+					auto to = (c + 2) % 3;
+					a[c] = _mm_sub_ps(y[from], y[to]);
+					b[c] = _mm_sub_ps(x[to], x[from]);
+					constant[c] = _mm_sub_ps(_mm_mul_ps(x[from], y[to]), _mm_mul_ps(x[to], y[from]));
+				}
+				auto area = _mm_sub_ps(
+					_mm_mul_ps(_mm_sub_ps(x[1], x[0]), _mm_sub_ps(y[2], y[0])),
+					_mm_mul_ps(_mm_sub_ps(x[2], x[0]), _mm_sub_ps(y[1], y[0]))
+				);
+				auto inverseArea = _mm_div_ps(one, area);
+				auto plane = [&](__m128 const (&coefficients)[3]) {
+					return _mm_mul_ps(_mm_add_ps(_mm_add_ps(
+						_mm_mul_ps(coefficients[0], z[0]), _mm_mul_ps(coefficients[1], z[1])),
+						_mm_mul_ps(coefficients[2], z[2])), inverseArea
+					);
+				};
+				auto depthA = plane(a);
+				auto depthB = plane(b);
+				auto reach = _mm_mul_ps(_mm_add_ps(_mm_and_ps(depthA, notSign), _mm_and_ps(depthB, notSign)), half);
+				auto depthC = _mm_add_ps(plane(constant), reach);
+
+				alignas(16) float lanes[16][4];
+				auto store = [&](int index, __m128 value) { _mm_store_ps(lanes[index], value); };
+				for (int c = 0; c < 3; c++) {
+					store(c, x[c]);
+					store(3 + c, y[c]);
+					store(6 + c, a[c]);
+					store(9 + c, b[c]);
+					store(12 + c, constant[c]);
+				}
+				store(15, area);
+				alignas(16) float depths[3][4];
+				_mm_store_ps(depths[0], depthA);
+				_mm_store_ps(depths[1], depthB);
+				_mm_store_ps(depths[2], depthC);
+				auto front = _mm_movemask_ps(inFront);
+				for (int lane = 0; lane < 4; lane++) {
+					if (!(front & (1 << lane))) {
+						this->setUpClipped(slice, i + lane);
+						continue;
+					}
+					auto triangle = ScreenTriangle();
+					for (int c = 0; c < 3; c++) {
+						triangle.edgeA[c] = lanes[6 + c][lane];
+						triangle.edgeB[c] = lanes[9 + c][lane];
+						triangle.edgeC[c] = lanes[12 + c][lane];
+					}
+					triangle.depthA = depths[0][lane];
+					triangle.depthB = depths[1][lane];
+					triangle.depthC = depths[2][lane];
+					float xs[3] = { lanes[0][lane], lanes[1][lane], lanes[2][lane] };
+					float ys[3] = { lanes[3][lane], lanes[4][lane], lanes[5][lane] };
+					this->bin(slice, triangle, lanes[15][lane], xs, ys);
+				}
+			}
+		}
+#endif
+		for (; i < end; i++) { this->setUpClipped(slice, i); }
+	}
+
+	// Set up one triangle, clipped against the near plane into up to two
+	void setUpClipped(Slice& slice, size_t triangle) {
+		glm::vec4 corners[3];
+		for (int c = 0; c < 3; c++) {
+			auto index = this->indices[3 * triangle + c];
+			corners[c] = glm::vec4(this->clipX[index], this->clipY[index], this->clipZ[index], this->clipW[index]);
+		}
+		// In front of the near plane where z + w >= 0, as OpenGL clips
+		glm::vec4 clipped[4];
+		auto count = 0;
+		for (int c = 0; c < 3; c++) {
+			auto& from = corners[c];
+			auto& to = corners[(c + 1) % 3];
+			auto fromDistance = from.z + from.w;
+			auto toDistance = to.z + to.w;
+			if (fromDistance >= 0.f) { clipped[count++] = from; }
+			if ((fromDistance >= 0.f) != (toDistance >= 0.f)) {
+				clipped[count++] = from + (to - from) * (fromDistance / (fromDistance - toDistance));
+			}
+		}
+		for (int c = 2; c < count; c++) { this->setUpScreen(slice, clipped[0], clipped[c - 1], clipped[c]); }
+	}
+
+	// Set up one triangle wholly in front of the near plane, as the SIMD path does four
+	void setUpScreen(Slice& slice, glm::vec4 const& corner0, glm::vec4 const& corner1, glm::vec4 const& corner2) {
+		glm::vec4 const* corners[3] = { &corner0, &corner1, &corner2 };
+		float x[3], y[3], z[3];
+		for (int c = 0; c < 3; c++) {
+			auto inverse = 1.f / corners[c]->w;
+			x[c] = (corners[c]->x * inverse * 0.5f + 0.5f) * WIDTH;
+			y[c] = (corners[c]->y * inverse * 0.5f + 0.5f) * HEIGHT;
+			z[c] = corners[c]->z * inverse;
+		}
+		auto triangle = ScreenTriangle();
+		for (int c = 0; c < 3; c++) {
+			auto from = (c + 1) % 3;
+			auto to = (c + 2) % 3;
+			triangle.edgeA[c] = y[from] - y[to];
+			triangle.edgeB[c] = x[to] - x[from];
+			triangle.edgeC[c] = x[from] * y[to] - x[to] * y[from];
+		}
+		auto area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+		auto inverseArea = 1.f / area;
+		auto plane = [&](float const (&coefficients)[3]) {
+			return (coefficients[0] * z[0] + coefficients[1] * z[1] + coefficients[2] * z[2]) * inverseArea;
+		};
+		triangle.depthA = plane(triangle.edgeA);
+		triangle.depthB = plane(triangle.edgeB);
+		triangle.depthC = plane(triangle.edgeC) + (std::abs(triangle.depthA) + std::abs(triangle.depthB)) * 0.5f;
+		this->bin(slice, triangle, area, x, y);
+	}
+
+	// Add a set up triangle to the slice, and to the bins its bounds touch, unless it faces away or is off the
+	// screen. Its depth plane gives the farthest depth within each pixel, rather than at its centre
+	void bin(Slice& slice, ScreenTriangle& triangle, float area, float const (&x)[3], float const (&y)[3]) {
+		// Counter-clockwise triangles face the camera, as OpenGL has them by default
+		if (!(area > 0.f)) return;
+		auto minX = std::max(std::min(std::min(x[0], x[1]), x[2]), 0.f);
+		auto minY = std::max(std::min(std::min(y[0], y[1]), y[2]), 0.f);
+		auto maxX = std::min(std::max(std::max(x[0], x[1]), x[2]), WIDTH - 1.f);
+		auto maxY = std::min(std::max(std::max(y[0], y[1]), y[2]), HEIGHT - 1.f);
+		if (!(minX <= maxX && minY <= maxY)) return;
+		triangle.minX = (int)minX;
+		triangle.minY = (int)minY;
+		triangle.maxX = (int)maxX;
+		triangle.maxY = (int)maxY;
+
+		auto index = (uint32_t)slice.triangles.size();
+		slice.triangles.push_back(triangle);
+		for (auto binY = triangle.minY / BIN_HEIGHT; binY <= triangle.maxY / BIN_HEIGHT; binY++) {
+			for (auto binX = triangle.minX / BIN_WIDTH; binX <= triangle.maxX / BIN_WIDTH; binX++) {
+				slice.bins[binY * BINS_X + binX].push_back(index);
+			}
+		}
+	}
+
+	// Rasterize the triangles of every slice in a bin, four pixels at a time with SIMD, then find the farthest
+	// depth of each of its tiles. Bins share no pixels, so each can be rasterized on a thread of its own
+	void rasterize(int bin, bool simd) {
+		auto binX = bin % BINS_X * BIN_WIDTH;
+		auto binY = bin / BINS_X * BIN_HEIGHT;
+		for (auto y = binY; y < binY + BIN_HEIGHT; y++) {
+			auto row = this->depth.begin() + y * WIDTH + binX;
+			std::fill(row, row + BIN_WIDTH, FLT_MAX);
+		}
+
+		for (auto& slice : this->slices) {
+			for (auto index : slice.bins[bin]) {
+				auto& triangle = slice.triangles[index];
+				auto minX = std::max(triangle.minX, binX);
+				auto maxX = std::min(triangle.maxX, binX + BIN_WIDTH - 1);
+				auto minY = std::max(triangle.minY, binY);
+				auto maxY = std::min(triangle.maxY, binY + BIN_HEIGHT - 1);
+				for (auto y = minY; y <= maxY; y++) {
+					auto row = this->depth.data() + y * WIDTH;
+					auto centreY = y + 0.5f;
+					// The part of each edge function, and of the depth, that is the same along the row
+					float rowEdges[3];
+					for (int c = 0; c < 3; c++) { rowEdges[c] = triangle.edgeB[c] * centreY + triangle.edgeC[c]; }
+					auto rowDepth = triangle.depthB * centreY + triangle.depthC;
+					auto x = minX;
+#if defined(OCCLUSION_CULLING_USE_SSE2)
+					if (simd) {
+						// From a multiple of four, which the bin's rows are too, so the last four stay in the bin.
+						// Pixels beyond the triangle's bounds are outside its edges
+						x = minX & ~3;
+						auto zero = _mm_setzero_ps();
+						__m128 a[3], edgeRow[3];
+						for (int c = 0; c < 3; c++) {
+							a[c] = _mm_set1_ps(triangle.edgeA[c]);
+							edgeRow[c] = _mm_set1_ps(rowEdges[c]);
+						}
+						auto depthA = _mm_set1_ps(triangle.depthA);
+						auto depthRow = _mm_set1_ps(rowDepth);
+						auto centreX = _mm_add_ps(_mm_set1_ps((float)x), _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f));
+						auto four = _mm_set1_ps(4.f);
+						for (; x <= maxX; x += 4) {
+							auto inside = _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a[0], centreX), edgeRow[0]), zero);
+							inside = _mm_and_ps(inside,
+								_mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a[1], centreX), edgeRow[1]), zero));
+							inside = _mm_and_ps(inside,
+								_mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a[2], centreX), edgeRow[2]), zero));
+							auto depth = _mm_add_ps(_mm_mul_ps(depthA, centreX), depthRow);
+							auto old = _mm_loadu_ps(row + x);
+							auto nearer = _mm_min_ps(old, depth);
+							_mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearer), _mm_andnot_ps(inside, old)));
+							centreX = _mm_add_ps(centreX, four);
+						}
+					}
+#endif
+					for (; x <= maxX; x++) {
+						auto centreX = x + 0.5f;
+						if (triangle.edgeA[0] * centreX + rowEdges[0] >= 0.f &&
+							triangle.edgeA[1] * centreX + rowEdges[1] >= 0.f &&
+							triangle.edgeA[2] * centreX + rowEdges[2] >= 0.f
+						) {
+							row[x] = std::min(row[x], triangle.depthA * centreX + rowDepth);
+						}
+					}
+				}
+			}
+		}
+
+		for (auto tileY = binY / TILE; tileY < (binY + BIN_HEIGHT) / TILE; tileY++) {
+			for (auto tileX = binX / TILE; tileX < (binX + BIN_WIDTH) / TILE; tileX++) {
+				auto farthest = -FLT_MAX;
+				for (auto y = tileY * TILE; y < tileY * TILE + TILE; y++) {
+					auto row = this->depth.data() + y * WIDTH + tileX * TILE;
+					farthest = std::max(farthest, *std::max_element(row, row + TILE));
+				}
+				this->tileDepth[tileY * TILES_X + tileX] = farthest;
+			}
+		}
+	}
+};
\ No newline at end of file
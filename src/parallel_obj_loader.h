@@ -0,0 +1,430 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "tiny_obj_loader.h"
+#include "mapped_file.h"
+
+// A drop-in replacement for tinyobj::LoadObj for large OBJ files. The file is memory-mapped and split into
+// newline-aligned chunks that are parsed on separate threads, and the per-chunk results are then stitched
+// together into the usual attrib_t/shape_t structures.
+//
+// Differences from tinyobj: polygons are fan-triangulated, which matches tinyobj for convex faces only;
+// vertex colours, lines and tags are not read; a `usemtl` may refer to a material from a later `mtllib`.
+namespace parallel_obj {
+
+	// Files smaller than this are parsed on the calling thread, as starting threads would cost more than it saves
+	const size_t MIN_CHUNK_SIZE = 1 << 20;
+
+	// Material and smoothing group state not known until the chunks before are parsed
+	const int INHERITED_MATERIAL = -2;
+	const unsigned int INHERITED_SMOOTHING = 0xFFFFFFFF;
+
+	// Bits set on a corner for each of its indices that are relative to the current attribute count
+	const uint8_t RELATIVE_VERTEX = 1;
+	const uint8_t RELATIVE_NORMAL = 2;
+	const uint8_t RELATIVE_TEXCOORD = 4;
+
+	// Everything parsed from a single chunk of the file. Relative indices are kept relative to the first
+	// attribute of the chunk until the attribute counts of the previous chunks are known
+	struct Chunk {
+		std::vector<tinyobj::real_t> vertices;
+		std::vector<tinyobj::real_t> normals;
+		std::vector<tinyobj::real_t> texcoords;
+		std::vector<tinyobj::index_t> corners; // 3 per triangle
+		std::vector<uint8_t> relative; // RELATIVE_* bits, 1 per corner
+		std::vector<int> materials; // index into materialNames, or INHERITED_MATERIAL. 1 per triangle
+		std::vector<unsigned int> smoothing; // 1 per triangle
+		std::vector<std::string> materialNames;
+		std::vector<std::string> materialLibraries;
+		std::vector<std::pair<size_t, std::string>> shapeStarts; // triangle index, shape name
+		int lastMaterial;
+		unsigned int lastSmoothing;
+		size_t line; // line number of the first line that failed to parse, or 0
+		bool ok;
+
+		Chunk() : lastMaterial(INHERITED_MATERIAL), lastSmoothing(INHERITED_SMOOTHING), line(0), ok(true) {}
+	};
+
+	inline bool isSpace(char c) {
+		return c == ' ' || c == '\t';
+	}
+	inline bool isNewLine(char c) {
+		return c == '\r' || c == '\n' || c == '\0';
+	}
+	inline char const* skipSpace(char const* p, char const* end) {
+		while (p < end && isSpace(*p)) p++;
+		return p;
+	}
+
+	// Parse a decimal floating point number, in a single pass and without locale lookups.
+	// Digits past the 19th are only used for their magnitude, which is well below float precision
+	inline char const* parseFloat(char const* p, char const* end, tinyobj::real_t& out) {
+		static const double POWERS[] = {
+			1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+			1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+		};
+		p = skipSpace(p, end);
+		auto negative = false;
+		if (p < end && (*p == '-' || *p == '+')) {
+			negative = *p == '-';
+			p++;
+		}
+		uint64_t mantissa = 0;
+		int exponent = 0;
+		int digits = 0;
+		for (; p < end && *p >= '0' && *p <= '9'; p++) {
+			if (digits < 19) { mantissa = mantissa * 10 + (*p - '0'); digits += mantissa != 0; }
+			else { exponent++; }
+		}
+		if (p < end && *p == '.') {
+			for (p++; p < end && *p >= '0' && *p <= '9'; p++) {
+				if (digits < 19) {
+					mantissa = mantissa * 10 + (*p - '0');
+					digits += mantissa != 0;
+					exponent--;
+				}
+			}
+		}
+		if (p < end && (*p == 'e' || *p == 'E')) {
+			p++;
+			auto negativeExponent = false;
+			if (p < end && (*p == '-' || *p == '+')) {
+				negativeExponent = *p == '-';
+				p++;
+			}
+			int value = 0;
+			for (; p < end && *p >= '0' && *p <= '9'; p++) {
+				if (value < 10000) value = value * 10 + (*p - '0');
+			}
+			exponent += negativeExponent ? -value : value;
+		}
+
+		double result = (double)mantissa;
+		if (exponent < 0) {
+			result = exponent >= -22 ? result / POWERS[-exponent] : result * std::pow(10.0, exponent);
+		} else if (exponent > 0) {
+			result = exponent <= 22 ? result * POWERS[exponent] : result * std::pow(10.0, exponent);
+		}
+		out = (tinyobj::real_t)(negative ? -result : result);
+		return p;
+	}
+
+	inline char const* parseInt(char const* p, char const* end, int& out) {
+		auto negative = false;
+		if (p < end && (*p == '-' || *p == '+')) {
+			negative = *p == '-';
+			p++;
+		}
+		int value = 0;
+		for (; p < end && *p >= '0' && *p <= '9'; p++) {
+			value = value * 10 + (*p - '0');
+		}
+		out = negative ? -value : value;
+		return p;
+	}
+
+	// Turn a 1-based OBJ index into a 0-based one. Negative (relative) indices are made relative to the
+	// chunk's first attribute, and flagged so they can be fixed up once the chunk's offset is known
+	inline bool fixIndex(int index, size_t chunkCount, uint8_t relativeBit, int& out, uint8_t& relative) {
+		if (index > 0) {
+			out = index - 1;
+			return true;
+		}
+		if (index < 0) {
+			out = (int)chunkCount + index;
+			relative |= relativeBit;
+			return true;
+		}
+		return false; // zero is not allowed according to the spec
+	}
+
+	// Parse a single v, v/vt, v//vn or v/vt/vn face corner
+	inline char const* parseCorner(
+		char const* p, char const* end, Chunk const& chunk, tinyobj::index_t& corner, uint8_t& relative, bool& ok
+	) {
+		corner.vertex_index = corner.normal_index = corner.texcoord_index = -1;
+		relative = 0;
+		int value;
+		p = parseInt(p, end, value);
+		ok = fixIndex(value, chunk.vertices.size() / 3, RELATIVE_VERTEX, corner.vertex_index, relative);
+		if (p < end && *p == '/') {
+			p++;
+			if (p < end && *p != '/') {
+				p = parseInt(p, end, value);
+				ok = ok && fixIndex(value, chunk.texcoords.size() / 2, RELATIVE_TEXCOORD, corner.texcoord_index, relative);
+			}
+			if (p < end && *p == '/') {
+				p = parseInt(p + 1, end, value);
+				ok = ok && fixIndex(value, chunk.normals.size() / 3, RELATIVE_NORMAL, corner.normal_index, relative);
+			}
+		}
+		return p;
+	}
+
+	// The rest of the line, without trailing whitespace
+	inline std::string parseName(char const* p, char const* end) {
+		p = skipSpace(p, end);
+		auto last = p;
+		while (last < end && !isNewLine(*last)) last++;
+		while (last > p && isSpace(last[-1])) last--;
+		return std::string(p, last);
+	}
+
+	inline bool startsWith(char const* p, char const* end, char const* keyword) {
+		auto length = strlen(keyword);
+		return (size_t)(end - p) > length && strncmp(p, keyword, length) == 0 && isSpace(p[length]);
+	}
+
+	// Parse every line in [begin, end). begin must be the start of a line
+	inline void parseChunk(char const* begin, char const* end, Chunk& chunk) {
+		auto faceCorners = std::vector<tinyobj::index_t>();
+		auto faceRelative = std::vector<uint8_t>();
+		size_t line = 0;
+
+		for (auto p = begin; p < end; line++) {
+			auto lineEnd = (char const*)memchr(p, '\n', end - p);
+			if (!lineEnd) lineEnd = end;
+			auto next = lineEnd + 1;
+			p = skipSpace(p, lineEnd);
+
+			if (p + 1 < lineEnd && p[0] == 'v' && isSpace(p[1])) {
+				tinyobj::real_t x, y, z;
+				p = parseFloat(p + 2, lineEnd, x);
+				p = parseFloat(p, lineEnd, y);
+				parseFloat(p, lineEnd, z);
+				chunk.vertices.push_back(x);
+				chunk.vertices.push_back(y);
+				chunk.vertices.push_back(z);
+			} else if (p + 2 < lineEnd && p[0] == 'v' && p[1] == 'n' && isSpace(p[2])) {
+				tinyobj::real_t x, y, z;
+				p = parseFloat(p + 3, lineEnd, x);
+				p = parseFloat(p, lineEnd, y);
+				parseFloat(p, lineEnd, z);
+				chunk.normals.push_back(x);
+				chunk.normals.push_back(y);
+				chunk.normals.push_back(z);
+			} else if (p + 2 < lineEnd && p[0] == 'v' && p[1] == 't' && isSpace(p[2])) {
+				tinyobj::real_t x, y;
+				p = parseFloat(p + 3, lineEnd, x);
+				parseFloat(p, lineEnd, y);
+				chunk.texcoords.push_back(x);
+				chunk.texcoords.push_back(y);
+			} else if (p + 1 < lineEnd && p[0] == 'f' && isSpace(p[1])) {
+				faceCorners.clear();
+				faceRelative.clear();
+				p = skipSpace(p + 2, lineEnd);
+				while (p < lineEnd && !isNewLine(*p)) {
+					tinyobj::index_t corner;
+					uint8_t relative;
+					bool ok;
+					p = parseCorner(p, lineEnd, chunk, corner, relative, ok);
+					if (!ok) {
+						chunk.ok = false;
+						chunk.line = line;
+						return;
+					}
+					faceCorners.push_back(corner);
+					faceRelative.push_back(relative);
+					p = skipSpace(p, lineEnd);
+				}
+				for (size_t k = 2; k < faceCorners.size(); k++) {
+					size_t fan[3] = { 0, k - 1, k };
+					for (auto c : fan) {
+						chunk.corners.push_back(faceCorners[c]);
+						chunk.relative.push_back(faceRelative[c]);
+					}
+					chunk.materials.push_back(chunk.lastMaterial);
+					chunk.smoothing.push_back(chunk.lastSmoothing);
+				}
+			} else if (startsWith(p, lineEnd, "usemtl")) {
+				auto name = parseName(p + 7, lineEnd);
+				auto found = std::find(chunk.materialNames.begin(), chunk.materialNames.end(), name);
+				chunk.lastMaterial = (int)(found - chunk.materialNames.begin());
+				if (found == chunk.materialNames.end()) chunk.materialNames.push_back(name);
+			} else if (startsWith(p, lineEnd, "mtllib")) {
+				auto names = std::istringstream(parseName(p + 7, lineEnd));
+				std::string name;
+				while (names >> name) chunk.materialLibraries.push_back(name);
+			} else if (p + 1 < lineEnd && (p[0] == 'o' || p[0] == 'g') && isSpace(p[1])) {
+				chunk.shapeStarts.push_back(std::make_pair(chunk.materials.size(), parseName(p + 2, lineEnd)));
+			} else if (p + 1 < lineEnd && p[0] == 's' && isSpace(p[1])) {
+				auto value = parseName(p + 2, lineEnd);
+				chunk.lastSmoothing = value == "off" ? 0 : (unsigned int)std::max(0, atoi(value.c_str()));
+			}
+			p = next;
+		}
+	}
+
+	// Load the OBJ at the given path, splitting the work across up to threadCount threads
+	// (0 to use every hardware thread). Arguments and return value are as for tinyobj::LoadObj
+	inline bool load(
+		tinyobj::attrib_t* attrib, std::vector<tinyobj::shape_t>* shapes,
+		std::vector<tinyobj::material_t>* materials, std::string* warn, std::string* err,
+		char const* path, unsigned int threadCount = 0
+	) {
+		std::string ignored;
+		if (!warn) warn = &ignored;
+		if (!err) err = &ignored;
+
+		auto file = MappedFile(path);
+		if (!file.isValid()) {
+			FileStamp stamp;
+			if (!FileStamp::of(path, stamp) || stamp.size != 0) {
+				*err += "Cannot open file [" + std::string(path) + "]\n";
+				return false;
+			}
+		}
+		auto begin = (char const*)file.getBytes();
+		auto end = begin + file.getSize();
+
+		if (threadCount == 0) threadCount = std::max(1u, std::thread::hardware_concurrency());
+		auto chunkCount = std::max<size_t>(1, std::min<size_t>(threadCount, file.getSize() / MIN_CHUNK_SIZE));
+
+		// Split at the first newline after each even split point
+		auto bounds = std::vector<char const*>(chunkCount + 1, end);
+		bounds[0] = begin;
+		for (size_t i = 1; i < chunkCount; i++) {
+			auto split = std::max(bounds[i - 1], begin + file.getSize() * i / chunkCount);
+			auto newline = (char const*)memchr(split, '\n', end - split);
+			bounds[i] = newline ? newline + 1 : end;
+		}
+
+		auto chunks = std::vector<Chunk>(chunkCount);
+		auto workers = std::vector<std::thread>();
+		for (size_t i = 1; i < chunkCount; i++) {
+			workers.emplace_back(parseChunk, bounds[i], bounds[i + 1], std::ref(chunks[i]));
+		}
+		parseChunk(bounds[0], bounds[1], chunks[0]);
+		for (auto& worker : workers) worker.join();
+		workers.clear();
+
+		for (size_t i = 0; i < chunkCount; i++) {
+			if (!chunks[i].ok) {
+				// Line numbers are only known within a chunk, so count the lines before it
+				auto line = (size_t)std::count(begin, bounds[i], '\n') + chunks[i].line + 1;
+				*err += "Failed parse `f' line(e.g. zero value for face index. line " + std::to_string(line) + ".)\n";
+				return false;
+			}
+		}
+
+		// Materials, from the material libraries in the order they were referenced
+		auto materialMap = std::map<std::string, int>();
+		auto loadedLibrary = false;
+		for (auto& chunk : chunks) {
+			for (auto& library : chunk.materialLibraries) {
+				if (loadedLibrary) break;
+				auto stream = std::ifstream(library);
+				if (!stream) {
+					*warn += "Material file [ " + library + " ] not found.\n";
+					continue;
+				}
+				tinyobj::LoadMtl(&materialMap, materials, &stream, warn, err);
+				loadedLibrary = true;
+			}
+		}
+		if (!loadedLibrary && std::any_of(chunks.begin(), chunks.end(), [](Chunk const& c) {
+			return !c.materialLibraries.empty();
+		})) {
+			*warn += "Failed to load material file(s). Use default material.\n";
+		}
+
+		// Offsets of each chunk's attributes and triangles, and the material and smoothing group in effect
+		// at its start, all of which depend on the chunks before it
+		auto vertexOffsets = std::vector<size_t>(chunkCount + 1, 0);
+		auto normalOffsets = std::vector<size_t>(chunkCount + 1, 0);
+		auto texcoordOffsets = std::vector<size_t>(chunkCount + 1, 0);
+		auto startMaterials = std::vector<int>(chunkCount, -1);
+		auto startSmoothing = std::vector<unsigned int>(chunkCount, 0);
+		for (size_t i = 0; i < chunkCount; i++) {
+			auto& chunk = chunks[i];
+			vertexOffsets[i + 1] = vertexOffsets[i] + chunk.vertices.size();
+			normalOffsets[i + 1] = normalOffsets[i] + chunk.normals.size();
+			texcoordOffsets[i + 1] = texcoordOffsets[i] + chunk.texcoords.size();
+			if (i + 1 < chunkCount) {
+				auto material = chunk.lastMaterial;
+				startMaterials[i + 1] = material == INHERITED_MATERIAL ? startMaterials[i] :
+					materialMap.count(chunk.materialNames[material]) ? materialMap[chunk.materialNames[material]] : -1;
+				startSmoothing[i + 1] = chunk.lastSmoothing == INHERITED_SMOOTHING ?
+					startSmoothing[i] : chunk.lastSmoothing;
+			}
+		}
+
+		attrib->vertices.resize(vertexOffsets[chunkCount]);
+		attrib->normals.resize(normalOffsets[chunkCount]);
+		attrib->texcoords.resize(texcoordOffsets[chunkCount]);
+		attrib->colors.clear();
+
+		// Copy each chunk's attributes into place and turn its indices into absolute ones
+		auto fixUp = [&](size_t i) {
+			auto& chunk = chunks[i];
+			std::copy(chunk.vertices.begin(), chunk.vertices.end(), attrib->vertices.begin() + vertexOffsets[i]);
+			std::copy(chunk.normals.begin(), chunk.normals.end(), attrib->normals.begin() + normalOffsets[i]);
+			std::copy(chunk.texcoords.begin(), chunk.texcoords.end(), attrib->texcoords.begin() + texcoordOffsets[i]);
+			chunk.vertices = std::vector<tinyobj::real_t>();
+			chunk.normals = std::vector<tinyobj::real_t>();
+			chunk.texcoords = std::vector<tinyobj::real_t>();
+
+			for (size_t c = 0; c < chunk.corners.size(); c++) {
+				auto relative = chunk.relative[c];
+				auto& corner = chunk.corners[c];
+				if (relative & RELATIVE_VERTEX) corner.vertex_index += (int)(vertexOffsets[i] / 3);
+				if (relative & RELATIVE_NORMAL) corner.normal_index += (int)(normalOffsets[i] / 3);
+				if (relative & RELATIVE_TEXCOORD) corner.texcoord_index += (int)(texcoordOffsets[i] / 2);
+			}
+			auto materialIds = std::vector<int>(chunk.materialNames.size(), -1);
+			for (size_t m = 0; m < chunk.materialNames.size(); m++) {
+				auto found = materialMap.find(chunk.materialNames[m]);
+				if (found != materialMap.end()) materialIds[m] = found->second;
+			}
+			for (auto& material : chunk.materials) {
+				material = material == INHERITED_MATERIAL ? startMaterials[i] : materialIds[material];
+			}
+			for (auto& smoothing : chunk.smoothing) {
+				if (smoothing == INHERITED_SMOOTHING) smoothing = startSmoothing[i];
+			}
+		};
+		for (size_t i = 1; i < chunkCount; i++) workers.emplace_back(fixUp, i);
+		fixUp(0);
+		for (auto& worker : workers) worker.join();
+
+		// Stitch the chunks' triangles into shapes, starting a new shape at each `o` or `g`
+		shapes->clear();
+		auto shape = tinyobj::shape_t();
+		auto appendTriangles = [&](Chunk const& chunk, size_t from, size_t to) {
+			shape.mesh.indices.insert(
+				shape.mesh.indices.end(), chunk.corners.begin() + 3 * from, chunk.corners.begin() + 3 * to
+			);
+			shape.mesh.num_face_vertices.insert(shape.mesh.num_face_vertices.end(), to - from, 3);
+			shape.mesh.material_ids.insert(
+				shape.mesh.material_ids.end(), chunk.materials.begin() + from, chunk.materials.begin() + to
+			);
+			shape.mesh.smoothing_group_ids.insert(
+				shape.mesh.smoothing_group_ids.end(), chunk.smoothing.begin() + from, chunk.smoothing.begin() + to
+			);
+		};
+		for (auto& chunk : chunks) {
+			size_t from = 0;
+			for (auto& start : chunk.shapeStarts) {
+				appendTriangles(chunk, from, start.first);
+				from = start.first;
+				if (!shape.mesh.indices.empty()) shapes->push_back(std::move(shape));
+				shape = tinyobj::shape_t();
+				shape.name = start.second;
+			}
+			appendTriangles(chunk, from, chunk.materials.size());
+		}
+		if (!shape.mesh.indices.empty()) shapes->push_back(std::move(shape));
+
+		return true;
+	}
+}
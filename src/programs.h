@@ -1,40 +1,115 @@
 #pragma once
 
+#include <cstddef>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "objects/object/mesh_batch.h"
+#include "objects/object/object.h"
 #include "objects/program.h"
+#include "objects/texture/cubemap.h"
 #include "objects/texture/texture.h"
+#include "objects/texture/texture_array.h"
+#include "objects/uniform_buffer.h"
+
+// What every program needs of the camera and the scene, set once a frame for all of them. Mirrors the std140 block
+// Frame of the shaders, which must declare the same members in the same order
+struct FrameUniforms {
+	glm::mat4 view;
+	glm::mat4 projection;
+	glm::vec3 cameraPosition;
+	float padding0;	// std140 rounds a vec3 up to 16 bytes
+	glm::vec3 lightPosition;
+	float padding1;
+
+	static const GLuint BINDING = 0;
+
+	static char const* name() {
+		return "Frame";
+	}
+
+	static std::vector<UniformBlockMember> members() {
+		return {
+			{ "view", offsetof(FrameUniforms, view) },
+			{ "projection", offsetof(FrameUniforms, projection) },
+			{ "cameraPosition_W", offsetof(FrameUniforms, cameraPosition) },
+			{ "lightPosition_W", offsetof(FrameUniforms, lightPosition) },
+		};
+	}
+
+	FrameUniforms(glm::mat4 view, glm::mat4 projection, glm::vec3 cameraPosition, glm::vec3 lightPosition) :
+		view(view), projection(projection), cameraPosition(cameraPosition), padding0(0.f),
+		lightPosition(lightPosition), padding1(0.f)
+	{}
+};
+// std140 puts a mat4 on a 16 byte boundary and takes 64 bytes for it, and a vec3 on a 16 byte boundary
+static_assert(offsetof(FrameUniforms, view) == 0, "view is not at its std140 offset");
+static_assert(offsetof(FrameUniforms, projection) == 64, "projection is not at its std140 offset");
+static_assert(offsetof(FrameUniforms, cameraPosition) == 128, "cameraPosition is not at its std140 offset");
+static_assert(offsetof(FrameUniforms, lightPosition) == 144, "lightPosition is not at its std140 offset");
+static_assert(sizeof(FrameUniforms) == 160, "FrameUniforms is not the size of its std140 block");
 
 // Store the program used by the objects
 struct ObjectProgram {
 	Program program;
 	UniformLocation model;
-	UniformLocation view;
-	UniformLocation projection;
-	UniformLocation cameraPosition;
-	UniformLocation lightPosition;
+	UniformLocation octahedralNormals;
+	UniformLocation instanced;
 
 	ObjectProgram(char const* vertexPath, char const* fragmentPath) {
 		auto program = Program(vertexPath, fragmentPath);
-		program.getUniformLocation("tex").set(texture::Texture::UNIT);
+		program.getUniformLocation("materials").setSampler(texture::MaterialArrays::UNIT);
+		program.bindUniformBlock<FrameUniforms>();
 		this->model = program.getUniformLocation("model");
-		this->view = program.getUniformLocation("view");
-		this->projection = program.getUniformLocation("projection");
-		this->cameraPosition = program.getUniformLocation("cameraPosition_W");
-		this->lightPosition = program.getUniformLocation("lightPosition_W");
+		this->octahedralNormals = program.getUniformLocation("octahedralNormals");
+		this->instanced = program.getUniformLocation("instanced");
 		this->program = std::move(program);
 	}
+
+	// Set the model matrix of an object, and how to decode its vertex streams
+	void setModel(glm::mat4 model, Object const& object) {
+		this->setDecoding(model, object);
+		this->instanced.set(0u);
+	}
+
+	// Set up the program for Object::drawInstanced, where each instance brings its own model matrix
+	void setInstanced(Object const& object) {
+		this->setDecoding(glm::mat4(1.f), object);
+		this->instanced.set(1u);
+	}
+
+	// Set up the program for MeshBatch::draw, whose streams are not quantized and whose draws each bring their
+	// own model matrix
+	void setBatched() {
+		this->model.set(glm::mat4(1.f));
+		this->octahedralNormals.set(0u);
+		this->instanced.set(1u);
+	}
+
+	// Set up the program for StaticScene::draw, whose streams are not quantized and already in world space
+	void setStatic() {
+		this->model.set(glm::mat4(1.f));
+		this->octahedralNormals.set(0u);
+		this->instanced.set(0u);
+	}
+
+private:
+	void setDecoding(glm::mat4 model, Object const& object) {
+		auto& quantization = object.getQuantization();
+		this->model.set(model * quantization.dequantization);
+		this->octahedralNormals.set(quantization.normals == QuantizedMesh::NormalEncoding::OCTAHEDRAL_16 ? 1u : 0u);
+	}
 };
 
 // Store the program used by the skybox
 struct SkyboxProgram {
 	Program program;
-	UniformLocation view;
-	UniformLocation projection;
 
 	SkyboxProgram(char const* vertexPath, char const* fragmentPath) {
 		auto program = Program(vertexPath, fragmentPath);
-		program.getUniformLocation("skybox").set(texture::Texture::UNIT);
-		this->view = program.getUniformLocation("view");
-		this->projection = program.getUniformLocation("projection");
+		program.getUniformLocation("skybox").setSampler(Cubemap::UNIT);
+		program.bindUniformBlock<FrameUniforms>();
 		this->program = std::move(program);
 	}
 };
@@ -43,17 +118,14 @@ struct SkyboxProgram {
 struct GroundProgram {
 	Program program;
 	UniformLocation model;
-	UniformLocation view;
-	UniformLocation projection;
 	UniformLocation colourMode;
 
 	GroundProgram(char const* vertexPath, char const* fragmentPath) {
 		auto program = Program(vertexPath, fragmentPath);
-		program.getUniformLocation("tex").set(texture::Texture::UNIT);
-		program.getUniformLocation("normalMap").set(texture::NormalMap::UNIT);
+		program.getUniformLocation("tex").setSampler(texture::Texture::UNIT);
+		program.getUniformLocation("normalMap").setSampler(texture::NormalMap::UNIT);
+		program.bindUniformBlock<FrameUniforms>();
 		this->model = program.getUniformLocation("model");
-		this->view = program.getUniformLocation("view");
-		this->projection = program.getUniformLocation("projection");
 		this->colourMode = program.getUniformLocation("colourMode");
 		this->program = std::move(program);
 	}
@@ -63,14 +135,11 @@ struct GroundProgram {
 struct LightProgram {
 	Program program;
 	UniformLocation model;
-	UniformLocation view;
-	UniformLocation projection;
 
 	LightProgram(char const* vertexPath, char const* fragmentPath) {
 		auto program = Program(vertexPath, fragmentPath);
+		program.bindUniformBlock<FrameUniforms>();
 		this->model = program.getUniformLocation("model");
-		this->view = program.getUniformLocation("view");
-		this->projection = program.getUniformLocation("projection");
 		this->program = std::move(program);
 	}
 };
\ No newline at end of file
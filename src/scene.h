@@ -0,0 +1,184 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include "frustum_culling.h"
+
+// Where everything in the world is, stored as structure of arrays: each component of every entity in an array of
+// its own, indexed by entity, so that a pass only touches the components it reads. An entity's world transform is
+// its parent's times its local one. Entities are only ever appended, and a parent has to exist before its children,
+// so parents always come first and a single pass in entity order updates every world transform after its parent's.
+// Only entities whose local transform changed, and their subtrees, are recomputed, and the runs of entities that
+// moved are kept until the next update, so that only those are uploaded again
+class Scene {
+public:
+	typedef uint32_t Entity;
+	static const Entity NONE = (Entity)-1;
+	// For the mesh and material handles of entities that have none
+	static const uint32_t NO_HANDLE = (uint32_t)-1;
+
+	// Axis-aligned box, and the radius of a sphere around its centre holding the same geometry, as a mesh's
+	// bounding sphere is
+	struct Bounds {
+		glm::vec3 min;
+		glm::vec3 max;
+		float radius;
+	};
+
+	// Consecutive entities
+	struct Run {
+		Entity first;
+		Entity count;
+	};
+
+private:
+	std::vector<Entity> parents;
+	std::vector<glm::vec3> positions;
+	std::vector<glm::quat> rotations;
+	std::vector<glm::vec3> scales;
+	std::vector<glm::mat4> worlds;
+	std::vector<Bounds> localBounds;
+	frustum_culling::Volumes worldVolumes;
+	// What to draw an entity with, as handles the renderer hands out. The scene does not look into them
+	std::vector<uint32_t> meshes;
+	std::vector<uint32_t> materials;
+	// Set when an entity's local transform changes, and during an update when its parent moved. Cleared at the end
+	// of the update, only over the runs that moved
+	std::vector<uint8_t> dirty;
+	bool anyDirty;
+	std::vector<Run> moved;	// by the last update
+
+public:
+	Scene() : anyDirty(false) {}
+
+	// Add an entity, under parent unless that is NONE. Its world transform is only valid after the next update
+	Entity create(
+		Entity parent, glm::vec3 position, glm::quat rotation, glm::vec3 scale, Bounds bounds,
+		uint32_t mesh = NO_HANDLE, uint32_t material = NO_HANDLE
+	) {
+		auto entity = (Entity)this->parents.size();
+		assert(parent == NONE || parent < entity);
+		this->parents.push_back(parent);
+		this->positions.push_back(position);
+		this->rotations.push_back(rotation);
+		this->scales.push_back(scale);
+		this->worlds.push_back(glm::mat4(1.f));
+		this->localBounds.push_back(bounds);
+		this->worldVolumes.resize(entity + 1);
+		this->meshes.push_back(mesh);
+		this->materials.push_back(material);
+		this->dirty.push_back(1);
+		this->anyDirty = true;
+		return entity;
+	}
+
+	void setPosition(Entity entity, glm::vec3 position) {
+		this->positions[entity] = position;
+		this->markDirty(entity);
+	}
+
+	void setRotation(Entity entity, glm::quat rotation) {
+		this->rotations[entity] = rotation;
+		this->markDirty(entity);
+	}
+
+	void setScale(Entity entity, glm::vec3 scale) {
+		this->scales[entity] = scale;
+		this->markDirty(entity);
+	}
+
+	// Recompute the world transform and bounds of every entity whose local transform changed since the last
+	// update, and of everything under it
+	void update() {
+		this->moved.clear();
+		if (!this->anyDirty) return;
+		auto count = (Entity)this->parents.size();
+		for (Entity entity = 0; entity < count; entity++) {
+			auto parent = this->parents[entity];
+			if (!this->dirty[entity] && (parent == NONE || !this->dirty[parent])) continue;
+			this->dirty[entity] = 1;
+
+			// Translation times rotation times scale, without the two matrix products
+			auto rotation = glm::mat3_cast(this->rotations[entity]);
+			auto scale = this->scales[entity];
+			auto local = glm::mat4(
+				glm::vec4(rotation[0] * scale.x, 0.f), glm::vec4(rotation[1] * scale.y, 0.f),
+				glm::vec4(rotation[2] * scale.z, 0.f), glm::vec4(this->positions[entity], 1.f)
+			);
+			auto& world = this->worlds[entity];
+			world = parent == NONE ? local : this->worlds[parent] * local;
+			this->setWorldVolume(entity);
+
+			if (!this->moved.empty() && this->moved.back().first + this->moved.back().count == entity) {
+				this->moved.back().count++;
+			} else {
+				this->moved.push_back(Run{ entity, 1 });
+			}
+		}
+		for (auto& run : this->moved) {
+			std::fill(this->dirty.begin() + run.first, this->dirty.begin() + run.first + run.count, (uint8_t)0);
+		}
+		this->anyDirty = false;
+	}
+
+	Entity getEntityCount() const {
+		return (Entity)this->parents.size();
+	}
+
+	// World transforms of every entity, in entity order, as of the last update
+	glm::mat4 const* getWorlds() const {
+		return this->worlds.data();
+	}
+
+	glm::mat4 const& getWorld(Entity entity) const {
+		return this->worlds[entity];
+	}
+
+	// World bounding volumes of every entity, in entity order, as of the last update
+	frustum_culling::Volumes const& getWorldVolumes() const {
+		return this->worldVolumes;
+	}
+
+	glm::vec3 getPosition(Entity entity) const {
+		return this->positions[entity];
+	}
+
+	uint32_t getMesh(Entity entity) const {
+		return this->meshes[entity];
+	}
+
+	uint32_t getMaterial(Entity entity) const {
+		return this->materials[entity];
+	}
+
+	// Runs of entities whose world transform the last update changed, in entity order
+	std::vector<Run> const& getMoved() const {
+		return this->moved;
+	}
+
+private:
+	void markDirty(Entity entity) {
+		this->dirty[entity] = 1;
+		this->anyDirty = true;
+	}
+
+	// The box around the entity's transformed box: its centre transformed, and its half extents through the
+	// absolute values of the matrix (Arvo). The sphere grows with the largest scale of the matrix
+	void setWorldVolume(Entity entity) {
+		auto& bounds = this->localBounds[entity];
+		auto& world = this->worlds[entity];
+		auto centre = glm::vec3(world * glm::vec4((bounds.min + bounds.max) / 2.f, 1.f));
+		auto extent = (bounds.max - bounds.min) / 2.f;
+		auto worldExtent = glm::abs(glm::vec3(world[0])) * extent.x + glm::abs(glm::vec3(world[1])) * extent.y +
+			glm::abs(glm::vec3(world[2])) * extent.z;
+		auto scale = std::max(glm::length(glm::vec3(world[0])), glm::length(glm::vec3(world[1])));
+		scale = std::max(scale, glm::length(glm::vec3(world[2])));
+		this->worldVolumes.set(entity, centre, worldExtent, bounds.radius * scale);
+	}
+};
\ No newline at end of file
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+// A fixed set of worker threads running submitted jobs in submission order
+class ThreadPool {
+	std::vector<std::thread> workers;
+	std::queue<std::function<void()>> jobs;
+	std::mutex mutex;
+	std::condition_variable wake;
+	bool stopping;
+
+public:
+	// Start the given number of workers, or one per hardware thread if 0
+	explicit ThreadPool(unsigned int threadCount = 0) : stopping(false) {
+		if (threadCount == 0) threadCount = std::max(1u, std::thread::hardware_concurrency());
+		for (unsigned int i = 0; i < threadCount; i++) {
+			this->workers.emplace_back([this] { this->work(); });
+		}
+	}
+
+	// The workers hold a pointer to the pool, so it can be neither copied nor moved
+	ThreadPool(ThreadPool const&) = delete;
+	ThreadPool& operator=(ThreadPool const&) = delete;
+
+	// Finish every job already submitted, then stop the workers
+	~ThreadPool() {
+		{
+			auto lock = std::unique_lock<std::mutex>(this->mutex);
+			this->stopping = true;
+		}
+		this->wake.notify_all();
+		for (auto& worker : this->workers) worker.join();
+	}
+
+	unsigned int getThreadCount() const {
+		return (unsigned int)this->workers.size();
+	}
+
+	// Run the job on a worker, returning a future for its result
+	template<typename Job>
+	auto submit(Job job) -> std::future<decltype(job())> {
+		// std::function needs a copyable callable, so the task is shared rather than moved in
+		auto task = std::make_shared<std::packaged_task<decltype(job())()>>(std::move(job));
+		auto result = task->get_future();
+		{
+			auto lock = std::unique_lock<std::mutex>(this->mutex);
+			this->jobs.push([task] { (*task)(); });
+		}
+		this->wake.notify_one();
+		return result;
+	}
+
+private:
+	void work() {
+		while (true) {
+			std::function<void()> job;
+			{
+				auto lock = std::unique_lock<std::mutex>(this->mutex);
+				this->wake.wait(lock, [this] { return this->stopping || !this->jobs.empty(); });
+				if (this->jobs.empty()) return;
+				job = std::move(this->jobs.front());
+				this->jobs.pop();
+			}
+			job();
+		}
+	}
+};
+
+// Call fn(begin, end) over contiguous slices of [0, count), on up to one thread per hardware thread.
+// Slices are at least minSlice long, so that small ranges are handled on the calling thread alone
+template<typename Fn>
+void parallelFor(size_t count, size_t minSlice, Fn fn) {
+	auto threadCount = (size_t)std::max(1u, std::thread::hardware_concurrency());
+	auto sliceCount = std::max<size_t>(1, std::min(threadCount, count / std::max<size_t>(1, minSlice)));
+	auto workers = std::vector<std::thread>();
+	for (size_t i = 1; i < sliceCount; i++) {
+		workers.emplace_back(fn, count * i / sliceCount, count * (i + 1) / sliceCount);
+	}
+	fn(0, count / sliceCount);
+	for (auto& worker : workers) worker.join();
+}
+
+// As parallelFor, on the workers of a pool and the calling thread rather than on threads started for the call, for
+// work repeated every frame. The calling thread waits for the pool, so it must not be one of its workers
+template<typename Fn>
+void parallelFor(ThreadPool& pool, size_t count, size_t minSlice, Fn fn) {
+	auto threadCount = (size_t)pool.getThreadCount() + 1;
+	auto sliceCount = std::max<size_t>(1, std::min(threadCount, count / std::max<size_t>(1, minSlice)));
+	auto done = std::vector<std::future<void>>();
+	for (size_t i = 1; i < sliceCount; i++) {
+		auto begin = count * i / sliceCount;
+		auto end = count * (i + 1) / sliceCount;
+		done.push_back(pool.submit([&fn, begin, end] { fn(begin, end); }));
+	}
+	fn(0, count / sliceCount);
+	for (auto& slice : done) slice.get();
+}
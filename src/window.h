@@ -10,6 +10,8 @@
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 
+#include "objects/gl_state.h"
+
 //Represents a constructed GLFW window and OpenGL context.
 template<typename RenderData>
 class Window {
@@ -55,7 +57,9 @@ public:
 
 		glfwSetInputMode(this->window, GLFW_STICKY_KEYS, true);
 
-		glEnable(GL_MULTISAMPLE);
+		// Nothing set on an earlier context carries over to this one
+		gl_state::invalidate();
+		gl_state::enable(GL_MULTISAMPLE);
 	}
 
 	// A window uniquely manages a GLFW context that cannot be copied